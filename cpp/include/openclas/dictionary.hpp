@@ -10,12 +10,24 @@
 #define _OPENCLAS_DICTIONARY_HPP_
 
 #include "common.hpp"
+#include "utility.hpp"
 #include <vector>
 #include <list>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <functional>	//	for std::greater
+#include <stdexcept>	//	for std::length_error, std::runtime_error
+#include <utility>	//	for std::pair
+#include <cmath>	//	for log()
+#include <boost/cstdint.hpp>	//	for boost::uint64_t
 
 using namespace std;
 
 namespace openclas {
+	///	the id returned for a word which does not exist in the dictionary
+	const size_t INVALID_WORD_ID = static_cast<size_t>(-1);
+
 	class TagEntry {
 	public:
 		int tag;
@@ -31,6 +43,99 @@ namespace openclas {
 		}
 	};
 
+	/*******************************************************************
+	*
+	*	TransitTable
+	*
+	********************************************************************/
+
+	class TransitEntry {
+	public:
+		size_t id;
+		double weight;
+	public:
+		TransitEntry(size_t id = 0, double weight = 0)
+			: id(id), weight(weight)
+		{
+		}
+		bool operator<(const TransitEntry& other) const
+		{
+			return this->id < other.id;
+		}
+	};
+
+	///	Word transit (bigram) table of one word.
+	///	The entries are kept in a sorted array by the id of the other word,
+	///	so the lookup is a binary search without constructing any string.
+	class TransitTable {
+	public:
+		typedef std::vector<TransitEntry> container_type;
+		typedef container_type::const_iterator const_iterator;
+	public:
+		void set(size_t id, double weight)
+		{
+			container_type::iterator iter = std::lower_bound(m_table.begin(), m_table.end(), TransitEntry(id));
+			if (iter != m_table.end() && iter->id == id)
+				iter->weight = weight;
+			else
+				m_table.insert(iter, TransitEntry(id, weight));
+		}
+
+		///	@returns the weight of the transit to given word id, or 0 if not exist.
+		double get(size_t id) const
+		{
+			const_iterator iter = std::lower_bound(m_table.begin(), m_table.end(), TransitEntry(id));
+			if (iter != m_table.end() && iter->id == id)
+				return iter->weight;
+			else
+				return 0;
+		}
+
+		void remove(size_t id)
+		{
+			container_type::iterator iter = std::lower_bound(m_table.begin(), m_table.end(), TransitEntry(id));
+			if (iter != m_table.end() && iter->id == id)
+				m_table.erase(iter);
+		}
+
+		///	Remove the transit to given word id, and shift all the ids after it,
+		///	which is used when a word is removed from the dictionary.
+		void remove_and_shift(size_t id)
+		{
+			remove(id);
+			for (container_type::iterator iter = std::upper_bound(m_table.begin(), m_table.end(), TransitEntry(id)); iter != m_table.end(); ++iter)
+				--iter->id;
+		}
+
+		void clear()
+		{
+			m_table.clear();
+		}
+
+		size_t size() const
+		{
+			return m_table.size();
+		}
+
+		bool empty() const
+		{
+			return m_table.empty();
+		}
+
+		const_iterator begin() const
+		{
+			return m_table.begin();
+		}
+
+		const_iterator end() const
+		{
+			return m_table.end();
+		}
+
+	protected:
+		container_type m_table;
+	};
+
 	/*******************************************************************
 	*
 	*	DictEntry
@@ -39,14 +144,21 @@ namespace openclas {
 
 	class DictEntry{
 	public:
-		typedef std::map<std::wstring, double> transit_type;
+		typedef TransitTable transit_type;
 
+		//	the index of the entry in Dictionary::words()
+		size_t id;
 		std::wstring word;
 		std::vector<TagEntry> tags;
-		//	transit table
+		//	transit table, indexed by the id of the other word
 		transit_type backward;
 		transit_type forward;
 	public:
+		DictEntry()
+			: id(0)
+		{
+		}
+
 		void add(int tag, int weight)
 		{
 			std::vector<TagEntry>::iterator iter = find(this->tags.begin(), this->tags.end(), TagEntry(tag));
@@ -65,29 +177,30 @@ namespace openclas {
 				this->tags.erase(iter);
 		}
 
-		double get_forward_weight(const std::wstring& word) const
+		double get_forward_weight(size_t next_id) const
 		{
-			transit_type::const_iterator iter = forward.find(word);
-			if (iter != forward.end())
-			{
-				return iter->second;
-			}else{
-				return 0;
-			}
+			return forward.get(next_id);
 		}
 
-		double get_backward_weight(const std::wstring& word) const
+		double get_backward_weight(size_t previous_id) const
 		{
-			transit_type::const_iterator iter = backward.find(word);
-			if (iter != backward.end())
-			{
-				return iter->second;
-			}else{
-				return 0;
-			}
+			return backward.get(previous_id);
 		}
 	};	//	class DictEntry
 
+	///	Prefix visitor which collects all the found values into a list.
+	template <typename ValueType>
+	struct prefix_collector {
+		std::vector<ValueType>& value_list;
+		prefix_collector(std::vector<ValueType>& value_list)
+			: value_list(value_list)
+		{}
+		void operator() (ValueType value, size_t /*length*/)
+		{
+			value_list.push_back(value);
+		}
+	};
+
 	/*******************************************************************
 	*
 	*	WordIndexer
@@ -104,9 +217,16 @@ namespace openclas {
 		}
 
 		virtual ~WordIndexer()
+		{
+			clear();
+		}
+
+		void clear()
 		{
 			for(map_type::iterator iter = m_table.begin(); iter != m_table.end(); ++iter)
 				delete iter->second;
+			m_table.clear();
+			m_entry_ptr = 0;
 		}
 
 		void add(const std::wstring& word, DictEntry* entry_ptr)
@@ -201,18 +321,30 @@ namespace openclas {
 
 		void prefix(std::wstring::const_iterator iter, std::wstring::const_iterator end, std::vector<DictEntry*>& entry_list) const
 		{
-			if (m_entry_ptr)
-				entry_list.push_back(m_entry_ptr);
+			prefix_collector<DictEntry*> collector(entry_list);
+			for_each_prefix(iter, end, collector);
+		}
 
-			if (iter == end)
+		///	Walk through the prefixes of given sequence without any allocation,
+		///	visitor(DictEntry* entry, size_t length) will be called for each found word.
+		///	Any forward iterator of wchar_t can be used, such as Utf8Iterator.
+		template <class Iterator, class Visitor>
+		void for_each_prefix(Iterator iter, Iterator end, Visitor& visitor) const
+		{
+			const WordIndexer* node = this;
+			for (size_t length = 0; ; ++length, ++iter)
 			{
-				return;
-			}
+				if (node->m_entry_ptr)
+					visitor(node->m_entry_ptr, length);
 
-			map_type::const_iterator it = m_table.find(*iter);
-			if (it != m_table.end())
-			{
-				it->second->prefix(iter+1, end, entry_list);
+				if (iter == end)
+					return;
+
+				map_type::const_iterator it = node->m_table.find(*iter);
+				if (it == node->m_table.end())
+					return;
+
+				node = it->second;
 			}
 		}
 
@@ -224,182 +356,1555 @@ namespace openclas {
 
 	/*******************************************************************
 	*
-	*	Dictionary
+	*	DoubleArrayIndexer
 	*
 	********************************************************************/
 
-	class Dictionary {
+	///	Frozen double-array trie.
+	///	It maps words to non-negative integer values, and it is built once from the whole
+	///	word list instead of word by word. Each character is translated into a dense code,
+	///	and a transition from state s by code c is the state t = base[s] + c, which is valid
+	///	only if check[t] == s. So the lookup cost is one or two array probes per character,
+	///	and all the states are stored in a few contiguous arrays.
+	class DoubleArrayIndexer {
 	public:
-		typedef std::vector<DictEntry*> word_dict_type;
-		typedef std::vector<int> tag_dict_type;
-		typedef std::vector<int> tag_transit_dict_type;
-		typedef WordIndexer word_indexer_type;
+		typedef std::pair<std::wstring, int> key_type;
+		enum { npos = -1 };
+		///	code of a symbol out of BMP
+		struct extra_code_type {
+			unsigned int symbol;
+			int code;
+			bool operator<(const extra_code_type& other) const
+			{
+				return symbol < other.symbol;
+			}
+		};
+		enum { BMP_CODE_SIZE = 0x10000 };
 	public:
-		Dictionary()
+		DoubleArrayIndexer()
+			: m_next_check(1)
 		{
+			clear();
 		}
 
-		virtual ~Dictionary()
+		void clear()
 		{
-			for(word_dict_type::iterator iter = m_word_dict.begin(); iter != m_word_dict.end(); ++iter)
-			{
-				delete (*iter);
-			}
+			m_base.clear();
+			m_check.clear();
+			m_value.clear();
+			m_bmp_code.clear();
+			m_extra_code.clear();
+			m_next_check = 1;
+
+			m_base_ptr = 0;
+			m_check_ptr = 0;
+			m_value_ptr = 0;
+			m_size = 0;
+			m_bmp_code_ptr = 0;
+			m_extra_code_ptr = 0;
+			m_extra_code_count = 0;
 		}
 
-		/*****************   Word   *****************/
-		DictEntry* add_word(const std::wstring& word)
+		bool empty() const
 		{
-			DictEntry* entry_ptr = get_word(word.begin(), word.end());
+			return m_size == 0;
+		}
 
-			if (entry_ptr)
-			{
-				//	exists, then return the index
-				return entry_ptr;
-			}else{
-				//	not exists, create new one
-				DictEntry* ptr = new DictEntry();
-				ptr->word = word;
-				m_word_dict.push_back(ptr);
-				m_word_indexer.add(word.begin(), word.end(), ptr);
-				
-				if (m_longest_word_length < word.length())
-					m_longest_word_length = word.length();
+		///	number of states (the length of base/check arrays)
+		size_t size() const
+		{
+			return m_size;
+		}
 
-				return ptr;
-			}
+		///	Build the trie from given (word, value) list, the list will be sorted.
+		///	The words should be unique, and the values should be non-negative.
+		void build(std::vector<key_type>& keys)
+		{
+			clear();
+			std::sort(keys.begin(), keys.end());
+
+			build_code_table(keys);
+
+			//	state 0 is the root
+			resize(keys.size() * 2 + 1);
+			m_check[0] = 0;
+			insert(0, keys, 0, keys.size(), 0);
+
+			//	remove the unused tail
+			size_t last = m_check.size();
+			while (last > 1 && m_check[last - 1] < 0)
+				--last;
+			m_base.resize(last);
+			m_check.resize(last);
+			m_value.resize(last);
+
+			m_base_ptr = &m_base[0];
+			m_check_ptr = &m_check[0];
+			m_value_ptr = &m_value[0];
+			m_size = last;
+			m_bmp_code_ptr = &m_bmp_code[0];
+			m_extra_code_ptr = m_extra_code.empty() ? 0 : &m_extra_code[0];
+			m_extra_code_count = m_extra_code.size();
 		}
 
-		void remove_word(const std::wstring& word)
+		/**	Use the arrays owned by others, such as a memory mapped dictionary image.
+		*	Nothing will be copied, so the arrays must outlive the indexer.
+		*	@param bmp_code should have BMP_CODE_SIZE items.
+		*	@param extra_code should be sorted by symbol.
+		*/
+		void assign(const int* base, const int* check, const int* value, size_t size,
+			const unsigned short* bmp_code, const extra_code_type* extra_code, size_t extra_code_count)
 		{
-			const DictEntry* entry_ptr = get_word(word.begin(), word.end());
-			if (entry_ptr)
-			{
-				m_word_indexer.remove(word.begin(), word.end());
-				word_dict_type::iterator iter = std::find(m_word_dict.begin(), m_word_dict.end(), entry_ptr);
-				if (iter != m_word_dict.end())
-					m_word_dict.erase(iter);
+			clear();
+			m_base_ptr = base;
+			m_check_ptr = check;
+			m_value_ptr = value;
+			m_size = size;
+			m_bmp_code_ptr = bmp_code;
+			m_extra_code_ptr = extra_code;
+			m_extra_code_count = extra_code_count;
+		}
 
-				delete entry_ptr;	//	release memory
-			}
+		const int* base() const { return m_base_ptr; }
+		const int* check() const { return m_check_ptr; }
+		const int* value() const { return m_value_ptr; }
+		const unsigned short* bmp_code() const { return m_bmp_code_ptr; }
+		const extra_code_type* extra_code() const { return m_extra_code_ptr; }
+		size_t extra_code_count() const { return m_extra_code_count; }
+
+		int get(const std::wstring& word) const
+		{
+			return get(word.begin(), word.end());
 		}
 
-		DictEntry* get_word(const std::wstring& word)
+		int get(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
 		{
-			return get_word(word.begin(), word.end());
+			if (empty())
+				return npos;
+
+			int state = 0;
+			for (; iter != end; ++iter)
+			{
+				state = next_state(state, *iter);
+				if (state < 0)
+					return npos;
+			}
+			return m_value_ptr[state];
 		}
 
-		const DictEntry* get_word(const std::wstring& word) const
+		std::vector<int> prefix(const std::wstring& word) const
 		{
-			return get_word(word.begin(), word.end());
+			std::vector<int> value_list;
+			prefix(word.begin(), word.end(), value_list);
+			return value_list;
 		}
 
-		DictEntry* get_word(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
+		void prefix(std::wstring::const_iterator iter, std::wstring::const_iterator end, std::vector<int>& value_list) const
 		{
-			return m_word_indexer.get(iter, end);
+			prefix_collector<int> collector(value_list);
+			for_each_prefix(iter, end, collector);
 		}
 
-		std::vector<DictEntry*> prefix(const std::wstring& word) const
+		///	Walk through the prefixes of given sequence without any allocation,
+		///	visitor(int value, size_t length) will be called for each found word.
+		///	Any forward iterator of wchar_t can be used, such as Utf8Iterator.
+		template <class Iterator, class Visitor>
+		void for_each_prefix(Iterator iter, Iterator end, Visitor& visitor) const
 		{
-			return prefix(word.begin(), word.end());
+			if (empty())
+				return;
+
+			int state = 0;
+			for (size_t length = 0; ; ++length)
+			{
+				if (m_value_ptr[state] != npos)
+					visitor(m_value_ptr[state], length);
+
+				if (iter == end)
+					return;
+
+				state = next_state(state, *iter++);
+				if (state < 0)
+					return;
+			}
 		}
 
-		std::vector<DictEntry*> prefix(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
+	private:
+		//	the pointers refer to the member arrays or the borrowed ones, so copy is not allowed.
+		DoubleArrayIndexer(const DoubleArrayIndexer&);
+		DoubleArrayIndexer& operator=(const DoubleArrayIndexer&);
+
+	protected:
+		struct child_type {
+			wchar_t symbol;
+			int code;
+			size_t begin;
+			size_t end;
+		};
+
+		int get_code(wchar_t symbol) const
 		{
-			return m_word_indexer.prefix(iter, end);
+			unsigned long value = static_cast<unsigned long>(symbol);
+			if (value < BMP_CODE_SIZE)
+				return m_bmp_code_ptr[value];
+
+			extra_code_type key;
+			key.symbol = static_cast<unsigned int>(value);
+			const extra_code_type* end = m_extra_code_ptr + m_extra_code_count;
+			const extra_code_type* iter = std::lower_bound(m_extra_code_ptr, end, key);
+			if (iter != end && iter->symbol == key.symbol)
+				return iter->code;
+			else
+				return 0;
 		}
 
-		size_t longest_word_length()
+		int next_state(int state, wchar_t symbol) const
 		{
-			return m_longest_word_length;
+			int code = get_code(symbol);
+			if (code == 0)
+				return npos;
+
+			//	the unsigned comparison rejects the negative states as well
+			int next = m_base_ptr[state] + code;
+			if (static_cast<size_t>(next) < m_size && m_check_ptr[next] == state)
+				return next;
+			else
+				return npos;
 		}
 
-		const word_dict_type& words() const
+		///	Assign the codes by the frequency of the symbols, so the most frequent
+		///	symbols get the smallest codes and the arrays stay dense.
+		void build_code_table(const std::vector<key_type>& keys)
 		{
-			return m_word_dict;
+			std::map<wchar_t, size_t> frequency;
+			for (std::vector<key_type>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+				for (std::wstring::const_iterator it = iter->first.begin(); it != iter->first.end(); ++it)
+					++frequency[*it];
+
+			std::vector<std::pair<size_t, wchar_t> > order;
+			for (std::map<wchar_t, size_t>::iterator iter = frequency.begin(); iter != frequency.end(); ++iter)
+				order.push_back(std::make_pair(iter->second, iter->first));
+			std::sort(order.rbegin(), order.rend());
+
+			if (order.size() >= 0xFFFF)
+				throw std::length_error("Too many symbols for DoubleArrayIndexer.");
+
+			m_bmp_code.assign(BMP_CODE_SIZE, 0);
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				int code = static_cast<int>(i + 1);
+				unsigned long value = static_cast<unsigned long>(order[i].second);
+				if (value < BMP_CODE_SIZE)
+				{
+					m_bmp_code[value] = static_cast<unsigned short>(code);
+				}else{
+					extra_code_type extra;
+					extra.symbol = static_cast<unsigned int>(value);
+					extra.code = code;
+					m_extra_code.push_back(extra);
+				}
+			}
+			std::sort(m_extra_code.begin(), m_extra_code.end());
+
+			//	the codes are looked up during the insertion
+			m_bmp_code_ptr = &m_bmp_code[0];
+			m_extra_code_ptr = m_extra_code.empty() ? 0 : &m_extra_code[0];
+			m_extra_code_count = m_extra_code.size();
 		}
 
-		/*****************   Tag   *****************/
-		void init_tag_dict(int size)
+		void resize(size_t size)
 		{
-			//	initialize tag table
-			m_tag_dict.clear();
-			m_tag_dict.resize(size, 0);
-			//	initialize tag transit table
-			m_tag_transit_dict.clear();
-			m_tag_transit_dict.resize(size*size, 0);
+			if (size > m_base.size())
+			{
+				m_base.resize(size, 0);
+				m_check.resize(size, -1);
+				m_value.resize(size, npos);
+			}
 		}
 
-		int get_tag_total_weight()
+		///	Find a base, which makes all (base + code) free.
+		int find_base(const std::vector<child_type>& children)
 		{
-			return m_tag_total_weight;
+			int first_code = children.front().code;
+			int max_code = 0;
+			for (size_t i = 0; i < children.size(); ++i)
+				max_code = std::max(max_code, children[i].code);
+
+			int pos = std::max(m_next_check, first_code + 1);
+			size_t occupied = 0;
+			bool first_free = true;
+			for (;; ++pos)
+			{
+				resize(static_cast<size_t>(pos - first_code + max_code + 1) * 2);
+
+				if (m_check[pos] >= 0)
+				{
+					++occupied;
+					continue;
+				}else if (first_free){
+					//	move the start position forward if the scanned area is almost full.
+					if (occupied * 20 >= static_cast<size_t>(pos - m_next_check + 1) * 19)
+						m_next_check = pos;
+					first_free = false;
+				}
+
+				int base = pos - first_code;
+				bool found = true;
+				for (size_t i = 1; i < children.size(); ++i)
+				{
+					if (m_check[base + children[i].code] >= 0)
+					{
+						found = false;
+						break;
+					}
+				}
+				if (found)
+					return base;
+			}
 		}
 
-		void set_tag_total_weight(int weight)
+		void insert(int state, const std::vector<key_type>& keys, size_t begin, size_t end, size_t depth)
 		{
-			m_tag_total_weight = weight;
+			//	the word ends at current state
+			if (begin < end && keys[begin].first.length() == depth)
+			{
+				m_value[state] = keys[begin].second;
+				++begin;
+			}
+
+			if (begin == end)
+				return;
+
+			//	group the keys by the symbol at [depth]
+			std::vector<child_type> children;
+			for (size_t i = begin; i < end; ++i)
+			{
+				wchar_t symbol = keys[i].first[depth];
+				if (children.empty() || children.back().symbol != symbol)
+				{
+					child_type child;
+					child.symbol = symbol;
+					child.code = get_code(symbol);
+					child.begin = i;
+					child.end = i + 1;
+					children.push_back(child);
+				}else{
+					children.back().end = i + 1;
+				}
+			}
+
+			//	occupy all the children before going deeper.
+			int base = find_base(children);
+			m_base[state] = base;
+			for (size_t i = 0; i < children.size(); ++i)
+				m_check[base + children[i].code] = state;
+
+			for (size_t i = 0; i < children.size(); ++i)
+				insert(base + children[i].code, keys, children[i].begin, children[i].end, depth + 1);
 		}
 
-		void add_tag_weight(int tag, int weight)
+	protected:
+		//	storage of a built trie
+		std::vector<int> m_base;
+		std::vector<int> m_check;
+		std::vector<int> m_value;
+		//	symbol -> code
+		std::vector<unsigned short> m_bmp_code;
+		std::vector<extra_code_type> m_extra_code;
+		//	the first position which might be free
+		int m_next_check;
+
+		//	the arrays used by lookup, either the storage above or the borrowed ones.
+		const int* m_base_ptr;
+		const int* m_check_ptr;
+		const int* m_value_ptr;
+		size_t m_size;
+		const unsigned short* m_bmp_code_ptr;
+		const extra_code_type* m_extra_code_ptr;
+		size_t m_extra_code_count;
+	};
+
+	/*******************************************************************
+	*
+	*	DictionaryImage
+	*
+	********************************************************************/
+
+	/**	OCD v2 dictionary image.
+	*	The image is a header followed by flat arrays, and every array is referred by
+	*	its offset from the beginning of the image, so it is position-independent and
+	*	can be memory mapped read-only and used in place without any parsing.
+	*	The image is stored in the native byte order and the native wchar_t.
+	*/
+	const unsigned int DICT_IMAGE_MAGIC_CODE = ('O' << 24 | 'C' << 16 | 'D' << 8 | '2');
+	const unsigned int DICT_IMAGE_VERSION = 2;
+	//	every section starts at the multiple of it
+	const size_t DICT_IMAGE_ALIGNMENT = 8;
+
+	enum DictImageSection {
+		IMAGE_TAG,			//	int[tag_count]
+		IMAGE_TAG_TRANSIT,	//	int[tag_count * tag_count]
+		IMAGE_BASE,			//	int[state_count]
+		IMAGE_CHECK,		//	int[state_count]
+		IMAGE_VALUE,		//	int[state_count], the word id
+		IMAGE_BMP_CODE,		//	unsigned short[DoubleArrayIndexer::BMP_CODE_SIZE]
+		IMAGE_EXTRA_CODE,	//	DoubleArrayIndexer::extra_code_type[extra_code_count]
+		IMAGE_ENTRY,		//	DictImageEntry[word_count]
+		IMAGE_TAG_ITEM,		//	TagEntry[tag_item_count]
+		IMAGE_TRANSIT,		//	DictImageTransit[transit_count], sorted by id within each entry
+		IMAGE_TEXT,			//	wchar_t[text_length], the words without terminator
+		IMAGE_SECTION_COUNT
+	};
+
+	struct DictImageHeader {
+		unsigned int magic_code;
+		unsigned int version;
+		unsigned int wchar_size;
+		unsigned int tag_count;
+		int tag_total_weight;
+		unsigned int word_count;
+		unsigned int longest_word_length;
+		unsigned int state_count;
+		unsigned int extra_code_count;
+		unsigned int tag_item_count;
+		unsigned int transit_count;
+		unsigned int text_length;
+		unsigned int offset[IMAGE_SECTION_COUNT];
+	};
+
+	///	The word of id i is the i-th entry, and its tags and forward transits are
+	///	the ranges of the tag item and transit arrays.
+	struct DictImageEntry {
+		unsigned int text_offset;
+		unsigned int length;
+		unsigned int tag_offset;
+		unsigned int tag_count;
+		unsigned int transit_offset;
+		unsigned int transit_count;
+	};
+
+	struct DictImageTransit {
+		unsigned int id;
+		int weight;
+		bool operator<(const DictImageTransit& other) const
 		{
-			if (static_cast<int>(m_tag_dict.size()) > tag)
-				m_tag_dict[tag] = weight;
+			return this->id < other.id;
 		}
+	};
 
-		void remove_tag_weight(int tag)
+	class DictionaryImage {
+	public:
+		DictionaryImage()
+			: m_data(0), m_size(0)
 		{
-			if (static_cast<int>(m_tag_dict.size()) > tag)
-				m_tag_dict[tag] = 0;
 		}
 
-		double get_tag_weight(int tag) const
+		/**	@param holder keeps the memory alive, such as a mapped file or a buffer,
+		*	it is shared by all the copies of the image.
+		*	@throws std::runtime_error if the image is not a valid OCD v2 image.
+		*/
+		DictionaryImage(const char* data, size_t size, boost::shared_ptr<void> holder)
+			: m_data(data), m_size(size), m_holder(holder)
 		{
-			if (static_cast<int>(m_tag_dict.size()) > tag)
-				return m_tag_dict[tag];
-			else
-				return 0;
+			validate();
 		}
 
-		const tag_dict_type& tags() const
+		bool empty() const
 		{
-			return m_tag_dict;
+			return m_data == 0;
 		}
 
-		/*****************   Tag transit   *****************/
-		int get_tag_transit_index(int current_tag, int next_tag) const
+		const char* data() const
 		{
-			return static_cast<int>((current_tag * m_tag_dict.size()) + next_tag);
+			return m_data;
 		}
 
-		void add_tag_transit_weight(int current_tag, int next_tag, int weight)
+		size_t size() const
 		{
-			int index = get_tag_transit_index(current_tag, next_tag);
-			m_tag_transit_dict.at(index) = weight;
+			return m_size;
 		}
 
-		void add_tag_transit_weight(int tags_index, int weight)
+		const DictImageHeader& header() const
 		{
-			if (tags_index < static_cast<int>(m_tag_transit_dict.size()))
-				m_tag_transit_dict.at(tags_index) = weight;
+			return *reinterpret_cast<const DictImageHeader*>(m_data);
 		}
 
-		void remove_tag_transit_weight(int current_tag, int next_tag)
+		template <typename T>
+		const T* section(DictImageSection section) const
 		{
-			int index = get_tag_transit_index(current_tag, next_tag);
-			m_tag_transit_dict.at(index) = 0;
+			return reinterpret_cast<const T*>(m_data + header().offset[section]);
 		}
 
-		int get_tag_transit_weight(int current_tag, int next_tag) const
+		///	size of a section in bytes
+		static size_t section_size(const DictImageHeader& header, DictImageSection section)
 		{
-			int index = get_tag_transit_index(current_tag, next_tag);
-			return m_tag_transit_dict.at(index);
+			switch (section)
+			{
+			case IMAGE_TAG:
+				return header.tag_count * sizeof(int);
+			case IMAGE_TAG_TRANSIT:
+				return static_cast<size_t>(header.tag_count) * header.tag_count * sizeof(int);
+			case IMAGE_BASE:
+			case IMAGE_CHECK:
+			case IMAGE_VALUE:
+				return header.state_count * sizeof(int);
+			case IMAGE_BMP_CODE:
+				return DoubleArrayIndexer::BMP_CODE_SIZE * sizeof(unsigned short);
+			case IMAGE_EXTRA_CODE:
+				return header.extra_code_count * sizeof(DoubleArrayIndexer::extra_code_type);
+			case IMAGE_ENTRY:
+				return header.word_count * sizeof(DictImageEntry);
+			case IMAGE_TAG_ITEM:
+				return header.tag_item_count * sizeof(TagEntry);
+			case IMAGE_TRANSIT:
+				return header.transit_count * sizeof(DictImageTransit);
+			case IMAGE_TEXT:
+				return header.text_length * sizeof(wchar_t);
+			default:
+				return 0;
+			}
 		}
 
-		const tag_transit_dict_type& tags_transit() const
+	protected:
+		void validate() const
 		{
-			return m_tag_transit_dict;
+			if (m_data == 0 || m_size < sizeof(DictImageHeader))
+				throw std::runtime_error("The dictionary image is truncated.");
+
+			const DictImageHeader& h = header();
+			if (h.magic_code != DICT_IMAGE_MAGIC_CODE || h.version != DICT_IMAGE_VERSION)
+				throw std::runtime_error("The dictionary image is not in OCD v2 format.");
+			if (h.wchar_size != sizeof(wchar_t))
+				throw std::runtime_error("The dictionary image is built with a different wchar_t.");
+			if (h.state_count == 0)
+				throw std::runtime_error("The dictionary image has no index.");
+
+			for (int i = 0; i < IMAGE_SECTION_COUNT; ++i)
+			{
+				DictImageSection s = static_cast<DictImageSection>(i);
+				if (h.offset[i] % DICT_IMAGE_ALIGNMENT != 0 || h.offset[i] > m_size || section_size(h, s) > m_size - h.offset[i])
+					throw std::runtime_error("The dictionary image is corrupted.");
+			}
+
+			//	the ranges of the entries and the ids are used without check afterwards
+			const DictImageEntry* entry = section<DictImageEntry>(IMAGE_ENTRY);
+			for (unsigned int i = 0; i < h.word_count; ++i)
+			{
+				if (entry[i].text_offset > h.text_length || entry[i].length > h.text_length - entry[i].text_offset
+					|| entry[i].tag_offset > h.tag_item_count || entry[i].tag_count > h.tag_item_count - entry[i].tag_offset
+					|| entry[i].transit_offset > h.transit_count || entry[i].transit_count > h.transit_count - entry[i].transit_offset)
+					throw std::runtime_error("The dictionary image is corrupted.");
+			}
+			const DictImageTransit* transit = section<DictImageTransit>(IMAGE_TRANSIT);
+			for (unsigned int i = 0; i < h.transit_count; ++i)
+			{
+				if (transit[i].id >= h.word_count)
+					throw std::runtime_error("The dictionary image is corrupted.");
+			}
+			const int* value = section<int>(IMAGE_VALUE);
+			for (unsigned int i = 0; i < h.state_count; ++i)
+			{
+				if (value[i] != DoubleArrayIndexer::npos && (value[i] < 0 || static_cast<unsigned int>(value[i]) >= h.word_count))
+					throw std::runtime_error("The dictionary image is corrupted.");
+			}
+		}
+
+	protected:
+		const char* m_data;
+		size_t m_size;
+		boost::shared_ptr<void> m_holder;
+	};
+
+	/*******************************************************************
+	*
+	*	BigramHash
+	*
+	********************************************************************/
+
+	/**	Frozen minimal perfect hash of the word id pairs, built by Compress-Hash-Displace (CHD).
+	*	The keys are split into buckets by a first hash, and the buckets are placed from the
+	*	largest one, each with the first displacement d that sends all of its keys to free slots
+	*	by a second hash seeded by d. So n keys take n slots, and a lookup is one probe of the
+	*	displacement and one of the slot. Each slot keeps a 32 bits fingerprint of its key to
+	*	reject most of the absent keys, the caller keeps the values in the slot order.
+	*/
+	class BigramHash {
+	public:
+		typedef boost::uint64_t key_type;
+		enum { npos = -1 };
+		//	average keys per bucket
+		enum { BUCKET_SIZE = 4 };
+	public:
+		static key_type make_key(size_t current_id, size_t next_id)
+		{
+			return (static_cast<key_type>(current_id) << 32) | static_cast<key_type>(next_id & 0xFFFFFFFF);
+		}
+
+		void clear()
+		{
+			m_displacement.clear();
+			m_fingerprint.clear();
+		}
+
+		bool empty() const
+		{
+			return m_fingerprint.empty();
+		}
+
+		size_t size() const
+		{
+			return m_fingerprint.size();
+		}
+
+		void swap(BigramHash& other)
+		{
+			m_displacement.swap(other.m_displacement);
+			m_fingerprint.swap(other.m_fingerprint);
+		}
+
+		///	@param keys should be unique.
+		void build(const std::vector<key_type>& keys)
+		{
+			clear();
+			if (keys.empty())
+				return;
+
+			size_t slot_count = keys.size();
+			size_t bucket_count = (slot_count + BUCKET_SIZE - 1) / BUCKET_SIZE;
+
+			//	group the keys by bucket, and place the largest buckets first
+			std::vector<std::pair<size_t, size_t> > order(keys.size());
+			for (size_t i = 0; i < keys.size(); ++i)
+				order[i] = std::make_pair(static_cast<size_t>(hash(keys[i]) % bucket_count), i);
+			std::sort(order.begin(), order.end());
+
+			std::vector<std::pair<size_t, size_t> > buckets;	//	(size, first index in order)
+			for (size_t i = 0; i < order.size(); )
+			{
+				size_t j = i + 1;
+				while (j < order.size() && order[j].first == order[i].first)
+					++j;
+				buckets.push_back(std::make_pair(j - i, i));
+				i = j;
+			}
+			std::sort(buckets.begin(), buckets.end(), std::greater<std::pair<size_t, size_t> >());
+
+			m_displacement.assign(bucket_count, 0);
+			std::vector<bool> taken(slot_count, false);
+			std::vector<size_t> slots;
+			//	a free slot is found in slot_count tries on average even for the last key
+			size_t max_displacement = std::max<size_t>(slot_count * 64, 0x10000);
+			for (size_t b = 0; b < buckets.size(); ++b)
+			{
+				size_t size = buckets[b].first;
+				const std::pair<size_t, size_t>* members = &order[buckets[b].second];
+				unsigned int d = 0;
+				for (;; ++d)
+				{
+					if (d >= max_displacement)
+						throw std::runtime_error("BigramHash cannot place the keys, are they unique?");
+
+					slots.clear();
+					for (size_t i = 0; i < size; ++i)
+					{
+						size_t slot = static_cast<size_t>(hash(keys[members[i].second], d) % slot_count);
+						if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+							break;
+						slots.push_back(slot);
+					}
+					if (slots.size() == size)
+						break;
+				}
+				m_displacement[members[0].first] = d;
+				for (size_t i = 0; i < size; ++i)
+					taken[slots[i]] = true;
+			}
+
+			m_fingerprint.resize(slot_count);
+			for (size_t i = 0; i < keys.size(); ++i)
+				m_fingerprint[slot(keys[i])] = fingerprint(keys[i]);
+		}
+
+		///	@returns the slot of the key in [0, size()), or npos if the key is absent.
+		int get(key_type key) const
+		{
+			if (m_fingerprint.empty())
+				return npos;
+			size_t index = slot(key);
+			return (m_fingerprint[index] == fingerprint(key)) ? static_cast<int>(index) : static_cast<int>(npos);
+		}
+
+	protected:
+		///	64 bits finalizer of MurmurHash3.
+		static key_type mix(key_type x)
+		{
+			x ^= x >> 33;
+			x *= 0xFF51AFD7ED558CCDULL;
+			x ^= x >> 33;
+			x *= 0xC4CEB9FE1A85EC53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+
+		static key_type hash(key_type key)
+		{
+			return mix(key);
+		}
+
+		static key_type hash(key_type key, unsigned int displacement)
+		{
+			return mix((key ^ 0x9E3779B97F4A7C15ULL) + displacement * 0xC2B2AE3D27D4EB4FULL);
+		}
+
+		static unsigned int fingerprint(key_type key)
+		{
+			return static_cast<unsigned int>(mix(key + 0x165667B19E3779F9ULL) >> 32);
+		}
+
+		size_t slot(key_type key) const
+		{
+			unsigned int d = m_displacement[hash(key) % m_displacement.size()];
+			return static_cast<size_t>(hash(key, d) % m_fingerprint.size());
+		}
+
+	protected:
+		std::vector<unsigned int> m_displacement;
+		std::vector<unsigned int> m_fingerprint;
+	};
+
+	/*******************************************************************
+	*
+	*	ScoreTable
+	*
+	********************************************************************/
+
+	///	The parameters of the costs of the words and the transits between them.
+	struct ScoringConfig {
+		//	the weight of the unigram probability in the smoothed transit probability, in (0, 1)
+		double smoothing;
+		//	the same for the transit between the tags
+		double tag_smoothing;
+		explicit ScoringConfig(double smoothing = 0.1, double tag_smoothing = 0.1)
+			: smoothing(smoothing), tag_smoothing(tag_smoothing)
+		{}
+		bool operator==(const ScoringConfig& other) const
+		{
+			return smoothing == other.smoothing && tag_smoothing == other.tag_smoothing;
+		}
+		bool operator!=(const ScoringConfig& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	///	Calculate the cost of the transit from a word of given weight (frequency)
+	///	0 < smoothing < 1
+	///		A = smoothing * P(Ci-1)
+	///		B = (1-smoothing) * P(Ci|Ci-1)
+	///		cost = - Log( A + B );
+	inline double calculate_transit_cost(double current_weight, double adjacency_weight, double smoothing)
+	{
+		double P1 = (1 + current_weight) / (MAX_FREQUENCE+80000);
+		double A = smoothing * P1;
+
+		double t = 1/(double)MAX_FREQUENCE;
+		double P2 = (((1-t) * adjacency_weight) / (1+current_weight)) + t;
+		double B = (1 - smoothing) * P2;
+
+		return - ::log( A + B );
+	}
+
+	///	Calculate the cost of a word being given tag, - Log( P(Wi|Ti) ), add-one smoothed over
+	///	the tag_count tags, (w + 1) / (T + V). The tag weight is at least the word's weight,
+	///	so a tag without weight, such as one out of the lexical context, has no negative cost.
+	inline double calculate_tag_cost(double word_tag_weight, double tag_weight, size_t tag_count)
+	{
+		double total = std::max(tag_weight, word_tag_weight) + std::max<size_t>(tag_count, 1);
+		return - ::log( (word_tag_weight + 1) / total );
+	}
+
+	///	Calculate the cost of the transit from a tag to the next tag
+	///	0 < smoothing < 1
+	///		A = smoothing * P(Ti)
+	///		B = (1-smoothing) * P(Ti|Ti-1)
+	///		cost = - Log( A + B );
+	inline double calculate_tag_transit_cost(double transit_weight, double current_weight, double next_weight, double total_weight, double smoothing)
+	{
+		double A = (total_weight > 0) ? smoothing * next_weight / total_weight : 0;
+		double B = (current_weight > 0) ? (1 - smoothing) * transit_weight / current_weight : 0;
+		if (A + B <= 0)
+			return - ::log( 1 / (double)MAX_FREQUENCE );
+		return - ::log( A + B );
+	}
+
+	/**	The costs of all the words and transits of a dictionary for a scoring config, computed
+	*	once, so the cost of a lattice edge is a lookup instead of a log().
+	*	For word i, weight(i) is the sum of its tag weights, cost(i) is the cost of the transit
+	*	to a word without bigram, and the transits with bigrams have their own costs, found by
+	*	one probe of a BigramHash. A bigram takes 8 bytes, its fingerprint and its cost as a
+	*	float, and its weight stays only in the transit table of the dictionary or its image.
+	*	The tags of word i have their costs in the order of the tags of the word, and the
+	*	transits between the tags are in a dense matrix.
+	*/
+	class ScoreTable {
+	public:
+		ScoreTable()
+			: m_tag_count(0)
+		{
+		}
+
+		void clear()
+		{
+			m_weights.clear();
+			m_costs.clear();
+			m_keys.clear();
+			m_index.clear();
+			m_transit_costs.clear();
+			m_tag_begin.clear();
+			m_tag_costs.clear();
+			m_tag_count = 0;
+			m_tag_transit_costs.clear();
+		}
+
+		bool empty() const
+		{
+			return m_weights.empty();
+		}
+
+		void swap(ScoreTable& other)
+		{
+			m_weights.swap(other.m_weights);
+			m_costs.swap(other.m_costs);
+			m_keys.swap(other.m_keys);
+			m_index.swap(other.m_index);
+			m_transit_costs.swap(other.m_transit_costs);
+			m_tag_begin.swap(other.m_tag_begin);
+			m_tag_costs.swap(other.m_tag_costs);
+			std::swap(m_tag_count, other.m_tag_count);
+			m_tag_transit_costs.swap(other.m_tag_transit_costs);
+		}
+
+		size_t word_count() const
+		{
+			return m_weights.size();
+		}
+
+		size_t transit_count() const
+		{
+			return m_transit_costs.size();
+		}
+
+		///	Add the next word, the id of which is word_count().
+		void add_word(double weight, double cost)
+		{
+			m_weights.push_back(weight);
+			m_costs.push_back(cost);
+			if (m_tag_begin.empty())
+				m_tag_begin.push_back(0);
+			m_tag_begin.push_back(m_tag_costs.size());
+		}
+
+		///	Add the cost of the next tag of the last added word.
+		void add_tag(double cost)
+		{
+			m_tag_costs.push_back(cost);
+			m_tag_begin.back() = m_tag_costs.size();
+		}
+
+		///	Set the costs of the transits between tag_count tags, costs[current * tag_count + next].
+		void set_tag_transits(size_t tag_count, const std::vector<double>& costs)
+		{
+			m_tag_count = tag_count;
+			m_tag_transit_costs = costs;
+		}
+
+		///	Add a transit, and the transits are not found until build() is called.
+		void add_transit(size_t current_id, size_t next_id, double cost)
+		{
+			m_keys.push_back(BigramHash::make_key(current_id, next_id));
+			m_transit_costs.push_back(static_cast<float>(cost));
+		}
+
+		///	Build the hash of all the added transits, and put the costs in its slot order.
+		void build()
+		{
+			m_index.build(m_keys);
+			std::vector<float> costs(m_transit_costs.size());
+			for (size_t i = 0; i < m_keys.size(); ++i)
+				costs[m_index.get(m_keys[i])] = m_transit_costs[i];
+			m_transit_costs.swap(costs);
+			std::vector<BigramHash::key_type>().swap(m_keys);
+		}
+
+		double weight(size_t id) const
+		{
+			return m_weights[id];
+		}
+
+		double cost(size_t id) const
+		{
+			return m_costs[id];
+		}
+
+		///	@returns the cost of the tag of given index in the tags of the word.
+		double tag_cost(size_t id, size_t index) const
+		{
+			return m_tag_costs[m_tag_begin[id] + index];
+		}
+
+		size_t tag_count() const
+		{
+			return m_tag_count;
+		}
+
+		///	@returns the cost of the transit from current tag to next tag, both less than tag_count().
+		double tag_transit_cost(size_t current_tag, size_t next_tag) const
+		{
+			return m_tag_transit_costs[current_tag * m_tag_count + next_tag];
+		}
+
+		///	@returns the cost of the transit from current word to next word.
+		double transit_cost(size_t current_id, size_t next_id) const
+		{
+			int slot = m_index.get(BigramHash::make_key(current_id, next_id));
+			return (slot != BigramHash::npos) ? m_transit_costs[slot] : m_costs[current_id];
+		}
+
+	protected:
+		std::vector<double> m_weights;
+		std::vector<double> m_costs;
+		//	the keys of the added transits until build()
+		std::vector<BigramHash::key_type> m_keys;
+		BigramHash m_index;
+		//	the costs of the transits in the slot order of m_index
+		std::vector<float> m_transit_costs;
+		//	the tags of word i are m_tag_costs[m_tag_begin[i], m_tag_begin[i + 1])
+		std::vector<size_t> m_tag_begin;
+		std::vector<double> m_tag_costs;
+		size_t m_tag_count;
+		std::vector<double> m_tag_transit_costs;
+	};
+
+	/*******************************************************************
+	*
+	*	Dictionary
+	*
+	********************************************************************/
+
+	class Dictionary {
+	public:
+		typedef std::vector<DictEntry*> word_dict_type;
+		typedef std::vector<int> tag_dict_type;
+		typedef std::vector<int> tag_transit_dict_type;
+		typedef WordIndexer word_indexer_type;
+		typedef DoubleArrayIndexer frozen_indexer_type;
+		typedef std::pair<const TagEntry*, const TagEntry*> tag_range_type;
+	public:
+		Dictionary()
+			: m_longest_word_length(0), m_tag_total_weight(0),
+			m_image_entry(0), m_image_tag_item(0), m_image_transit(0), m_image_text(0)
+		{
+		}
+
+		virtual ~Dictionary()
+		{
+			clear_words();
+		}
+
+		/*****************   Word   *****************/
+		DictEntry* add_word(const std::wstring& word)
+		{
+			check_writable();
+			DictEntry* entry_ptr = get_word(word.begin(), word.end());
+
+			if (entry_ptr)
+			{
+				//	exists, then return the index
+				return entry_ptr;
+			}else{
+				//	not exists, create new one
+				DictEntry* ptr = new DictEntry();
+				ptr->id = m_word_dict.size();
+				ptr->word = word;
+				m_word_dict.push_back(ptr);
+				m_word_indexer.add(word.begin(), word.end(), ptr);
+				m_frozen_indexer.clear();
+				m_scores.clear();
+				
+				if (m_longest_word_length < word.length())
+					m_longest_word_length = word.length();
+
+				return ptr;
+			}
+		}
+
+		void remove_word(const std::wstring& word)
+		{
+			check_writable();
+			const DictEntry* entry_ptr = get_word(word.begin(), word.end());
+			if (entry_ptr)
+			{
+				m_word_indexer.remove(word.begin(), word.end());
+				m_frozen_indexer.clear();
+				m_scores.clear();
+
+				size_t id = entry_ptr->id;
+				m_word_dict.erase(m_word_dict.begin() + id);
+				delete entry_ptr;	//	release memory
+
+				//	keep the ids dense
+				for (word_dict_type::iterator iter = m_word_dict.begin(); iter != m_word_dict.end(); ++iter)
+				{
+					if ((*iter)->id > id)
+						--(*iter)->id;
+					(*iter)->forward.remove_and_shift(id);
+					(*iter)->backward.remove_and_shift(id);
+				}
+			}
+		}
+
+		DictEntry* get_word(const std::wstring& word)
+		{
+			return get_word(word.begin(), word.end());
+		}
+
+		const DictEntry* get_word(const std::wstring& word) const
+		{
+			return get_word(word.begin(), word.end());
+		}
+
+		///	@returns the entry of given word, or 0 if not exist. It throws for a read-only dictionary.
+		DictEntry* get_word(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
+		{
+			check_entries();
+			if (is_frozen())
+			{
+				int index = m_frozen_indexer.get(iter, end);
+				return (index != frozen_indexer_type::npos) ? m_word_dict[index] : 0;
+			}else{
+				return m_word_indexer.get(iter, end);
+			}
+		}
+
+		std::vector<DictEntry*> prefix(const std::wstring& word) const
+		{
+			return prefix(word.begin(), word.end());
+		}
+
+		///	@returns the entries of the prefixes. It throws for a read-only dictionary, use for_each_prefix() instead.
+		std::vector<DictEntry*> prefix(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
+		{
+			check_entries();
+			std::vector<DictEntry*> entry_list;
+			entry_collector collector(m_word_dict, entry_list);
+			for_each_prefix(iter, end, collector);
+			return entry_list;
+		}
+
+		///	Walk through all the words which are prefixes of given sequence, in the order of length.
+		///	visitor(size_t id, size_t length) will be called for each word, and nothing
+		///	will be allocated during the walk. The length is the count of symbols.
+		///	Any forward iterator of wchar_t can be used, so a UTF-8 text can be walked
+		///	by Utf8Iterator, and decoded on the fly.
+		template <class Visitor>
+		void for_each_prefix(std::wstring::const_iterator iter, std::wstring::const_iterator end, Visitor& visitor) const
+		{
+			for_each_prefix<std::wstring::const_iterator, Visitor>(iter, end, visitor);
+		}
+
+		template <class Iterator, class Visitor>
+		void for_each_prefix(Iterator iter, Iterator end, Visitor& visitor) const
+		{
+			if (is_frozen())
+			{
+				index_visitor<Visitor> adapter(visitor);
+				m_frozen_indexer.for_each_prefix(iter, end, adapter);
+			}else{
+				entry_visitor<Visitor> adapter(visitor);
+				m_word_indexer.for_each_prefix(iter, end, adapter);
+			}
+		}
+
+		/*****************   Word by id   *****************/
+		//	The functions below work for both the DictEntry based dictionary
+		//	and the read-only one attached to an image.
+
+		size_t word_count() const
+		{
+			return is_read_only() ? m_image.header().word_count : m_word_dict.size();
+		}
+
+		size_t get_word_id(const std::wstring& word) const
+		{
+			return get_word_id(word.begin(), word.end());
+		}
+
+		///	@returns the id of given word, or INVALID_WORD_ID if not exist.
+		size_t get_word_id(std::wstring::const_iterator iter, std::wstring::const_iterator end) const
+		{
+			if (is_frozen())
+			{
+				int index = m_frozen_indexer.get(iter, end);
+				return (index != frozen_indexer_type::npos) ? static_cast<size_t>(index) : INVALID_WORD_ID;
+			}else{
+				DictEntry* entry = m_word_indexer.get(iter, end);
+				return entry ? entry->id : INVALID_WORD_ID;
+			}
+		}
+
+		std::wstring get_word_string(size_t id) const
+		{
+			if (is_read_only())
+			{
+				const DictImageEntry& entry = m_image_entry[id];
+				return std::wstring(m_image_text + entry.text_offset, m_image_text + entry.text_offset + entry.length);
+			}else{
+				return m_word_dict[id]->word;
+			}
+		}
+
+		///	@returns [first, second) of the tags of given word.
+		tag_range_type get_word_tags(size_t id) const
+		{
+			if (is_read_only())
+			{
+				const TagEntry* begin = m_image_tag_item + m_image_entry[id].tag_offset;
+				return tag_range_type(begin, begin + m_image_entry[id].tag_count);
+			}else{
+				const std::vector<TagEntry>& tags = m_word_dict[id]->tags;
+				if (tags.empty())
+					return tag_range_type(0, 0);
+				else
+					return tag_range_type(&tags[0], &tags[0] + tags.size());
+			}
+		}
+
+		///	@returns the sum of the weights of all the tags of given word.
+		double get_word_weight(size_t id) const
+		{
+			if (!m_scores.empty())
+				return m_scores.weight(id);
+
+			tag_range_type range = get_word_tags(id);
+			double weight = 0;
+			for (const TagEntry* iter = range.first; iter != range.second; ++iter)
+				weight += iter->weight;
+			return weight;
+		}
+
+		///	@returns the transit weight from current word to next word, or 0 if not exist.
+		double get_word_transit_weight(size_t current_id, size_t next_id) const
+		{
+			if (is_read_only())
+			{
+				const DictImageEntry& entry = m_image_entry[current_id];
+				const DictImageTransit* begin = m_image_transit + entry.transit_offset;
+				const DictImageTransit* end = begin + entry.transit_count;
+				DictImageTransit key;
+				key.id = static_cast<unsigned int>(next_id);
+				const DictImageTransit* iter = std::lower_bound(begin, end, key);
+				return (iter != end && iter->id == key.id) ? iter->weight : 0;
+			}else{
+				return m_word_dict[current_id]->get_forward_weight(next_id);
+			}
+		}
+
+		///	@returns the count of the transits from given word.
+		size_t get_word_transit_count(size_t id) const
+		{
+			return is_read_only() ? m_image_entry[id].transit_count : m_word_dict[id]->forward.size();
+		}
+
+		///	Walk through the transits from given word in the order of the next word id,
+		///	visitor(size_t next_id, double weight) will be called for each transit.
+		template <class Visitor>
+		void for_each_word_transit(size_t id, Visitor& visitor) const
+		{
+			if (is_read_only())
+			{
+				const DictImageEntry& entry = m_image_entry[id];
+				const DictImageTransit* begin = m_image_transit + entry.transit_offset;
+				for (const DictImageTransit* iter = begin; iter != begin + entry.transit_count; ++iter)
+					visitor(static_cast<size_t>(iter->id), static_cast<double>(iter->weight));
+			}else{
+				const DictEntry::transit_type& forward = m_word_dict[id]->forward;
+				for (DictEntry::transit_type::const_iterator iter = forward.begin(); iter != forward.end(); ++iter)
+					visitor(iter->id, iter->weight);
+			}
+		}
+
+		/**	Set the transit weight from current_word to next_word, both words should exist
+		*	in the dictionary, since the transit tables are indexed by word id.
+		* @returns false if either of the words does not exist.
+		*/
+		bool add_word_transit_weight(const std::wstring& current_word, const std::wstring& next_word, double weight)
+		{
+			check_writable();
+			DictEntry* current_entry = get_word(current_word);
+			DictEntry* next_entry = get_word(next_word);
+			if (!current_entry || !next_entry)
+				return false;
+
+			current_entry->forward.set(next_entry->id, weight);
+			next_entry->backward.set(current_entry->id, weight);
+			m_scores.clear();
+			return true;
+		}
+
+		size_t longest_word_length() const
+		{
+			return m_longest_word_length;
+		}
+
+		/*****************   Score   *****************/
+		const ScoringConfig& scoring() const
+		{
+			return m_scoring;
+		}
+
+		///	Change the scoring config, and the precomputed scores are computed again if any.
+		void set_scoring(const ScoringConfig& scoring)
+		{
+			if (scoring == m_scoring)
+				return;
+			m_scoring = scoring;
+			if (!m_scores.empty())
+				build_scores();
+		}
+
+		/**	Compute the weights of all the words and the costs of all the transits and tags for
+		*	current scoring config, and use them afterwards. It's done by freeze() and attach_image().
+		*	Adding or removing a word, a transit or a tag weight drops the scores, and the costs are
+		*	computed on the fly until build_scores() or freeze() is called again. The tags changed
+		*	through DictEntry are not tracked, so call build_scores() after that.
+		*/
+		void build_scores()
+		{
+			//	the weights are summed from the tags while m_scores is empty
+			m_scores.clear();
+			ScoreTable scores;
+			size_t count = word_count();
+			for (size_t id = 0; id < count; ++id)
+			{
+				double weight = get_word_weight(id);
+				scores.add_word(weight, calculate_transit_cost(weight, 0, m_scoring.smoothing));
+				tag_range_type tags = get_word_tags(id);
+				for (const TagEntry* tag = tags.first; tag != tags.second; ++tag)
+					scores.add_tag(calculate_tag_cost(tag->weight, get_tag_weight(tag->tag), m_tag_dict.size()));
+				if (is_read_only())
+				{
+					const DictImageEntry& entry = m_image_entry[id];
+					const DictImageTransit* transit = m_image_transit + entry.transit_offset;
+					for (unsigned int i = 0; i < entry.transit_count; ++i)
+						scores.add_transit(id, transit[i].id, calculate_transit_cost(weight, transit[i].weight, m_scoring.smoothing));
+				}else{
+					const TransitTable& forward = m_word_dict[id]->forward;
+					for (TransitTable::const_iterator iter = forward.begin(); iter != forward.end(); ++iter)
+						scores.add_transit(id, iter->id, calculate_transit_cost(weight, iter->weight, m_scoring.smoothing));
+				}
+			}
+			scores.build();
+
+			size_t tag_count = m_tag_dict.size();
+			std::vector<double> tag_transits(tag_count * tag_count);
+			for (size_t current = 0; current < tag_count; ++current)
+				for (size_t next = 0; next < tag_count; ++next)
+					tag_transits[current * tag_count + next] = calculate_tag_transit_cost(
+						m_tag_transit_dict[current * tag_count + next], m_tag_dict[current], m_tag_dict[next], m_tag_total_weight, m_scoring.tag_smoothing);
+			scores.set_tag_transits(tag_count, tag_transits);
+			m_scores.swap(scores);
+		}
+
+		bool has_scores() const
+		{
+			return !m_scores.empty();
+		}
+
+		const ScoreTable& scores() const
+		{
+			return m_scores;
+		}
+
+		///	@returns the cost of the transit from given word to a word without bigram.
+		double get_word_cost(size_t id) const
+		{
+			if (!m_scores.empty())
+				return m_scores.cost(id);
+			return calculate_transit_cost(get_word_weight(id), 0, m_scoring.smoothing);
+		}
+
+		///	@returns the smoothed cost of the transit from current word to next word, see calculate_transit_cost().
+		double get_transit_cost(size_t current_id, size_t next_id) const
+		{
+			if (!m_scores.empty())
+				return m_scores.transit_cost(current_id, next_id);
+			return calculate_transit_cost(get_word_weight(current_id), get_word_transit_weight(current_id, next_id), m_scoring.smoothing);
+		}
+
+		///	@returns the cost of the tag of given index in get_word_tags(id), see calculate_tag_cost().
+		double get_word_tag_cost(size_t id, size_t index) const
+		{
+			if (!m_scores.empty())
+				return m_scores.tag_cost(id, index);
+			const TagEntry& tag = get_word_tags(id).first[index];
+			return calculate_tag_cost(tag.weight, get_tag_weight(tag.tag), m_tag_dict.size());
+		}
+
+		///	@returns the smoothed cost of the transit from current tag to next tag, see calculate_tag_transit_cost().
+		///	The tags out of the tag dictionary have no weight.
+		double get_tag_transit_cost(int current_tag, int next_tag) const
+		{
+			size_t tag_count = m_tag_dict.size();
+			bool in_dict = current_tag >= 0 && next_tag >= 0 && static_cast<size_t>(current_tag) < tag_count && static_cast<size_t>(next_tag) < tag_count;
+			if (in_dict && !m_scores.empty())
+				return m_scores.tag_transit_cost(current_tag, next_tag);
+			return calculate_tag_transit_cost(in_dict ? get_tag_transit_weight(current_tag, next_tag) : 0,
+				get_tag_weight(current_tag), get_tag_weight(next_tag), m_tag_total_weight, m_scoring.tag_smoothing);
+		}
+
+		/**	Build the double-array indexer from all current words, and use it for
+		*	all the lookups afterwards. The dictionary is still modifiable, but adding
+		*	or removing a word will drop the frozen indexer, and lookups will fall back
+		*	to the WordIndexer until freeze() is called again.
+		*/
+		void freeze()
+		{
+			if (is_read_only())
+				return;
+
+			std::vector<frozen_indexer_type::key_type> keys;
+			keys.reserve(m_word_dict.size());
+			for (size_t i = 0; i < m_word_dict.size(); ++i)
+				keys.push_back(frozen_indexer_type::key_type(m_word_dict[i]->word, static_cast<int>(i)));
+
+			m_frozen_indexer.build(keys);
+			build_scores();
+		}
+
+		void unfreeze()
+		{
+			if (!is_read_only())
+			{
+				m_frozen_indexer.clear();
+				m_scores.clear();
+			}
+		}
+
+		bool is_frozen() const
+		{
+			return !m_frozen_indexer.empty();
+		}
+
+		/*****************   Image   *****************/
+		/**	Drop all the words, and use the words, tags and transits in given image in place.
+		*	The dictionary becomes read-only: the words can be looked up by id, but there is no
+		*	DictEntry, so words(), get_word() and prefix() throw. The tag tables are copied,
+		*	since they are tiny. The image shares the ownership of the memory.
+		*/
+		void attach_image(const DictionaryImage& image)
+		{
+			clear_words();
+			m_frozen_indexer.clear();
+			m_scores.clear();
+			m_image = image;
+			if (image.empty())
+				return;
+
+			const DictImageHeader& header = image.header();
+			m_longest_word_length = header.longest_word_length;
+			m_tag_total_weight = header.tag_total_weight;
+
+			const int* tag = image.section<int>(IMAGE_TAG);
+			m_tag_dict.assign(tag, tag + header.tag_count);
+			const int* tag_transit = image.section<int>(IMAGE_TAG_TRANSIT);
+			m_tag_transit_dict.assign(tag_transit, tag_transit + header.tag_count * header.tag_count);
+
+			m_frozen_indexer.assign(image.section<int>(IMAGE_BASE), image.section<int>(IMAGE_CHECK), image.section<int>(IMAGE_VALUE), header.state_count,
+				image.section<unsigned short>(IMAGE_BMP_CODE), image.section<frozen_indexer_type::extra_code_type>(IMAGE_EXTRA_CODE), header.extra_code_count);
+			m_image_entry = image.section<DictImageEntry>(IMAGE_ENTRY);
+			m_image_tag_item = image.section<TagEntry>(IMAGE_TAG_ITEM);
+			m_image_transit = image.section<DictImageTransit>(IMAGE_TRANSIT);
+			m_image_text = image.section<wchar_t>(IMAGE_TEXT);
+			build_scores();
+		}
+
+		bool is_read_only() const
+		{
+			return !m_image.empty();
+		}
+
+		const DictionaryImage& image() const
+		{
+			return m_image;
+		}
+
+		const frozen_indexer_type& frozen_indexer() const
+		{
+			return m_frozen_indexer;
+		}
+
+		///	@returns the entries of the words. It throws for a read-only dictionary, use the functions by id instead.
+		const word_dict_type& words() const
+		{
+			check_entries();
+			return m_word_dict;
+		}
+
+		/*****************   Tag   *****************/
+		void init_tag_dict(int size)
+		{
+			//	initialize tag table
+			m_tag_dict.clear();
+			m_tag_dict.resize(size, 0);
+			//	initialize tag transit table
+			m_tag_transit_dict.clear();
+			m_tag_transit_dict.resize(size*size, 0);
+			m_scores.clear();
+		}
+
+		int get_tag_total_weight() const
+		{
+			return m_tag_total_weight;
+		}
+
+		void set_tag_total_weight(int weight)
+		{
+			m_tag_total_weight = weight;
+			m_scores.clear();
+		}
+
+		void add_tag_weight(int tag, int weight)
+		{
+			if (static_cast<int>(m_tag_dict.size()) > tag)
+				m_tag_dict[tag] = weight;
+			m_scores.clear();
+		}
+
+		void remove_tag_weight(int tag)
+		{
+			if (static_cast<int>(m_tag_dict.size()) > tag)
+				m_tag_dict[tag] = 0;
+			m_scores.clear();
+		}
+
+		double get_tag_weight(int tag) const
+		{
+			if (static_cast<int>(m_tag_dict.size()) > tag)
+				return m_tag_dict[tag];
+			else
+				return 0;
+		}
+
+		const tag_dict_type& tags() const
+		{
+			return m_tag_dict;
+		}
+
+		/*****************   Tag transit   *****************/
+		int get_tag_transit_index(int current_tag, int next_tag) const
+		{
+			return static_cast<int>((current_tag * m_tag_dict.size()) + next_tag);
+		}
+
+		void add_tag_transit_weight(int current_tag, int next_tag, int weight)
+		{
+			int index = get_tag_transit_index(current_tag, next_tag);
+			m_tag_transit_dict.at(index) = weight;
+			m_scores.clear();
+		}
+
+		void add_tag_transit_weight(int tags_index, int weight)
+		{
+			if (tags_index < static_cast<int>(m_tag_transit_dict.size()))
+				m_tag_transit_dict.at(tags_index) = weight;
+			m_scores.clear();
+		}
+
+		void remove_tag_transit_weight(int current_tag, int next_tag)
+		{
+			int index = get_tag_transit_index(current_tag, next_tag);
+			m_tag_transit_dict.at(index) = 0;
+			m_scores.clear();
+		}
+
+		int get_tag_transit_weight(int current_tag, int next_tag) const
+		{
+			int index = get_tag_transit_index(current_tag, next_tag);
+			return m_tag_transit_dict.at(index);
+		}
+
+		const tag_transit_dict_type& tags_transit() const
+		{
+			return m_tag_transit_dict;
+		}
+
+
+	protected:
+		///	translate the index reported by frozen indexer to the word id.
+		template <class Visitor>
+		struct index_visitor {
+			Visitor& visitor;
+			index_visitor(Visitor& visitor)
+				: visitor(visitor)
+			{}
+			void operator() (int index, size_t length)
+			{
+				visitor(static_cast<size_t>(index), length);
+			}
+		};
+
+		///	translate the entry reported by WordIndexer to the word id.
+		template <class Visitor>
+		struct entry_visitor {
+			Visitor& visitor;
+			entry_visitor(Visitor& visitor)
+				: visitor(visitor)
+			{}
+			void operator() (const DictEntry* entry, size_t length)
+			{
+				visitor(entry->id, length);
+			}
+		};
+
+		struct entry_collector {
+			const word_dict_type& words;
+			std::vector<DictEntry*>& entry_list;
+			entry_collector(const word_dict_type& words, std::vector<DictEntry*>& entry_list)
+				: words(words), entry_list(entry_list)
+			{}
+			void operator() (size_t id, size_t /*length*/)
+			{
+				entry_list.push_back(words[id]);
+			}
+		};
+
+		void check_writable() const
+		{
+			if (is_read_only())
+				throw std::logic_error("The dictionary attached to an image is read-only.");
+		}
+
+		void check_entries() const
+		{
+			if (is_read_only())
+				throw std::logic_error("The dictionary attached to an image has no DictEntry.");
+		}
+
+		void clear_words()
+		{
+			for(word_dict_type::iterator iter = m_word_dict.begin(); iter != m_word_dict.end(); ++iter)
+			{
+				delete (*iter);
+			}
+			m_word_dict.clear();
+			m_word_indexer.clear();
+			m_longest_word_length = 0;
 		}
 
+	private:
+		//	the entries are owned by the dictionary, so copy is not allowed.
+		Dictionary(const Dictionary&);
+		Dictionary& operator=(const Dictionary&);
 
 	protected:
 		//	word
@@ -411,6 +1916,16 @@ namespace openclas {
 		int m_tag_total_weight;
 		//	indexer
 		word_indexer_type m_word_indexer;
+		frozen_indexer_type m_frozen_indexer;
+		//	score
+		ScoringConfig m_scoring;
+		ScoreTable m_scores;
+		//	image
+		DictionaryImage m_image;
+		const DictImageEntry* m_image_entry;
+		const TagEntry* m_image_tag_item;
+		const DictImageTransit* m_image_transit;
+		const wchar_t* m_image_text;
 	};	//	class Dictionary
 }	//	namespace openclas
 
@@ -15,12 +15,15 @@
 #endif	//	min
 
 #include "common.hpp"
+#include "lattice.hpp"
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/graph_concepts.hpp>
 #include <boost/graph/dag_shortest_paths.hpp>
+#include <boost/graph/topological_sort.hpp>
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <limits>
 
 namespace openclas {
 
@@ -32,6 +35,11 @@ namespace openclas {
 		path_type()
 			: weight(0), nodelist()
 		{}
+		void swap(path_type& other)
+		{
+			std::swap(weight, other.weight);
+			nodelist.swap(other.nodelist);
+		}
 	};
 
 	inline bool operator < (const path_type& left, const path_type& right)
@@ -84,12 +92,47 @@ namespace openclas {
 			dag_shortest_path(g, begin, end, shortest_path);
 			result_paths.push_back(shortest_path);
 		}else{
-			std::vector<path_type> candidate_paths;
-			dag_all_paths(g, begin, end, candidate_paths);
+			//	decode the lattice of the graph, then translate the nodes back to the vertices.
+			typedef typename graph_traits<IncidenceGraph>::vertex_descriptor vertex_type;
+			Lattice<vertex_type> lattice;
+			std::vector<size_t> index_map;
+			dag_to_lattice(g, lattice, index_map);
+
+			typename property_map<IncidenceGraph, vertex_index_t>::type
+				vindex_map = get(vertex_index, g);
+			size_t first = result_paths.size();
+			dag_k_shortest_paths(lattice, index_map[vindex_map[begin]], index_map[vindex_map[end]], result_paths, k);
+			for (size_t i = first; i < result_paths.size(); ++i)
+				for (std::vector<size_t>::iterator iter = result_paths[i].nodelist.begin(); iter != result_paths[i].nodelist.end(); ++iter)
+					*iter = lattice[*iter];
+		}
+	}
+
+	//	Copy a DAG to a lattice in topological order, the node of the lattice is the vertex of the graph,
+	//	and index_map[vertex_index] is the index of the node in the lattice.
+	template <class Graph>
+	void dag_to_lattice(Graph& g, Lattice<typename graph_traits<Graph>::vertex_descriptor>& lattice, std::vector<size_t>& index_map)
+	{
+		typedef typename graph_traits<Graph>::vertex_descriptor vertex_type;
+		std::vector<vertex_type> order;
+		topological_sort(g, std::back_inserter(order));
+
+		typename property_map<Graph, vertex_index_t>::type
+			vindex_map = get(vertex_index, g);
+		typename property_map<Graph, edge_weight_t>::type
+			w_map = get(edge_weight, g);
+
+		lattice.clear();
+		index_map.assign(num_vertices(g), 0);
+		//	topological_sort() gives the reverse order
+		for (typename std::vector<vertex_type>::reverse_iterator iter = order.rbegin(); iter != order.rend(); ++iter)
+			index_map[vindex_map[*iter]] = lattice.add_node(*iter);
 
-			k = std::min(k, static_cast<int>(candidate_paths.size()));
-			std::partial_sort(candidate_paths.begin(), candidate_paths.begin() + k, candidate_paths.end());
-			result_paths.assign(candidate_paths.begin(), candidate_paths.begin() + k);
+		for (size_t i = 0; i < lattice.node_count(); ++i)
+		{
+			typename graph_traits<Graph>::out_edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = out_edges(lattice[i], g); ei != ei_end; ++ei)
+				lattice.add_edge(i, index_map[vindex_map[target(*ei, g)]], w_map[*ei]);
 		}
 	}
 
@@ -128,6 +171,284 @@ namespace openclas {
 			std::reverse(result_path.nodelist.begin(), result_path.nodelist.end());
 		}
 	}
+
+	/*******************************************************************
+	*
+	*	Lattice
+	*
+	********************************************************************/
+
+	//	The nodes of a lattice are in topological order already, so the algorithms
+	//	below walk through the nodes by index instead of sorting the graph.
+
+	///	Working arrays for the shortest paths of lattices.
+	///	Reuse one buffer for many lattices, then the arrays will be allocated only
+	///	when a lattice larger than all previous ones comes.
+	struct shortest_path_buffer {
+		///	a partial path ending at a node
+		struct candidate_type {
+			double weight;
+			size_t predecessor;	//	the previous node
+			size_t rank;		//	the rank of the partial path in the list of previous node
+		};
+		//	k = 1
+		std::vector<double> distance;
+		std::vector<size_t> predecessor;
+		//	k > 1, the sorted k best partial paths of node i are
+		//	candidate[i * k, i * k + candidate_count[i])
+		std::vector<candidate_type> candidate;
+		std::vector<size_t> candidate_count;
+		std::vector<candidate_type> merged;
+
+		void swap(shortest_path_buffer& other)
+		{
+			distance.swap(other.distance);
+			predecessor.swap(other.predecessor);
+			candidate.swap(other.candidate);
+			candidate_count.swap(other.candidate_count);
+			merged.swap(other.merged);
+		}
+	};
+
+	//	Find all paths of given pair of node in a lattice. (DFS-like algorithm)
+	template <class Node>
+	void dag_all_paths(Lattice<Node>& g, size_t begin, size_t end,
+		std::vector<path_type>& result_paths,
+		path_type current_path = path_type())
+	{
+		if (g.empty())
+			return;	//	return if g is empty
+
+		current_path.nodelist.push_back(begin);
+		if (begin == end) {
+			result_paths.push_back(current_path);
+		} else {
+			double original_weight = current_path.weight;
+			typename Lattice<Node>::edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = g.out_edges(begin); ei != ei_end; ++ei) {
+				current_path.weight = original_weight + ei->weight;
+				dag_all_paths(g, ei->target, end, result_paths, current_path);
+			}
+		}
+	}
+
+	//	Find k-shortest-path in a lattice.
+	template <class Node>
+	void dag_k_shortest_paths(Lattice<Node>& g, size_t begin, size_t end,
+		std::vector<path_type>& result_paths,
+		int k)
+	{
+		shortest_path_buffer buffer;
+		dag_k_shortest_paths(g, begin, end, result_paths, k, buffer);
+	}
+
+	template <class Node>
+	void dag_k_shortest_paths(Lattice<Node>& g, size_t begin, size_t end,
+		std::vector<path_type>& result_paths,
+		int k,
+		shortest_path_buffer& buffer)
+	{
+		if (g.empty() || k <= 0)
+			return;	//	return if g is empty
+
+		if (k == 1) {
+			path_type shortest_path;
+			dag_shortest_path(g, begin, end, shortest_path, buffer);
+			result_paths.push_back(shortest_path);
+		}else{
+			dag_k_best_paths(g, begin, end, result_paths, static_cast<size_t>(k), buffer);
+		}
+	}
+
+	//	The forward pass of dag_k_best_paths(), the candidates are kept in the buffer.
+	//	@returns the count of the paths found, at most k.
+	template <class Node>
+	size_t dag_k_best_candidates(Lattice<Node>& g, size_t begin, size_t end,
+		size_t k,
+		shortest_path_buffer& buffer)
+	{
+		typedef shortest_path_buffer::candidate_type candidate_type;
+		std::vector<candidate_type>& candidates = buffer.candidate;
+		std::vector<size_t>& counts = buffer.candidate_count;
+		std::vector<candidate_type>& merged = buffer.merged;
+
+		if (candidates.size() < g.node_count() * k)
+			candidates.resize(g.node_count() * k);
+		if (counts.size() < g.node_count())
+			counts.resize(g.node_count());
+		if (merged.size() < k)
+			merged.resize(k);
+		for (size_t i = begin; i <= end; ++i)
+			counts[i] = 0;
+
+		candidate_type start = {0, begin, 0};
+		candidates[begin * k] = start;
+		counts[begin] = 1;
+
+		for (size_t u = begin; u < end; ++u)
+		{
+			size_t u_count = counts[u];
+			if (u_count == 0)
+				continue;	//	not reachable
+			const candidate_type* u_list = &candidates[u * k];
+
+			typename Lattice<Node>::edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = g.out_edges(u); ei != ei_end; ++ei)
+			{
+				size_t v = ei->target;
+				if (v > end)
+					continue;	//	no way back to [end]
+
+				candidate_type* v_list = &candidates[v * k];
+				size_t v_count = counts[v];
+				//	nothing better
+				if (v_count == k && v_list[k - 1].weight <= u_list[0].weight + ei->weight)
+					continue;
+
+				//	merge two sorted lists, and keep the first k
+				size_t a = 0, b = 0, n = 0;
+				while (n < k && (a < v_count || b < u_count))
+				{
+					if (b == u_count || (a < v_count && v_list[a].weight <= u_list[b].weight + ei->weight))
+					{
+						merged[n++] = v_list[a++];
+					}else{
+						candidate_type candidate = {u_list[b].weight + ei->weight, u, b};
+						merged[n++] = candidate;
+						++b;
+					}
+				}
+				std::copy(merged.begin(), merged.begin() + n, v_list);
+				counts[v] = n;
+			}
+		}
+
+		return counts[end];
+	}
+
+	//	Trace back the path [rank] found by dag_k_best_candidates(),
+	//	the nodelist of given path is replaced, and its memory is reused.
+	inline void dag_k_best_path(const shortest_path_buffer& buffer, size_t begin, size_t end,
+		size_t k, size_t rank,
+		path_type& path)
+	{
+		typedef shortest_path_buffer::candidate_type candidate_type;
+		const std::vector<candidate_type>& candidates = buffer.candidate;
+		path.weight = candidates[end * k + rank].weight;
+
+		size_t count = 1;
+		for (size_t node = end, r = rank; node != begin; ++count)
+		{
+			const candidate_type& candidate = candidates[node * k + r];
+			node = candidate.predecessor;
+			r = candidate.rank;
+		}
+		path.nodelist.resize(count);
+		for (size_t node = end, r = rank; count > 0; --count)
+		{
+			path.nodelist[count - 1] = node;
+			const candidate_type& candidate = candidates[node * k + r];
+			node = candidate.predecessor;
+			r = candidate.rank;
+		}
+	}
+
+	//	Find k-shortest-path in a lattice by keeping the sorted k best partial paths of each node.
+	//	The lists are pushed along the out edges in topological order, and each edge merges
+	//	two sorted lists in O(k), so the cost is O((n+m)k) instead of enumerating all paths.
+	//	The paths are sorted by weight, and the earlier found one goes first if the weights are equal.
+	template <class Node>
+	void dag_k_best_paths(Lattice<Node>& g, size_t begin, size_t end,
+		std::vector<path_type>& result_paths,
+		size_t k,
+		shortest_path_buffer& buffer)
+	{
+		size_t count = dag_k_best_candidates(g, begin, end, k, buffer);
+		for (size_t rank = 0; rank < count; ++rank)
+		{
+			result_paths.push_back(path_type());
+			dag_k_best_path(buffer, begin, end, k, rank, result_paths.back());
+		}
+	}
+
+	//	Find shortest-path in a lattice. O(n+m)
+	template <class Node>
+	void dag_shortest_path(Lattice<Node>& g, size_t begin, size_t end,
+		path_type& result_path)
+	{
+		shortest_path_buffer buffer;
+		dag_shortest_path(g, begin, end, result_path, buffer);
+	}
+
+	//	Single pass of forward relaxation, since the nodes are sorted already.
+	//	Only the nodes in [begin, end] are touched, and no memory is allocated
+	//	except the result path if the buffer is large enough.
+	template <class Node>
+	void dag_shortest_path(Lattice<Node>& g, size_t begin, size_t end,
+		path_type& result_path,
+		shortest_path_buffer& buffer)
+	{
+		if (g.empty())
+			return;	//	return if g is empty
+
+		if (begin == end) {
+			result_path.nodelist.push_back(begin);
+			return;
+		}
+
+		std::vector<double>& distance = buffer.distance;
+		std::vector<size_t>& predecessor = buffer.predecessor;
+		if (distance.size() < g.node_count())
+		{
+			distance.resize(g.node_count());
+			predecessor.resize(g.node_count());
+		}
+		for (size_t i = begin; i <= end; ++i)
+		{
+			distance[i] = std::numeric_limits<double>::max();
+			predecessor[i] = i;
+		}
+		distance[begin] = 0;
+
+		//	relax the out edges of the nodes in topological order
+		for (size_t u = begin; u < end; ++u)
+		{
+			if (distance[u] == std::numeric_limits<double>::max())
+				continue;	//	not reachable
+
+			typename Lattice<Node>::edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = g.out_edges(u); ei != ei_end; ++ei)
+			{
+				if (ei->target > end)
+					continue;	//	no way back to [end]
+
+				double d = distance[u] + ei->weight;
+				if (d < distance[ei->target])
+				{
+					distance[ei->target] = d;
+					predecessor[ei->target] = u;
+				}
+			}
+		}
+
+		if (end == predecessor[end])	//	[begin] is not connected with [end]
+			return;
+
+		result_path.weight = distance[end];
+
+		//	count the nodes first, so the path is allocated once.
+		size_t count = 1;
+		for (size_t current = end; current != begin; current = predecessor[current])
+			++count;
+		size_t first = result_path.nodelist.size();
+		result_path.nodelist.resize(first + count);
+		size_t current = end;
+		for (size_t n = count; n > 0; --n)
+		{
+			result_path.nodelist[first + n - 1] = current;
+			current = predecessor[current];
+		}
+	}
 }
 
 //	_OPENCLAS_K_SHORTEST_PATH_HPP_
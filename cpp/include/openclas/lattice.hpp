@@ -0,0 +1,159 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+#pragma once
+#ifndef _OPENCLAS_LATTICE_HPP_
+#define _OPENCLAS_LATTICE_HPP_
+
+#include "common.hpp"
+#include <boost/graph/graph_traits.hpp>
+#include <vector>
+#include <utility>
+#include <algorithm>	//	for std::swap()
+#include <stdexcept>	//	for std::logic_error
+
+namespace openclas {
+
+	/**	Directed acyclic graph of the candidate words.
+	*	The nodes are stored in a contiguous array, and the out edges of each node are
+	*	a range of one contiguous edge array (CSR), so building a lattice only appends
+	*	to a few arrays, and clear() keeps the memory for the next sentence.
+	*	The nodes should be added in topological order (for segmentation, by offset),
+	*	and every edge should go from a node to a later one, so the algorithms can
+	*	walk through the nodes by index without sorting.
+	*/
+	template <class Node>
+	class Lattice {
+	public:
+		typedef Node node_type;
+		struct edge_type {
+			size_t target;
+			double weight;
+		};
+		typedef const edge_type* edge_iterator;
+		typedef std::pair<size_t, size_t> terminal_type;
+
+		//	The category of the graph, it makes graph_traits<> of the lattice valid,
+		//	so the overloads of the lattice are more specialized than the ones of boost graphs.
+		typedef size_t vertex_descriptor;
+		typedef size_t edge_descriptor;
+		typedef boost::directed_tag directed_category;
+		typedef boost::allow_parallel_edge_tag edge_parallel_category;
+		typedef boost::incidence_graph_tag traversal_category;
+	public:
+		Lattice()
+			: m_terminal(0, 0)
+		{
+		}
+
+		///	Remove all the nodes and edges, the memory is kept for reuse.
+		void clear()
+		{
+			m_nodes.clear();
+			m_edge_begin.clear();
+			m_edge_end.clear();
+			m_edges.clear();
+			m_terminal = terminal_type(0, 0);
+		}
+
+		bool empty() const
+		{
+			return m_nodes.empty();
+		}
+
+		size_t node_count() const
+		{
+			return m_nodes.size();
+		}
+
+		size_t edge_count() const
+		{
+			return m_edges.size();
+		}
+
+		///	@returns the index of the new node.
+		size_t add_node(const Node& node)
+		{
+			m_nodes.push_back(node);
+			m_edge_begin.push_back(m_edges.size());
+			m_edge_end.push_back(m_edges.size());
+			return m_nodes.size() - 1;
+		}
+
+		///	All the out edges of a node should be added together.
+		void add_edge(size_t source, size_t target, double weight)
+		{
+			if (m_edge_begin[source] != m_edge_end[source] && m_edge_end[source] != m_edges.size())
+				throw std::logic_error("The out edges of a lattice node should be added together.");
+
+			if (m_edge_begin[source] == m_edge_end[source])
+				m_edge_begin[source] = m_edges.size();
+
+			edge_type edge;
+			edge.target = target;
+			edge.weight = weight;
+			m_edges.push_back(edge);
+			m_edge_end[source] = m_edges.size();
+		}
+
+		Node& operator[](size_t index)
+		{
+			return m_nodes[index];
+		}
+
+		const Node& operator[](size_t index) const
+		{
+			return m_nodes[index];
+		}
+
+		const std::vector<Node>& nodes() const
+		{
+			return m_nodes;
+		}
+
+		///	@returns [first, second) of the out edges of given node.
+		std::pair<edge_iterator, edge_iterator> out_edges(size_t index) const
+		{
+			if (m_edge_begin[index] == m_edge_end[index])
+				return std::pair<edge_iterator, edge_iterator>(0, 0);
+
+			edge_iterator base = &m_edges[0];
+			return std::pair<edge_iterator, edge_iterator>(base + m_edge_begin[index], base + m_edge_end[index]);
+		}
+
+		///	(first, last) node of the paths in the lattice.
+		terminal_type& terminal()
+		{
+			return m_terminal;
+		}
+
+		const terminal_type& terminal() const
+		{
+			return m_terminal;
+		}
+
+		///	Exchange the nodes and edges with other lattice, along with the memory of both.
+		void swap(Lattice& other)
+		{
+			m_nodes.swap(other.m_nodes);
+			m_edge_begin.swap(other.m_edge_begin);
+			m_edge_end.swap(other.m_edge_end);
+			m_edges.swap(other.m_edges);
+			std::swap(m_terminal, other.m_terminal);
+		}
+
+	protected:
+		std::vector<Node> m_nodes;
+		//	out edges of node i are m_edges[m_edge_begin[i], m_edge_end[i])
+		std::vector<size_t> m_edge_begin;
+		std::vector<size_t> m_edge_end;
+		std::vector<edge_type> m_edges;
+		terminal_type m_terminal;
+	};
+}
+
+//	_OPENCLAS_LATTICE_HPP_
+#endif
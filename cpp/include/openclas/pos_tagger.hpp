@@ -0,0 +1,99 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+
+#pragma once
+#ifndef _OPENCLAS_POS_TAGGER_HPP_
+#define _OPENCLAS_POS_TAGGER_HPP_
+
+#include "common.hpp"
+#include "dictionary.hpp"
+#include "segment.hpp"
+#include "viterbi.hpp"
+#include <vector>
+
+namespace openclas {
+
+	/**	Part-of-speech tagger over the words of a segmentation.
+	*	A recorded word of the dictionary has the tags of its entry as the candidates, with the
+	*	costs of Dictionary::get_word_tag_cost(), and any other word, such as a number, a string
+	*	or [Begin], keeps its own tag. The best tags are decoded by a SparseViterbiDecoder over
+	*	the candidates, with the costs of Dictionary::get_tag_transit_cost(), so a word costs the
+	*	product of the counts of its candidates and the previous ones, instead of WORD_TAG_SIZE^2.
+	*	The costs are precomputed by Dictionary::build_scores(), so freeze the dictionary first.
+	*	The buffers are reused between calls, so keep a tagger for many sentences. A tagger is
+	*	not thread-safe, use one tagger for each thread.
+	*/
+	class PosTagger {
+	public:
+		typedef Segment::segment_type segment_type;
+	public:
+		///	Tag the words in place.
+		void tag(WordInformation* words, size_t count, const Dictionary& dict)
+		{
+			if (count == 0)
+				return;
+
+			m_decoder.clear();
+			for (size_t i = 0; i < count; ++i)
+			{
+				m_decoder.add_position();
+				add_candidates(words[i], dict);
+			}
+
+			//	the costs are negative log probabilities
+			m_decoder.decode(tag_transit(dict), m_path);
+			for (size_t i = 0; i < m_path.size(); ++i)
+				words[i].tag = static_cast<enum WordTag>(m_path[i]);
+		}
+
+		void tag(segment_type& seg, const Dictionary& dict)
+		{
+			if (!seg.words.empty())
+				tag(&seg.words[0], seg.words.size(), dict);
+		}
+
+		void tag(std::vector<segment_type>& segs, const Dictionary& dict)
+		{
+			for (size_t i = 0; i < segs.size(); ++i)
+				tag(segs[i], dict);
+		}
+
+	protected:
+		struct tag_transit {
+			const Dictionary& dict;
+			explicit tag_transit(const Dictionary& dict)
+				: dict(dict)
+			{}
+			double operator()(size_t current_tag, size_t next_tag) const
+			{
+				return - dict.get_tag_transit_cost(static_cast<int>(current_tag), static_cast<int>(next_tag));
+			}
+		};
+
+		void add_candidates(const WordInformation& word, const Dictionary& dict)
+		{
+			if (word.is_recorded && word.entry_id != INVALID_WORD_ID)
+			{
+				Dictionary::tag_range_type tags = dict.get_word_tags(word.entry_id);
+				if (tags.first != tags.second)
+				{
+					for (const TagEntry* iter = tags.first; iter != tags.second; ++iter)
+						m_decoder.add_candidate(iter->tag, - dict.get_word_tag_cost(word.entry_id, iter - tags.first));
+					return;
+				}
+			}
+			m_decoder.add_candidate(word.tag, 0);
+		}
+
+	protected:
+		SparseViterbiDecoder<double> m_decoder;
+		std::vector<size_t> m_path;
+	};
+}
+
+//	_OPENCLAS_POS_TAGGER_HPP_
+#endif
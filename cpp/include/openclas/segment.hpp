@@ -13,13 +13,18 @@
 #include "utility.hpp"
 #include "dictionary.hpp"
 #include "k_shortest_path.hpp"
+#include "thread_pool.hpp"
 
 #include <boost/utility.hpp>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/adjacency_list.hpp>
-#include <limits>		//	for std::numeric_limits<double>::max()
 #include <vector>
-#include <stdexcept>	//	for std::logic_error
+#include <algorithm>	//	for std::push_heap(), std::pop_heap()
+#include <iterator>		//	for std::advance()
+#include <functional>	//	for std::greater
+#include <stdexcept>	//	for std::logic_error, std::length_error
+#include <istream>
+#include <cstring>		//	for std::memcpy()
 
 namespace boost {
 	enum vertex_desc_t { vertex_desc = 1000 };
@@ -34,14 +39,21 @@ namespace openclas {
 
 	struct WordInformation {
 		enum WordTag tag;
+		//	next to tag, so they share the padding
+		bool is_recorded;
 		double weight;
+		//	in symbols
 		size_t offset;
 		size_t length;
-		bool is_recorded;
 		size_t index;
-		const DictEntry* entry;
+		//	the id of the dictionary word, or INVALID_WORD_ID
+		size_t entry_id;
+		//	in bytes, only set by the segmentation of UTF-8 text
+		size_t byte_offset;
+		size_t byte_length;
 		WordInformation()
-			: tag(WORD_TAG_UNKNOWN), weight(0), offset(0), length(0), is_recorded(false), index(0), entry(0)
+			: tag(WORD_TAG_UNKNOWN), is_recorded(false), weight(0), offset(0), length(0), index(0), entry_id(INVALID_WORD_ID),
+			byte_offset(0), byte_length(0)
 		{}
 		bool operator== (const WordInformation& other) const
 		{
@@ -52,11 +64,71 @@ namespace openclas {
 				&& this->length == other.length
 				&& this->is_recorded == other.is_recorded
 				&& this->index == other.index
-				&& this->entry == other.entry
+				&& this->entry_id == other.entry_id
+				&& this->byte_offset == other.byte_offset
+				&& this->byte_length == other.byte_length
 				);
 		}
 	};
 
+	//	the entry_id of a WordNode without dictionary entry
+	const unsigned int INVALID_NODE_ENTRY = static_cast<unsigned int>(-1);
+
+	/**	The packed candidate word of the atoms, the out table and the lattice nodes.
+	*	It's 24 bytes instead of the 72 bytes of WordInformation, so more candidates stay in
+	*	cache while building and decoding the lattices, and WordInformation is only made for
+	*	the words of the results. The text is at most 4G symbols.
+	*	The weight stays a double, a float is exact only for the frequencies up to 2^24.
+	*/
+	struct WordNode {
+		double weight;
+		//	in symbols
+		unsigned int offset;
+		unsigned int length;
+		//	the id of the dictionary word, or INVALID_NODE_ENTRY
+		unsigned int entry_id;
+		unsigned short tag;
+		bool is_recorded;
+		WordNode()
+			: weight(0), offset(0), length(0), entry_id(INVALID_NODE_ENTRY), tag(WORD_TAG_UNKNOWN), is_recorded(false)
+		{}
+		///	@param index	the index of the node in its lattice.
+		WordInformation to_word_information(size_t index) const
+		{
+			WordInformation word;
+			word.tag = static_cast<enum WordTag>(tag);
+			word.is_recorded = is_recorded;
+			word.weight = weight;
+			word.offset = offset;
+			word.length = length;
+			word.index = index;
+			word.entry_id = (entry_id == INVALID_NODE_ENTRY) ? INVALID_WORD_ID : entry_id;
+			return word;
+		}
+	};
+
+	///	The compact view of a word of a segmentation, the word is the symbols [offset, offset + length)
+	///	of the text, which is not copied.
+	struct WordSpan {
+		size_t offset;
+		size_t length;
+		enum WordTag tag;
+		double weight;
+		WordSpan()
+			: offset(0), length(0), tag(WORD_TAG_UNKNOWN), weight(0)
+		{}
+		explicit WordSpan(const WordInformation& word)
+			: offset(word.offset), length(word.length), tag(word.tag), weight(word.weight)
+		{}
+		explicit WordSpan(const WordNode& word)
+			: offset(word.offset), length(word.length), tag(static_cast<enum WordTag>(word.tag)), weight(word.weight)
+		{}
+		bool operator== (const WordSpan& other) const
+		{
+			return offset == other.offset && length == other.length && tag == other.tag && weight == other.weight;
+		}
+	};
+
 	typedef property<vertex_index_t, size_t,
 		property<vertex_distance_t, double, 
 		property<vertex_predecessor_t, size_t,
@@ -69,91 +141,307 @@ namespace openclas {
 	typedef adjacency_list<vecS, vecS, directedS, 
 		VertexProperty, EdgeProperty, GraphProperty> WordGraph;
 
+	typedef Lattice<WordNode> WordLattice;
+
+	///	Copy the lattice to a boost graph, so the boost graph algorithms can be applied to it.
+	inline void lattice_to_graph(const WordLattice& lattice, WordGraph& graph)
+	{
+		graph = WordGraph(lattice.node_count());
+
+		property_map<WordGraph, vertex_desc_t>::type
+			vprop_map = get(vertex_desc, graph);
+		for (size_t i = 0; i < lattice.node_count(); ++i)
+		{
+			vprop_map[i] = lattice[i].to_word_information(i);
+			WordLattice::edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = lattice.out_edges(i); ei != ei_end; ++ei)
+				add_edge(i, ei->target, ei->weight, graph);
+		}
+
+		get_property(graph, graph_terminal) = lattice.terminal();
+	}
+
+	/**	Candidate words of a text, indexed by offset.
+	*	All the words are stored in one contiguous array, and the words beginning at
+	*	offset i are [begin(i), end(i)). Only the offsets marked as the beginning of an atom
+	*	have words. reset() and clear() keep the memory for the next text.
+	*/
+	class OutTable {
+	public:
+		typedef WordNode* iterator;
+		typedef const WordNode* const_iterator;
+	public:
+		///	Prepare for a text of given length, no offset is marked.
+		void reset(size_t length)
+		{
+			if (length > static_cast<size_t>(static_cast<unsigned int>(-1)) - 1)
+				throw std::length_error("The text is too long for the offsets of WordNode.");
+			m_words.clear();
+			m_begin.assign(length + 1, npos());
+			m_end.assign(length + 1, npos());
+		}
+
+		void clear()
+		{
+			reset(0);
+		}
+
+		void swap(OutTable& other)
+		{
+			m_words.swap(other.m_words);
+			m_begin.swap(other.m_begin);
+			m_end.swap(other.m_end);
+		}
+
+		///	@returns the length of the text.
+		size_t length() const
+		{
+			return m_begin.empty() ? 0 : m_begin.size() - 1;
+		}
+
+		///	Mark the offset as the beginning of an atom.
+		void mark(size_t offset)
+		{
+			if (!is_marked(offset))
+				m_begin[offset] = m_end[offset] = 0;
+		}
+
+		bool is_marked(size_t offset) const
+		{
+			return m_begin[offset] != npos();
+		}
+
+		///	@returns the next marked offset after given one, or length() if there is none.
+		size_t next(size_t offset) const
+		{
+			size_t last = length();
+			while (++offset < last && !is_marked(offset))
+				;
+			return offset < last ? offset : last;
+		}
+
+		///	Add a word at its offset, and the offset is marked.
+		///	All the words of an offset should be added together.
+		void push_back(const WordNode& word)
+		{
+			size_t offset = word.offset;
+			if (!is_marked(offset) || m_end[offset] != m_words.size())
+			{
+				if (is_marked(offset) && m_begin[offset] != m_end[offset])
+					throw std::logic_error("The words of an offset in out table should be added together.");
+				m_begin[offset] = m_words.size();
+			}
+			m_words.push_back(word);
+			m_end[offset] = m_words.size();
+		}
+
+		///	@returns the count of words at given offset.
+		size_t size(size_t offset) const
+		{
+			return is_marked(offset) ? m_end[offset] - m_begin[offset] : 0;
+		}
+
+		iterator begin(size_t offset)
+		{
+			return m_words.empty() ? 0 : &m_words[0] + (is_marked(offset) ? m_begin[offset] : 0);
+		}
+
+		iterator end(size_t offset)
+		{
+			return m_words.empty() ? 0 : &m_words[0] + (is_marked(offset) ? m_end[offset] : 0);
+		}
+
+		const_iterator begin(size_t offset) const
+		{
+			return const_cast<OutTable*>(this)->begin(offset);
+		}
+
+		const_iterator end(size_t offset) const
+		{
+			return const_cast<OutTable*>(this)->end(offset);
+		}
+
+		///	@returns the position of a word in the table, the words of each offset are in a row,
+		///	and the offsets are in the order of being added.
+		size_t position(const_iterator word) const
+		{
+			return m_words.empty() ? 0 : static_cast<size_t>(word - &m_words[0]);
+		}
+
+	protected:
+		static size_t npos()
+		{
+			return static_cast<size_t>(-1);
+		}
+
+	protected:
+		std::vector<WordNode> m_words;
+		//	words of offset i are m_words[m_begin[i], m_end[i]), or npos if offset i is not marked
+		std::vector<size_t> m_begin;
+		std::vector<size_t> m_end;
+	};
+
+	class SegmenterContext;
+
 	class Segment{
+		friend class SegmenterContext;
 	public:
-		typedef std::map< size_t, std::vector<WordInformation> > out_table_type;
-		typedef std::vector<shared_ptr<WordGraph> > graph_list_type;
+		typedef OutTable out_table_type;
+		typedef std::vector<WordLattice> graph_list_type;
 		typedef struct {
 			double weight;
 			std::vector<WordInformation> words;
 		} segment_type;
 	public:
-		static std::wstring segment_to_string(const std::wstring& text, segment_type& seg)
+		static std::wstring segment_to_string(const std::wstring& text, const segment_type& seg)
 		{
-			std::wostringstream oss;
+			std::wstring result;
 			bool empty = true;
-			for(std::vector<WordInformation>::iterator iSeg = seg.words.begin(); iSeg != seg.words.end(); ++iSeg)
+			for(std::vector<WordInformation>::const_iterator iSeg = seg.words.begin(); iSeg != seg.words.end(); ++iSeg)
 			{
 				if (!empty)
-					oss << " ";
+					result += L' ';
 
 				if (iSeg->tag != WORD_TAG_BEGIN && iSeg->tag != WORD_TAG_END) {
-					std::wstring word(text.begin() + iSeg->offset, text.begin() + iSeg->offset + iSeg->length);
-					oss << word << "/" << WORD_TAG_NAME[iSeg->tag];
+					result.append(text, iSeg->offset, iSeg->length);
+					result += L'/';
+					result += WORD_TAG_NAME[iSeg->tag];
 					empty = false;
 				}
 			}
-			return oss.str();
+			return result;
 		}
 
-
-		static std::vector<segment_type> segment(const std::wstring& text, const Dictionary& dict, int k = 1)
+		///	Append the words of the segmentation except [Begin] and [End] to spans.
+		static void get_spans(const segment_type& seg, std::vector<WordSpan>& spans)
 		{
-			//	create sub-graphs based on given text.
-			graph_list_type graphs = create_graphs(text, dict);
-			return segment(graphs, k);
+			for (size_t i = 0; i < seg.words.size(); ++i)
+			{
+				if (seg.words[i].tag != WORD_TAG_BEGIN && seg.words[i].tag != WORD_TAG_END)
+					spans.push_back(WordSpan(seg.words[i]));
+			}
 		}
 
-		static std::vector<segment_type> segment(graph_list_type& graphs, int k = 1)
+		/**	Write the words as "word/tag" separated by spaces in UTF-8 to the buffer, without any
+		*	allocation or locale. [Begin] and [End] are skipped. The words can be WordSpan or
+		*	WordInformation, and their symbols are read from text.
+		*	Nothing is written beyond size, and the output is not terminated by '\0'.
+		* @returns the size of the whole output. If it's larger than size, the output is truncated,
+		*	and a buffer of the returned size is enough.
+		*/
+		template <class Word>
+		static size_t format_utf8(const wchar_t* text, const Word* words, size_t count, char* buffer, size_t size)
 		{
-			//	calculate k-shortest paths for each graph.
-			std::vector<std::vector<path_type> > subgraph_path_lists(graphs.size());
-			for (size_t i = 0; i < graphs.size(); ++i)
+			size_t used = 0;
+			for (size_t i = 0; i < count; ++i)
 			{
-				WordGraph& graph = *graphs[i];
-				//	get the k best path
-				graph_property<WordGraph, graph_terminal_t>::type
-					gterminal = get_property(graph, graph_terminal);
-				std::vector<path_type> results;
-				dag_k_shortest_paths(graph, gterminal.first, gterminal.second, results, k);
+				const Word& word = words[i];
+				if (word.tag == WORD_TAG_BEGIN || word.tag == WORD_TAG_END)
+					continue;
 
-				//	Get words for each result
-				std::vector<path_type>& segments_list = subgraph_path_lists[i];
-				for (std::vector<path_type>::iterator iPath = results.begin(); iPath != results.end(); ++iPath)
+				const TagNameUtf8& tag = WORD_TAG_NAME_UTF8[word.tag];
+				if (used + word.length * UTF8_MAX_LENGTH + tag.length + 2 <= size)
 				{
-					segments_list.push_back(*iPath);
+					//	room for the worst case
+					char* out = buffer + used;
+					if (used != 0)
+						*out++ = ' ';
+					out += encode_utf8(text + word.offset, word.length, out);
+					*out++ = '/';
+					std::memcpy(out, tag.name, tag.length);
+					used = out + tag.length - buffer;
+				}else{
+					if (used != 0)
+						put_bytes(" ", 1, buffer, size, used);
+					//	a few symbols at a time, and a surrogate pair is never split
+					enum { PIECE_LENGTH = 64 };
+					char bytes[PIECE_LENGTH * UTF8_MAX_LENGTH];
+					for (size_t done = 0; done < word.length; )
+					{
+						size_t piece = std::min(static_cast<size_t>(PIECE_LENGTH), word.length - done);
+						if (piece > 1 && done + piece < word.length && text[word.offset + done + piece - 1] >= 0xD800 && text[word.offset + done + piece - 1] <= 0xDBFF)
+							--piece;
+						put_bytes(bytes, encode_utf8(text + word.offset + done, piece, bytes), buffer, size, used);
+						done += piece;
+					}
+					put_bytes("/", 1, buffer, size, used);
+					put_bytes(tag.name, tag.length, buffer, size, used);
 				}
+			}
+			return used;
+		}
+
+		///	Append the words of the segmentation as "word/tag" in UTF-8 to out, see format_utf8().
+		static void format_utf8(const std::wstring& text, const segment_type& seg, std::string& out)
+		{
+			if (seg.words.empty())
+				return;
+			size_t base = out.size();
+			size_t bound = text.size() * UTF8_MAX_LENGTH + seg.words.size() * (WORD_TAG_NAME_UTF8_MAX_LENGTH + 2);
+			out.resize(base + bound);
+			out.resize(base + format_utf8(text.data(), &seg.words[0], seg.words.size(), &out[base], bound));
+		}
+
+
+		///	Segment the text with a temporary SegmenterContext,
+		///	use a SegmenterContext directly for many texts.
+		static std::vector<segment_type> segment(const std::wstring& text, const Dictionary& dict, int k = 1);
+
+		static std::vector<segment_type> segment(graph_list_type& graphs, int k = 1);
 
+		///	Segment the UTF-8 text without converting it to wstring,
+		///	the words have the offsets in both symbols and bytes.
+		static std::vector<segment_type> segment_utf8(const std::string& text, const Dictionary& dict, int k = 1);
+
+		///	Input:	the sorted k best paths of each sub-graph
+		///	Output:	the k best combinations of one path from each sub-graph, sorted by the sum of weights
+		///	The combinations of the first i sub-graphs are merged with the paths of sub-graph i,
+		///	keeping the k best only. O(k log k * subgraphs)
+		static std::vector<std::vector<path_type> > get_overall_k_shortest_path(std::vector<std::vector<path_type> >& subgraph_path_lists, int k = 1)
+		{
+			std::vector<std::vector<path_type> > overall_k_shortest_paths;
+			size_t subgraph_count = subgraph_path_lists.size();
+			if (k <= 0)
+				return overall_k_shortest_paths;
+			if (subgraph_count == 0)
+			{
+				//	the only combination is the empty one
+				overall_k_shortest_paths.push_back(std::vector<path_type>());
+				return overall_k_shortest_paths;
 			}
 
-			//	construct overall k-shortest paths.
-			std::vector<std::vector<path_type> > overall_k_shortest_paths = get_overall_k_shortest_path(subgraph_path_lists, k);
+			//	table[i] is the k best combinations of sub-graph [0, i]
+			std::vector<std::vector<combination_type> > table(subgraph_count);
+			std::vector<path_type>& first_paths = subgraph_path_lists[0];
+			for (size_t j = 0; j < first_paths.size() && j < static_cast<size_t>(k); ++j)
+			{
+				combination_type combination = {first_paths[j].weight, 0, j};
+				table[0].push_back(combination);
+			}
+			std::vector<combination_type> frontier;
+			for (size_t i = 1; i < subgraph_count; ++i)
+			{
+				std::vector<path_type>& paths = subgraph_path_lists[i];
+				if (paths.empty())
+					return overall_k_shortest_paths;
+				merge_k_smallest_sums(table[i - 1], &paths[0], paths.size(), static_cast<size_t>(k), table[i], frontier);
+			}
 
-			//	construct k-shortest path in segment_type list;
-			std::vector<segment_type> segs;
-			for(size_t i = 0; i < overall_k_shortest_paths.size(); ++i)
+			//	trace back the paths of each combination
+			const std::vector<combination_type>& last = table.back();
+			for (size_t r = 0; r < last.size(); ++r)
 			{
-				segment_type seg;
-				seg.weight = 0;
-				for (size_t j = 0; j < overall_k_shortest_paths[i].size(); ++j)
+				std::vector<path_type> path_list(subgraph_count);
+				size_t rank = r;
+				for (size_t i = subgraph_count; i-- > 0; )
 				{
-					path_type& path = overall_k_shortest_paths[i][j];
-					seg.weight += path.weight;
-
-					//	get the WordInformation
-					property_map<WordGraph, vertex_desc_t>::type
-						vprop_map = get(vertex_desc, *graphs[j]);
-					for (std::vector<size_t>::iterator iPath = path.nodelist.begin(); iPath != path.nodelist.end(); ++iPath)
-					{
-						std::vector<size_t>::iterator iNextPath = iPath;
-						if (++iNextPath != path.nodelist.end())
-							seg.words.push_back(vprop_map[*iPath]);
-					}
+					const combination_type& combination = table[i][rank];
+					path_list[i] = subgraph_path_lists[i][combination.path];
+					rank = combination.rank;
 				}
-				segs.push_back(seg);
+				overall_k_shortest_paths.push_back(path_list);
 			}
-
-			return segs;
+			return overall_k_shortest_paths;
 		}
 
 		static graph_list_type create_graphs(const wstring& text, const Dictionary& dict)
@@ -164,11 +452,12 @@ namespace openclas {
 			if (text.empty())
 				return sub_graphs;
 
-			std::vector<WordInformation> atoms;
+			std::vector<WordNode> atoms;
 			split_atoms(text, atoms);
 			out_table_type out_table;
 			create_out_table(text, dict, atoms, out_table);
-			create_graphs(text, dict, out_table, sub_graphs);
+			std::vector<size_t> split_points;
+			sub_graphs.resize(create_graphs(dict, out_table, split_points, sub_graphs));
 
 			return sub_graphs;
 		}
@@ -176,18 +465,62 @@ namespace openclas {
 	protected:
 		///	Input:	text,
 		///	Output:	atoms
-		static void split_atoms(const wstring& text, std::vector<WordInformation>& atoms)
+		static void split_atoms(const wstring& text, std::vector<WordNode>& atoms)
+		{
+			std::vector<enum SymbolType> types;
+			split_atoms(text.data(), text.data() + text.size(), atoms, types);
+		}
+
+		///	Input:	the symbols [begin, end) in memory
+		///	Output:	atoms, and the symbol types of the symbols
+		///	All the symbols are classified at once by classify(), which skips the ASCII runs.
+		static void split_atoms(const wchar_t* begin, const wchar_t* end, std::vector<WordNode>& atoms, std::vector<enum SymbolType>& types)
+		{
+			size_t length = end - begin;
+			types.resize(length);
+			if (length == 0)
+				return;
+			classify(begin, length, &types[0]);
+
+			size_t index_begin = 0;
+			for (size_t i = 1; i < length; ++i)
+			{
+				enum SymbolType previous_type = types[i - 1];
+				enum SymbolType current_type = types[i];
+				//	Exception cases
+				//	case: [\.+-．－＋][0-9]+
+				if (current_type == SYMBOL_TYPE_NUMBER && exist(begin[i - 1], NUMBER_PREFIXS))
+					continue;
+				//	case: [\d][\d] or [\w][\w]
+				if ( (previous_type == current_type) && (previous_type == SYMBOL_TYPE_LETTER || previous_type == SYMBOL_TYPE_NUMBER) )
+					continue;
+
+				WordNode word = create_word(previous_type, index_begin, i - index_begin);
+				atoms.push_back(word);
+				index_begin = i;
+			}
+
+			//	the last atom
+			WordNode word = create_word(types[length - 1], index_begin, length - index_begin);
+			atoms.push_back(word);
+		}
+
+		///	Input:	the symbols [begin, end), by a Utf8Iterator, which are decoded one by one
+		///	Output:	atoms
+		template <class Iterator>
+		static void split_atoms(Iterator begin, Iterator end, std::vector<WordNode>& atoms)
 		{
 			//	Add text.
 			size_t		index_begin = 0;
+			size_t		i = 0;
 			wchar_t		current_symbol = wchar_t();
 			enum SymbolType	current_type = SYMBOL_TYPE_UNKNOWN;
 
-			for(size_t i = 0; i < text.size(); ++i)
+			for(Iterator iter = begin; iter != end; ++i)
 			{
 				wchar_t		previous_symbol = current_symbol;
 				enum SymbolType	previous_type = current_type;
-				current_symbol = text[i];
+				current_symbol = *iter++;
 				current_type = get_symbol_type(current_symbol);
 
 				if (i != 0) {
@@ -201,21 +534,26 @@ namespace openclas {
 						pending = true;
 
 					if (!pending) {
-						WordInformation word = create_word(previous_type, index_begin, i - index_begin);
+						WordNode word = create_word(previous_type, index_begin, i - index_begin);
 						atoms.push_back(word);
 						index_begin = i;
 					}
 				}
 
-				if (i == text.size() - 1)
-				{
-					WordInformation word = create_word(current_type, index_begin, i - index_begin + 1);
-					atoms.push_back(word);
-				}
+				//	the following ASCII letters or digits are pending in the same atom, so skip them.
+				if (current_type == SYMBOL_TYPE_LETTER || current_type == SYMBOL_TYPE_NUMBER)
+					i += skip_ascii_run(iter, end, current_type == SYMBOL_TYPE_LETTER, current_symbol);
+			}
+
+			//	the last atom
+			if (i != 0)
+			{
+				WordNode word = create_word(current_type, index_begin, i - index_begin);
+				atoms.push_back(word);
 			}
 		}
 
-		static void merge_atoms(const wstring& /*text*/, std::vector<WordInformation>& /*atoms*/)
+		static void merge_atoms(const wstring& /*text*/, std::vector<WordNode>& /*atoms*/)
 		{
 			//	TODO: implement the following:
 			//		[may be better adjust it by dict's weight]
@@ -223,16 +561,14 @@ namespace openclas {
 			//	get_continue_case_1(): 	([0-9０-９]+[年月])/([末内中底前间初])
 		}
 
-		static void get_special_word_info(const Dictionary& dict, WordInformation& item)
+		static void get_special_word_info(const Dictionary& dict, WordNode& item)
 		{
-			std::wstring special_word = get_special_word_string(item.tag);
-			const DictEntry* entry = dict.get_word(special_word);
-			if (entry)
+			const std::wstring& special_word = SPECIAL_WORD_STRING[item.tag];
+			size_t id = dict.get_word_id(special_word);
+			if (id != INVALID_WORD_ID)
 			{
-				item.entry = entry;
-				item.weight = 0;
-				for (std::vector<TagEntry>::const_iterator iTag = entry->tags.begin(); iTag != entry->tags.end(); ++iTag)
-					item.weight += iTag->weight;
+				item.entry_id = static_cast<unsigned int>(id);
+				item.weight = dict.get_word_weight(id);
 			}else{
 				std::ostringstream out;
 				out << "Dictionary does not contain the entry for special word \"" << narrow(special_word, locale_platform) << "\"";
@@ -240,95 +576,180 @@ namespace openclas {
 			}
 		}
 
+		///	Copy the bytes to the buffer as long as there is room, and count them anyway.
+		static void put_bytes(const char* bytes, size_t count, char* buffer, size_t size, size_t& used)
+		{
+			if (used < size)
+				std::memcpy(buffer + used, bytes, std::min(count, size - used));
+			used += count;
+		}
+
+		///	Construct the word of given dictionary entry, which begins at the atom.
+		static WordNode create_dictionary_word(const Dictionary& dict, size_t id, const WordNode& atom, size_t word_length)
+		{
+			WordNode item;
+
+			//	attach the Dictionary entry
+			item.entry_id = static_cast<unsigned int>(id);
+			//	sum all tags weights as the item's weight
+			item.weight = dict.get_word_weight(id);
+
+			//	use the tag if the word has the only tag
+			Dictionary::tag_range_type tags = dict.get_word_tags(id);
+			if (tags.second - tags.first == 1)
+				item.tag = static_cast<unsigned short>(tags.first->tag);
+
+			item.is_recorded = true;
+			item.offset = atom.offset;
+			item.length = static_cast<unsigned int>(word_length);
+			return item;
+		}
+
+		///	Add the dictionary words found at the offset of given atom to out_table.
+		struct out_table_visitor {
+			const Dictionary& dict;
+			out_table_type& out_table;
+			const WordNode& atom;
+			out_table_visitor(const Dictionary& dict, out_table_type& out_table, const WordNode& atom)
+				: dict(dict), out_table(out_table), atom(atom)
+			{}
+			void operator() (size_t id, size_t word_length)
+			{
+				//	make sure the found word will ended at the offset which is a begin of one of atoms.
+				if (word_length < atom.length || !out_table.is_marked(atom.offset + word_length))
+					return;
+
+				WordNode item = create_dictionary_word(dict, id, atom, word_length);
+				if (item.length == atom.length)
+				{
+					//	refine the atom.
+					*out_table.begin(atom.offset) = item;
+				}else{
+					//	add new word to both offset array and wordlist
+					out_table.push_back(item);
+				}
+			}
+		};
+
+		///	Same as out_table_visitor, but the words are appended to a list, in which the atom is words[first].
+		///	The out table is only read, so the atoms can be looked up in parallel.
+		struct word_collector {
+			const Dictionary& dict;
+			const out_table_type& out_table;
+			const WordNode& atom;
+			std::vector<WordNode>& words;
+			size_t first;
+			word_collector(const Dictionary& dict, const out_table_type& out_table, const WordNode& atom, std::vector<WordNode>& words, size_t first)
+				: dict(dict), out_table(out_table), atom(atom), words(words), first(first)
+			{}
+			void operator() (size_t id, size_t word_length)
+			{
+				if (word_length < atom.length || !out_table.is_marked(atom.offset + word_length))
+					return;
+
+				WordNode item = create_dictionary_word(dict, id, atom, word_length);
+				if (item.length == atom.length)
+					words[first] = item;
+				else
+					words.push_back(item);
+			}
+		};
+
+		///	Input:	the symbols [position, end) from the atom, dict, out_table with all the atoms marked
+		///	Output:	the words beginning at the atom are appended to words, in the order of out_table_type::push_back()
+		template <class Iterator>
+		static void collect_words(Iterator position, Iterator end, const Dictionary& dict, const out_table_type& out_table, const WordNode& atom, std::vector<WordNode>& words)
+		{
+			size_t first = words.size();
+			words.push_back(atom);
+			if (atom.is_recorded)
+			{
+				word_collector collector(dict, out_table, atom, words, first);
+				dict.for_each_prefix(position, end, collector);
+			}else{
+				get_special_word_info(dict, words[first]);
+			}
+		}
+
 		///	Input:	text, dict, atoms
 		///	Output:	out_table_type
-		static void create_out_table(const wstring& text, const Dictionary& dict, const std::vector<WordInformation>& atoms, out_table_type& out_table)
+		static void create_out_table(const wstring& text, const Dictionary& dict, const std::vector<WordNode>& atoms, out_table_type& out_table)
 		{
-			//	initialize from atoms
+			create_out_table(text.data(), text.data() + text.size(), dict, atoms, out_table);
+		}
+
+		///	Input:	the symbols [begin, end), dict, atoms
+		///	Output:	out_table_type
+		template <class Iterator>
+		static void create_out_table(Iterator begin, Iterator end, const Dictionary& dict, const std::vector<WordNode>& atoms, out_table_type& out_table)
+		{
+			//	the words can only begin and end at the beginning of atoms
+			out_table.reset(atoms.empty() ? 0 : atoms.back().offset + atoms.back().length);
 			for (size_t i = 0; i < atoms.size(); ++i)
-			{
-				WordInformation atom = atoms[i];
-				out_table[atoms[i].offset].push_back(atom);
-			}
+				out_table.mark(atoms[i].offset);
 
-			//	initialize from dictionary
+			//	initialize from atoms and dictionary, the atom is the first word of each offset
+			Iterator position = begin;
 			for (size_t i = 0; i < atoms.size(); ++i)
 			{
-				const WordInformation& atom = atoms[i];
+				const WordNode& atom = atoms[i];
+				out_table.push_back(atom);
 				if (atom.is_recorded)
 				{
 					//	look up dictionary for prefixes of given sequence.
-					std::vector<DictEntry*> entries = dict.prefix(text.begin() + atom.offset, text.end());
-					for(std::vector<DictEntry*>::iterator iter = entries.begin(); iter != entries.end(); ++iter)
-					{
-						//	find the word list of the given offset.
-						size_t word_length = (*iter)->word.length();
-						//	make sure the found word will ended at the offset which is a begin of one of atoms.
-						out_table_type::iterator it = out_table.find(atom.offset + word_length);
-						if (word_length >= atom.length && it != out_table.end())
-						{
-							//	Construct the word
-							WordInformation item;
-
-							//	attach the Dictionary entry
-							item.entry = *iter;
-							//	calculate the weight
-							item.weight = 0;
-							//	sum all tags weights as the item's weight
-							for (std::vector<TagEntry>::iterator iTag = (*iter)->tags.begin(); iTag != (*iter)->tags.end(); ++iTag)
-								item.weight += iTag->weight;
-
-							//	use the tag if the word has the only tag
-							if ((*iter)->tags.size() == 1)
-								item.tag = static_cast<enum WordTag>((*iter)->tags[0].tag);
-
-							item.is_recorded = true;
-							item.offset = atom.offset;
-							item.length = word_length;
-
-							if (item.length == atom.length)
-							{
-								//	refine the atom.
-								out_table[atom.offset].at(0) = item;
-							}else{
-								//	add new word to both offset array and wordlist
-								out_table[atom.offset].push_back(item);
-							}
-						}
-					}
+					out_table_visitor visitor(dict, out_table, atom);
+					dict.for_each_prefix(position, end, visitor);
 				}else{
 					//	not recorded
-					get_special_word_info(dict, out_table[atom.offset].at(0));
+					get_special_word_info(dict, *out_table.begin(atom.offset));
 				}
+				std::advance(position, atom.length);
 			}
 		}
 
-		///	Input:	text, dict, out_table
+		///	Input:	dict, out_table
 		///	Output:	graph_list
-		static void create_graphs(const wstring& text, const Dictionary& dict, out_table_type& out_table, graph_list_type& sub_graphs)
+		///	The sub-graphs are filled in sub_graphs[0, count), the list grows if it's not enough,
+		///	and the existing graphs are reused.
+		///	@returns the count of sub-graphs.
+		static size_t create_graphs(const Dictionary& dict, const out_table_type& out_table, std::vector<size_t>& split_points, graph_list_type& sub_graphs)
+		{
+			find_split_points(out_table, split_points);
+			size_t count = split_points.size() - 1;
+			if (sub_graphs.size() < count)
+				sub_graphs.resize(count);
+			for (size_t i = 0; i < count; ++i)
+				create_graph(dict, out_table, split_points[i], split_points[i + 1], sub_graphs[i]);
+			return count;
+		}
+
+		///	Input:	out_table
+		///	Output:	the offsets to split the candidate graph into sub-graphs, including 0 and the length,
+		///	so the sub-graph i is [split_points[i], split_points[i + 1]).
+		static void find_split_points(const out_table_type& out_table, std::vector<size_t>& split_points)
 		{
 			//	split candidate graph (out_table) into several sub-graphs.
 			//	The split point should be the node with multiple out-edges, and no edge cross over the node.
-			out_table_type::iterator prev_iOut = out_table.begin();
+			split_points.clear();
+			split_points.push_back(0);
+			size_t length = out_table.length();
 			size_t max_offset = 0;
-			for (out_table_type::iterator iOut = out_table.begin(); iOut != out_table.end(); ++iOut)
+			for (size_t offset = 0, next; offset < length; offset = next)
 			{
-				//	Get the next iterator
-				out_table_type::iterator iNext = iOut;
-				++iNext;
+				//	Get the next offset
+				next = out_table.next(offset);
 
-				if (iOut != out_table.begin()	//	never split the first node
-					&& max_offset == iOut->first	//	no over edge
-					&& iOut->second.size() == 1	//	current offset only have a single word
-					&& (iNext != out_table.end() && iNext->second.size() > 1)	//	next offset have more than one words.
+				if (offset != 0	//	never split the first node
+					&& max_offset == offset	//	no over edge
+					&& out_table.size(offset) == 1	//	current offset only have a single word
+					&& (next != length && out_table.size(next) > 1)	//	next offset have more than one words.
 					)
 				{
 					//	multiple out-edges, and no over edge, so split here
-					create_graph(text, dict, out_table, prev_iOut, iOut, sub_graphs);
-					prev_iOut = iOut;
+					split_points.push_back(offset);
 				}
 
-				for (std::vector<WordInformation>::iterator iWord = iOut->second.begin(); iWord != iOut->second.end(); ++iWord)
+				for (OutTable::const_iterator iWord = out_table.begin(offset); iWord != out_table.end(offset); ++iWord)
 				{
 					size_t target_offset = iWord->offset + iWord->length;
 					if (target_offset > max_offset)
@@ -336,129 +757,93 @@ namespace openclas {
 				}
 			}
 			//	reach the last node
-			create_graph(text, dict, out_table, prev_iOut, out_table.end(), sub_graphs);
+			split_points.push_back(length);
 		}
 
-		///	Input:	text, dict, out_table, (begin, end)
+		///	Input:	dict, out_table, offsets (begin, end)
 		///	Output:	graph
-		static void create_graph(const wstring& text, const Dictionary& dict, 
-			out_table_type& out_table, 
-			out_table_type::iterator begin, out_table_type::iterator end,
-			graph_list_type& sub_graphs)
+		///	The out table is not changed, so the sub-graphs can be created in parallel.
+		///	The words of the out table should be added in the order of offsets, since the index
+		///	of a node is the position of the word in the table.
+		static void create_graph(const Dictionary& dict, 
+			const out_table_type& out_table, 
+			size_t begin, size_t end,
+			WordLattice& graph)
 		{
-			//	create graph
-			size_t word_count = 0;
-			for (out_table_type::iterator iter = begin; iter != end; ++iter)
-			{
-				word_count += iter->second.size();
-			}
-
-			if (begin == out_table.begin())
-				++word_count;	//	One more node for [Begin] for first sub-graph
-
-			++word_count;	//	One more node for the last node, it will be either end, or [End] of whole graph
-
-			shared_ptr<WordGraph> graph_ptr(new WordGraph(word_count));
-			WordGraph& graph = *graph_ptr;
+			graph.clear();
 
 			//	attach vertex information
-			property_map<WordGraph, vertex_desc_t>::type
-				vprop_map = get(vertex_desc, graph);
-
 			size_t current_index = 0;
 			//		[Begin]
-			if (begin == out_table.begin())
+			if (begin == 0)
 			{
 				//	put [begin] to graph as the first node
-				WordInformation word_begin;
+				WordNode word_begin;
 				word_begin.tag = WORD_TAG_BEGIN;
 				//	the index of other nodes should increase one, since [Begin] is insert into the first one.
-				word_begin.index = current_index++;
-				word_begin.entry = 0;
+				++current_index;
 				get_special_word_info(dict, word_begin);
-				vprop_map[word_begin.index] = word_begin;
+				graph.add_node(word_begin);
 			}
+			//	the index of the word at position p of the table is p - first_position
+			size_t first_position = out_table.position(out_table.begin(begin)) - current_index;
 			//		Internal node
-			for (out_table_type::iterator iter = begin; iter != end; ++iter)
+			for (size_t offset = begin; offset < end; offset = out_table.next(offset))
 			{
-				for (std::vector<WordInformation>::iterator it = iter->second.begin(); it != iter->second.end(); ++it)
+				for (OutTable::const_iterator it = out_table.begin(offset); it != out_table.end(offset); ++it)
 				{
-					size_t index = current_index++;
-					vprop_map[index] = *it;
-					vprop_map[index].index = index;
-					it->index = index;
+					graph.add_node(*it);
+					++current_index;
 				}
 			}
 			//		[End]
-			if (end == out_table.end()) {
+			if (end == out_table.length()) {
 				//	put [End] to graph as the last node
-				WordInformation word_end;
+				WordNode word_end;
 				word_end.tag = WORD_TAG_END;
-				word_end.index = current_index++;
-				word_end.offset = text.size();
-				word_end.entry = 0;
+				word_end.offset = static_cast<unsigned int>(out_table.length());
 				get_special_word_info(dict, word_end);
-				vprop_map[word_end.index] = word_end;
+				graph.add_node(word_end);
 			}else{
 				//	put 'end' to graph as the last node.
-				WordInformation& word_end = end->second.front();
-				word_end.index = current_index++;
-				vprop_map[word_end.index] = word_end;
-				vprop_map[word_end.index].index = word_end.index;
+				graph.add_node(*out_table.begin(end));
 			}
 
 			//	adding edges
-			property_map<WordGraph, vertex_index_t>::type
-				vindex_map = get(vertex_index, graph);
-
-			for (size_t i = 0; i < num_vertices(graph) - 1; ++i)
+			for (size_t i = 0; i < graph.node_count() - 1; ++i)
 			{
-				WordInformation prop = vprop_map[i];
+				const WordNode& prop = graph[i];
 				size_t next_offset = prop.offset + prop.length;
 
 				//	add all edges begin from the end of current word
-				if (next_offset < text.size())
+				if (next_offset < out_table.length())
 				{
-					out_table_type::iterator iter_out_next = out_table.find(next_offset);
-					std::vector<WordInformation>& next_wordlist = iter_out_next->second;
-					for (std::vector<WordInformation>::iterator iter = next_wordlist.begin(); iter != next_wordlist.end(); ++iter)
+					for (OutTable::const_iterator iter = out_table.begin(next_offset); iter != out_table.end(next_offset); ++iter)
 					{
-						add_edge_to_graph(prop, *iter, graph, text);
+						add_edge_to_graph(dict, prop, i, *iter, out_table.position(iter) - first_position, graph);
 					}
 				}else{
-					//	next_offset == text.size()
-					WordInformation& prop_end = vprop_map[num_vertices(graph)-1];
-					add_edge_to_graph(prop, prop_end, graph, text);
+					//	next_offset == out_table.length()
+					size_t end_index = graph.node_count() - 1;
+					add_edge_to_graph(dict, prop, i, graph[end_index], end_index, graph);
 				}
 			}
 
 			//	graph terminal
-			graph_property<WordGraph, graph_terminal_t>::type&
-				gterminal = get_property(graph, graph_terminal);
-
-			gterminal.first = 0;
-			if (end == out_table.end()) {
-				gterminal.second = num_vertices(graph) - 1;
-			}else{
-				gterminal.second = end->second.front().index;
-			}
-
-			sub_graphs.push_back(graph_ptr);
+			graph.terminal().first = 0;
+			graph.terminal().second = graph.node_count() - 1;
 		}
 
-		static void add_edge_to_graph(const WordInformation& prop, const WordInformation& prop_next, WordGraph& graph, const std::wstring& text)
+		static void add_edge_to_graph(const Dictionary& dict, const WordNode& prop, size_t index, const WordNode& prop_next, size_t next_index, WordLattice& graph)
 		{
-			std::wstring next_word;
-			if (prop_next.is_recorded)
-				next_word = text.substr(prop_next.offset, prop_next.length);
+			//	the entry of an unrecorded word is the entry of its special word.
+			double weight;
+			if (prop.entry_id == INVALID_NODE_ENTRY)
+				weight = calculate_transit_cost(prop.weight, 0, dict.scoring().smoothing);
+			else if (prop_next.entry_id == INVALID_NODE_ENTRY)
+				weight = dict.get_word_cost(prop.entry_id);
 			else
-				next_word = get_special_word_string(prop_next.tag);
-
-			double adjacency_weight = 0;
-			if (prop.entry)
-				adjacency_weight = prop.entry->get_forward_weight(next_word);
-
-			double weight = calculate_transit_weight(prop.weight, adjacency_weight);
+				weight = dict.get_transit_cost(prop.entry_id, prop_next.entry_id);
 			
 			if (!prop.is_recorded)
 			{
@@ -466,32 +851,14 @@ namespace openclas {
 			}
 
 			//	add the edge with weight
-			add_edge(prop.index, prop_next.index, weight, graph);
-		}
-
-		///	Calculate the possibility
-		///	0 < smoothing < 1
-		///		A = smoothing * P(Ci-1)
-		///		B = (1-smoothing) * P(Ci|Ci-1)
-		///		frequency = - Log( A + B );
-		static double calculate_transit_weight(double current_weight, double adjacency_weight, double smoothing = 0.1)
-		{
-			double P1 = (1 + current_weight) / (MAX_FREQUENCE+80000);
-			double A = smoothing * P1;
-
-			double t = 1/(double)MAX_FREQUENCE;
-			double P2 = (((1-t) * adjacency_weight) / (1+current_weight)) + t;
-			double B = (1 - smoothing) * P2;
-
-			double weight = - ::log( A + B );
-			return weight;
+			graph.add_edge(index, next_index, weight);
 		}
 
-		static WordInformation create_word(enum SymbolType type, size_t offset, size_t length)
+		static WordNode create_word(enum SymbolType type, size_t offset, size_t length)
 		{
-			WordInformation word;
-			word.offset = offset;
-			word.length = length;
+			WordNode word;
+			word.offset = static_cast<unsigned int>(offset);
+			word.length = static_cast<unsigned int>(length);
 			word.is_recorded = true;
 			if (type != SYMBOL_TYPE_CHINESE)
 			{
@@ -520,43 +887,763 @@ namespace openclas {
 			}
 			return word;
 		}
-		static std::vector<std::vector<path_type> > get_overall_k_shortest_path(std::vector<std::vector<path_type> >& subgraph_path_lists, int k = 1)
+		///	One of the k best combinations of the paths of the first sub-graphs,
+		///	it's the combination [rank] of the previous sub-graphs plus the path [path] of this one.
+		struct combination_type {
+			double weight;
+			size_t rank;
+			size_t path;
+
+			bool operator>(const combination_type& rhs) const
+			{
+				if (weight != rhs.weight)
+					return weight > rhs.weight;
+				else if (rank != rhs.rank)
+					return rank > rhs.rank;
+				else
+					return path > rhs.path;
+			}
+		};
+
+		///	Input:	the sorted k best combinations of previous sub-graphs, the sorted paths of this sub-graph
+		///	Output:	the sorted k smallest sums of the two lists
+		///	(rank, path + 1) is pushed when (rank, path) is popped, and (rank + 1, 0) when (rank, 0) is popped,
+		///	so the frontier (a heap) holds at most k + 1 pairs, and no pair is pushed twice. O(k log k)
+		static void merge_k_smallest_sums(const std::vector<combination_type>& previous, const path_type* paths, size_t path_count, size_t k,
+			std::vector<combination_type>& result, std::vector<combination_type>& frontier)
 		{
-			std::vector<std::vector<path_type> > overall_k_shortest_paths;
-			size_t subgraph_count = subgraph_path_lists.size();
-			std::vector<size_t> index_list(subgraph_count, 0);
+			result.clear();
+			frontier.clear();
+			if (previous.empty() || path_count == 0)
+				return;
+
+			std::greater<combination_type> heap_compare;
+			combination_type first = {previous[0].weight + paths[0].weight, 0, 0};
+			frontier.push_back(first);
+			while (result.size() < k && !frontier.empty())
+			{
+				std::pop_heap(frontier.begin(), frontier.end(), heap_compare);
+				combination_type top = frontier.back();
+				frontier.pop_back();
+				result.push_back(top);
 
-			for (int a = 0; a < k; ++a)
+				if (top.path + 1 < path_count)
+				{
+					combination_type next = {previous[top.rank].weight + paths[top.path + 1].weight, top.rank, top.path + 1};
+					frontier.push_back(next);
+					std::push_heap(frontier.begin(), frontier.end(), heap_compare);
+				}
+				if (top.path == 0 && top.rank + 1 < previous.size())
+				{
+					combination_type next = {previous[top.rank + 1].weight + paths[0].weight, top.rank + 1, 0};
+					frontier.push_back(next);
+					std::push_heap(frontier.begin(), frontier.end(), heap_compare);
+				}
+			}
+		}
+	};
+
+	/**	The best segmentations of a batch of texts, in one flat array of words.
+	*	The words of text i are [begin(i), end(i)), without [Begin] and [End], and their
+	*	offsets are in text i.
+	*/
+	struct SegmentBatch {
+		std::vector<WordInformation> words;
+		//	the words of text i are words[offsets[i], offsets[i + 1])
+		std::vector<size_t> offsets;
+
+		SegmentBatch() : offsets(1, 0) {}
+
+		///	@returns the count of texts.
+		size_t size() const
+		{
+			return offsets.size() - 1;
+		}
+
+		void clear()
+		{
+			words.clear();
+			offsets.assign(1, 0);
+		}
+
+		void swap(SegmentBatch& other)
+		{
+			words.swap(other.words);
+			offsets.swap(other.offsets);
+		}
+
+		const WordInformation* begin(size_t text) const
+		{
+			return words.empty() ? 0 : &words[0] + offsets[text];
+		}
+
+		const WordInformation* end(size_t text) const
+		{
+			return words.empty() ? 0 : &words[0] + offsets[text + 1];
+		}
+
+		///	Append the best one of the segmentations of a text, or no word if there is none.
+		void push_back(const std::vector<Segment::segment_type>& segs)
+		{
+			if (!segs.empty())
 			{
-				double min_weight = std::numeric_limits<double>::max();
-				size_t min_index = 0;
-				bool found_next = false;
-				//	fill the j-th best path in
-				std::vector<path_type> path_list;
-				for (size_t i = 0; i < subgraph_count; ++i)
+				const std::vector<WordInformation>& best = segs.front().words;
+				for (size_t i = 0; i < best.size(); ++i)
 				{
-					size_t index = index_list[i];
-					path_list.push_back(subgraph_path_lists[i][index]);
-					//	find which sub-graph contains the next candidate path.
-					if ((index+1) < subgraph_path_lists[i].size() && subgraph_path_lists[i][index+1].weight < min_weight)
+					if (best[i].tag != WORD_TAG_BEGIN && best[i].tag != WORD_TAG_END)
+						words.push_back(best[i]);
+				}
+			}
+			offsets.push_back(words.size());
+		}
+
+		///	Append all the texts of another batch.
+		void append(const SegmentBatch& other)
+		{
+			size_t base = words.size();
+			words.insert(words.end(), other.words.begin(), other.words.end());
+			for (size_t i = 1; i < other.offsets.size(); ++i)
+				offsets.push_back(base + other.offsets[i]);
+		}
+	};
+
+	/**	Reusable segmenter.
+	*	The context owns all the intermediate buffers of segmentation, the atoms, the out table,
+	*	the sub-graphs, the paths and the results, and they are cleared instead of freed
+	*	between calls. Once the buffers are large enough, segmenting another text with the same k
+	*	allocates no memory.
+	*	The buffers grown by a text longer than max_reused_length() are released after the call,
+	*	so a long document will not hold the memory.
+	*	A context is not thread-safe, use one context for each thread.
+	*/
+	class SegmenterContext {
+	public:
+		typedef Segment::segment_type segment_type;
+		typedef Segment::graph_list_type graph_list_type;
+		enum { DEFAULT_REUSED_LENGTH = 4096 };
+		//	in bytes, so the symbols of a chunk never exceed DEFAULT_REUSED_LENGTH
+		enum { DEFAULT_CHUNK_SIZE = 4096 };
+		//	a shorter text splits into too few sub-graphs to pay for waking up the threads
+		//	and stitching the ranges back together at their boundaries
+		enum { MIN_PARALLEL_LENGTH = 4096 };
+		//	the atoms are split into more ranges than workers, so the ranges can be stolen
+		enum { RANGES_PER_WORKER = 8 };
+		//	a smaller batch leaves each range with only a few texts, so dispatching the ranges
+		//	and appending their parts costs more than the segmentation they share out
+		enum { MIN_PARALLEL_BATCH = 64 };
+	public:
+		explicit SegmenterContext(size_t max_reused_length = DEFAULT_REUSED_LENGTH)
+			: m_max_reused_length(max_reused_length), m_pool(0), m_graph_count(0)
+		{
+		}
+
+		size_t max_reused_length() const
+		{
+			return m_max_reused_length;
+		}
+
+		void set_max_reused_length(size_t length)
+		{
+			m_max_reused_length = length;
+		}
+
+		ThreadPool* thread_pool() const
+		{
+			return m_pool;
+		}
+
+		/**	Segment the texts of at least MIN_PARALLEL_LENGTH symbols on the pool. The dictionary
+		*	lookups of the atoms, and the lattice building and decoding of the sub-graphs, run
+		*	in parallel, and the results are merged in order, so they're the same as the
+		*	sequential ones. The pool is not owned by the context, and it can be shared.
+		* @param pool	the pool, or 0 to segment sequentially.
+		*/
+		void set_thread_pool(ThreadPool* pool)
+		{
+			m_pool = pool;
+		}
+
+		///	@returns the k best segmentations of the text, sorted by weight.
+		///	The result is owned by the context, and it's valid until the next call.
+		const std::vector<segment_type>& segment(const std::wstring& text, const Dictionary& dict, int k = 1)
+		{
+			segment_symbols(text.data(), text.data() + text.size(), dict, k);
+			return m_segments;
+		}
+
+		/**	Segment the UTF-8 text, the symbols are decoded on the fly by Utf8Iterator,
+		*	so the text is never converted to a wstring.
+		*	The offsets and lengths of the words are in both symbols and bytes, and an invalid
+		*	byte is a symbol by itself, see decode_utf8().
+		* @returns the k best segmentations of the text, sorted by weight.
+		*/
+		const std::vector<segment_type>& segment_utf8(const char* text, size_t size, const Dictionary& dict, int k = 1)
+		{
+			segment_symbols(Utf8Iterator(text, text + size), Utf8Iterator(text + size, text + size), dict, k);
+			fill_byte_offsets(text, size);
+			return m_segments;
+		}
+
+		const std::vector<segment_type>& segment_utf8(const std::string& text, const Dictionary& dict, int k = 1)
+		{
+			return segment_utf8(text.data(), text.size(), dict, k);
+		}
+
+		/**	Segment a batch of texts, such as short queries, and put the best segmentation of
+		*	each text into one flat array, so there is no result vector for each text.
+		*	All the texts share the buffers of the context. With a thread pool (see
+		*	set_thread_pool()), a batch of at least MIN_PARALLEL_BATCH texts is split into
+		*	ranges segmented on the pool, each worker with its own context, and the results
+		*	are merged in order.
+		* @returns the words of the texts, which are owned by the context, and valid until the next call.
+		*/
+		const SegmentBatch& segment_batch(const std::wstring* texts, size_t count, const Dictionary& dict)
+		{
+			m_batch.clear();
+			if (!m_pool || m_pool->size() < 2 || count < MIN_PARALLEL_BATCH)
+			{
+				for (size_t i = 0; i < count; ++i)
+					m_batch.push_back(segment(texts[i], dict, 1));
+				return m_batch;
+			}
+
+			//	the range r is texts [count * r / range_count, count * (r + 1) / range_count)
+			size_t range_count = std::min(count, m_pool->size() * RANGES_PER_WORKER);
+			grow(m_batch_parts, range_count);
+			while (m_workers.size() < m_pool->size())
+				m_workers.push_back(shared_ptr<SegmenterContext>(new SegmenterContext(m_max_reused_length)));
+
+			batch_task task(*this, texts, count, range_count, dict);
+			m_pool->run(range_count, task);
+
+			for (size_t r = 0; r < range_count; ++r)
+				m_batch.append(m_batch_parts[r]);
+			return m_batch;
+		}
+
+		const SegmentBatch& segment_batch(const std::vector<std::wstring>& texts, const Dictionary& dict)
+		{
+			return segment_batch(texts.empty() ? 0 : &texts[0], texts.size(), dict);
+		}
+
+		/**	Segment a UTF-8 stream chunk by chunk, and emit the words of the best segmentation
+		*	to the sink as soon as each chunk is done, so the memory is bounded by the chunk size
+		*	instead of the size of the stream.
+		*	A chunk is cut after its last punctuation or line break, and the rest is carried to
+		*	the next chunk. A chunk without any of them is cut at its last whole symbol.
+		*	sink(const WordInformation& word, const char* bytes) is called for each word except
+		*	[Begin] and [End], the offsets of word are from the beginning of the stream, and bytes
+		*	is valid only during the call.
+		* @param chunk_size	the size of a chunk in bytes, it's at least UTF8_MAX_LENGTH.
+		* @returns the count of words.
+		*/
+		template <class Sink>
+		size_t segment_stream(std::istream& in, const Dictionary& dict, Sink& sink, size_t chunk_size = DEFAULT_CHUNK_SIZE)
+		{
+			if (chunk_size < UTF8_MAX_LENGTH)
+				chunk_size = UTF8_MAX_LENGTH;
+			m_chunk.resize(chunk_size);
+
+			size_t word_count = 0;
+			size_t symbol_base = 0;
+			size_t byte_base = 0;
+			size_t used = 0;
+			bool finished = false;
+			while (!finished)
+			{
+				in.read(&m_chunk[used], static_cast<std::streamsize>(chunk_size - used));
+				used += static_cast<size_t>(in.gcount());
+				finished = !in;
+				if (used == 0)
+					break;
+
+				size_t cut = finished ? used : find_chunk_end(&m_chunk[0], used);
+				if (cut == 0)
+					cut = used;
+				segment_utf8(&m_chunk[0], cut, dict, 1);
+				if (!m_segments.empty())
+				{
+					const std::vector<WordInformation>& words = m_segments[0].words;
+					for (size_t i = 0; i < words.size(); ++i)
 					{
-						min_weight = subgraph_path_lists[i][index+1].weight;
-						min_index = i;
-						found_next = true;
+						if (words[i].tag == WORD_TAG_BEGIN || words[i].tag == WORD_TAG_END)
+							continue;
+						WordInformation word = words[i];
+						word.offset += symbol_base;
+						word.byte_offset += byte_base;
+						sink(word, &m_chunk[words[i].byte_offset]);
+						++word_count;
 					}
+					if (!words.empty())
+						symbol_base += words.back().offset + words.back().length;
 				}
-				overall_k_shortest_paths.push_back(path_list);
-				//	if nothing found, then there is no more candidates path.
-				if (found_next) {
-					++index_list[min_index];
-				}else{
-					break;
+				byte_base += cut;
+
+				//	carry the rest to the next chunk
+				std::copy(m_chunk.begin() + cut, m_chunk.begin() + used, m_chunk.begin());
+				used -= cut;
+			}
+
+			if (chunk_size > m_max_reused_length)
+				std::vector<char>().swap(m_chunk);
+			return word_count;
+		}
+
+		///	@returns the k best segmentations of given sub-graphs.
+		const std::vector<segment_type>& segment(graph_list_type& graphs, int k = 1)
+		{
+			decode(graphs, graphs.size(), k, 0, m_pool && m_pool->size() > 1 && graphs.size() > 1);
+			return m_segments;
+		}
+
+		///	Free the intermediate buffers, the last result is kept.
+		void release()
+		{
+			std::vector<WordNode>().swap(m_atoms);
+			std::vector<enum SymbolType>().swap(m_types);
+			Segment::out_table_type().swap(m_out_table);
+			std::vector<size_t>().swap(m_byte_offsets);
+			std::vector<size_t>().swap(m_split_points);
+			std::vector<size_t>().swap(m_range_first);
+			std::vector<std::vector<WordNode> >().swap(m_range_words);
+			graph_list_type().swap(m_graphs);
+			m_graph_count = 0;
+			std::vector<shortest_path_buffer>().swap(m_path_buffers);
+			std::vector<path_type>().swap(m_paths);
+			std::vector<size_t>().swap(m_path_count);
+			std::vector<std::vector<combination_type> >().swap(m_table);
+			std::vector<combination_type>().swap(m_frontier);
+			std::vector<size_t>().swap(m_choice);
+			std::vector<std::vector<WordInformation> >().swap(m_spare_words);
+			std::vector<SegmentBatch>().swap(m_batch_parts);
+			std::vector<shared_ptr<SegmenterContext> >().swap(m_workers);
+		}
+
+	protected:
+		typedef Segment::combination_type combination_type;
+
+		///	Look up the words of the atoms [first, last) from position, into a list.
+		template <class Iterator>
+		struct out_table_task {
+			SegmenterContext& context;
+			const Dictionary& dict;
+			const std::vector<Iterator>& positions;
+			Iterator end;
+			out_table_task(SegmenterContext& context, const Dictionary& dict, const std::vector<Iterator>& positions, Iterator end)
+				: context(context), dict(dict), positions(positions), end(end)
+			{}
+			void operator() (size_t range, size_t /*worker*/)
+			{
+				context.collect_range_words(range, positions[range], end, dict);
+			}
+		};
+		template <class Iterator> friend struct out_table_task;
+
+		///	Create (if dict is given) and decode the sub-graph.
+		struct graph_task {
+			SegmenterContext& context;
+			const Dictionary* dict;
+			graph_list_type& graphs;
+			size_t best;
+			graph_task(SegmenterContext& context, const Dictionary* dict, graph_list_type& graphs, size_t best)
+				: context(context), dict(dict), graphs(graphs), best(best)
+			{}
+			void operator() (size_t index, size_t worker)
+			{
+				context.process_graph(dict, graphs[index], index, best, worker);
+			}
+		};
+		friend struct graph_task;
+
+		///	Segment a range of a batch with the context of the worker.
+		struct batch_task {
+			SegmenterContext& context;
+			const std::wstring* texts;
+			size_t count;
+			size_t range_count;
+			const Dictionary& dict;
+			batch_task(SegmenterContext& context, const std::wstring* texts, size_t count, size_t range_count, const Dictionary& dict)
+				: context(context), texts(texts), count(count), range_count(range_count), dict(dict)
+			{}
+			void operator() (size_t range, size_t worker)
+			{
+				context.segment_batch_range(texts + count * range / range_count, texts + count * (range + 1) / range_count, dict, range, worker);
+			}
+		};
+		friend struct batch_task;
+
+		void segment_batch_range(const std::wstring* first, const std::wstring* last, const Dictionary& dict, size_t range, size_t worker)
+		{
+			SegmentBatch& part = m_batch_parts[range];
+			SegmenterContext& context = *m_workers[worker];
+			part.clear();
+			for (; first != last; ++first)
+				part.push_back(context.segment(*first, dict, 1));
+		}
+
+		/**	Grow the buffers to at least given count, and keep the memory of the existing ones.
+		*	vector::resize() would copy them, and a copy has no room beyond its contents, so
+		*	they are swapped into the larger vector instead. T should have swap().
+		*/
+		template <class T>
+		static void grow(std::vector<T>& buffers, size_t count)
+		{
+			if (buffers.size() >= count)
+				return;
+			std::vector<T> grown(count);
+			for (size_t i = 0; i < buffers.size(); ++i)
+				grown[i].swap(buffers[i]);
+			buffers.swap(grown);
+		}
+
+		///	Resize m_segments to given count. The words of the segmentations beyond the count are
+		///	kept in m_spare_words with their memory, and given back when the count grows again.
+		void resize_segments(size_t count)
+		{
+			size_t size = m_segments.size();
+			grow(m_spare_words, std::max(size, count));
+			for (size_t i = count; i < size; ++i)
+				m_segments[i].words.swap(m_spare_words[i]);
+			if (count > m_segments.capacity())
+			{
+				std::vector<segment_type> grown(count);
+				for (size_t i = 0; i < size; ++i)
+				{
+					grown[i].weight = m_segments[i].weight;
+					grown[i].words.swap(m_segments[i].words);
 				}
+				m_segments.swap(grown);
+			}else{
+				m_segments.resize(count);
+			}
+			for (size_t i = size; i < count; ++i)
+				m_segments[i].words.swap(m_spare_words[i]);
+		}
+
+		void split_atoms(const wchar_t* begin, const wchar_t* end)
+		{
+			Segment::split_atoms(begin, end, m_atoms, m_types);
+		}
+
+		template <class Iterator>
+		void split_atoms(Iterator begin, Iterator end)
+		{
+			Segment::split_atoms(begin, end, m_atoms);
+		}
+
+		template <class Iterator>
+		void segment_symbols(Iterator begin, Iterator end, const Dictionary& dict, int k)
+		{
+			m_atoms.clear();
+			m_out_table.clear();
+			m_split_points.clear();
+			m_graph_count = 0;
+
+			bool parallel = false;
+			if (begin != end)
+			{
+				split_atoms(begin, end);
+				size_t length = m_atoms.back().offset + m_atoms.back().length;
+				parallel = m_pool && m_pool->size() > 1 && length >= MIN_PARALLEL_LENGTH;
+				if (parallel)
+					create_out_table_parallel(begin, end, dict);
+				else
+					Segment::create_out_table(begin, end, dict, m_atoms, m_out_table);
+
+				//	the sub-graphs are created along with decoding
+				Segment::find_split_points(m_out_table, m_split_points);
+				m_graph_count = m_split_points.size() - 1;
+				grow(m_graphs, m_graph_count);
+			}
+			decode(m_graphs, m_graph_count, k, &dict, parallel);
+
+			if (m_out_table.length() > m_max_reused_length)
+				release();
+		}
+
+		///	Same as Segment::create_out_table(), but the atoms are split into ranges, and the
+		///	words of the ranges are looked up on the pool, then added to the table in order.
+		template <class Iterator>
+		void create_out_table_parallel(Iterator begin, Iterator end, const Dictionary& dict)
+		{
+			size_t atom_count = m_atoms.size();
+			m_out_table.reset(m_atoms.back().offset + m_atoms.back().length);
+			for (size_t i = 0; i < atom_count; ++i)
+				m_out_table.mark(m_atoms[i].offset);
+
+			//	the range r is atoms [m_range_first[r], m_range_first[r + 1]) from positions[r]
+			size_t range_count = std::min(atom_count, m_pool->size() * RANGES_PER_WORKER);
+			m_range_first.resize(range_count + 1);
+			std::vector<Iterator> positions;
+			positions.reserve(range_count);
+			Iterator position = begin;
+			size_t offset = 0;
+			for (size_t r = 0; r < range_count; ++r)
+			{
+				size_t first = atom_count * r / range_count;
+				m_range_first[r] = first;
+				std::advance(position, m_atoms[first].offset - offset);
+				offset = m_atoms[first].offset;
+				positions.push_back(position);
+			}
+			m_range_first[range_count] = atom_count;
+			grow(m_range_words, range_count);
+
+			out_table_task<Iterator> task(*this, dict, positions, end);
+			m_pool->run(range_count, task);
+
+			for (size_t r = 0; r < range_count; ++r)
+			{
+				const std::vector<WordNode>& words = m_range_words[r];
+				for (size_t i = 0; i < words.size(); ++i)
+					m_out_table.push_back(words[i]);
+			}
+		}
+
+		template <class Iterator>
+		void collect_range_words(size_t range, Iterator position, Iterator end, const Dictionary& dict)
+		{
+			std::vector<WordNode>& words = m_range_words[range];
+			words.clear();
+			for (size_t i = m_range_first[range]; i < m_range_first[range + 1]; ++i)
+			{
+				Segment::collect_words(position, end, dict, m_out_table, m_atoms[i], words);
+				std::advance(position, m_atoms[i].length);
+			}
+		}
+
+		/**	Find where to cut a chunk of UTF-8 text: after the last punctuation or line break,
+		*	or else before the last symbol if it's truncated.
+		* @returns the size of the part to segment.
+		*/
+		static size_t find_chunk_end(const char* text, size_t size)
+		{
+			//	the first byte of the last symbol
+			size_t last = previous_symbol_begin(text, size);
+			size_t whole = (utf8_sequence_length(text[last]) > size - last) ? last : size;
+
+			for (size_t end = whole; end > 0; )
+			{
+				size_t begin = previous_symbol_begin(text, end);
+				size_t length = 0;
+				wchar_t symbol = decode_utf8(text + begin, text + end, length);
+				if (begin + length != end)
+				{
+					//	an invalid byte
+					begin = end - 1;
+				}else if (symbol == L'\n' || get_symbol_type(symbol) == SYMBOL_TYPE_PUNCTUATION){
+					return end;
+				}
+				end = begin;
+			}
+			return whole;
+		}
+
+		///	@returns the first byte of the symbol which ends at end, by skipping back the continuation bytes.
+		static size_t previous_symbol_begin(const char* text, size_t end)
+		{
+			size_t begin = end - 1;
+			while (begin > 0 && end - begin < UTF8_MAX_LENGTH && (static_cast<unsigned char>(text[begin]) & 0xC0) == 0x80)
+				--begin;
+			return begin;
+		}
+
+		///	Set the offsets and lengths in bytes of the words of the segmentations.
+		///	The text is decoded once into the byte offsets of the symbols, which are shared by
+		///	all the segmentations.
+		void fill_byte_offsets(const char* text, size_t size)
+		{
+			if (m_segments.empty())
+				return;
+
+			//	m_byte_offsets[i] is the byte offset of symbol i, and the last one is the size
+			m_byte_offsets.clear();
+			Utf8Iterator end(text + size, text + size);
+			for (Utf8Iterator position(text, text + size); position != end; ++position)
+				m_byte_offsets.push_back(position.base() - text);
+			m_byte_offsets.push_back(size);
+
+			for (size_t r = 0; r < m_segments.size(); ++r)
+			{
+				std::vector<WordInformation>& words = m_segments[r].words;
+				for (size_t i = 0; i < words.size(); ++i)
+				{
+					WordInformation& word = words[i];
+					word.byte_offset = m_byte_offsets[word.offset];
+					word.byte_length = m_byte_offsets[word.offset + word.length] - word.byte_offset;
+				}
+			}
+
+			if (m_byte_offsets.size() - 1 > m_max_reused_length)
+				std::vector<size_t>().swap(m_byte_offsets);
+		}
+
+		///	Same as Segment::segment(graphs, k), but all the buffers are reused.
+		///	If dict is given, the sub-graphs are created from the out table first.
+		void decode(graph_list_type& graphs, size_t graph_count, int k, const Dictionary* dict, bool parallel)
+		{
+			if (k <= 0)
+			{
+				resize_segments(0);
+				return;
+			}
+			size_t best = static_cast<size_t>(k);
+
+			//	the k best paths of sub-graph i are m_paths[i * best, i * best + m_path_count[i]),
+			//	so the sub-graphs can be decoded in any order.
+			m_path_count.assign(graph_count, 0);
+			grow(m_paths, graph_count * best);
+
+			size_t workers = parallel ? m_pool->size() : 1;
+			grow(m_path_buffers, workers);
+			graph_task task(*this, dict, graphs, best);
+			if (parallel)
+			{
+				m_pool->run(graph_count, task);
+			}else{
+				for (size_t i = 0; i < graph_count; ++i)
+					task(i, 0);
+			}
+
+			combine(graphs, graph_count, best);
+		}
+
+		void process_graph(const Dictionary* dict, WordLattice& graph, size_t index, size_t best, size_t worker)
+		{
+			if (dict)
+				Segment::create_graph(*dict, m_out_table, m_split_points[index], m_split_points[index + 1], graph);
+			if (graph.empty())
+				return;
+
+			shortest_path_buffer& buffer = m_path_buffers[worker];
+			path_type* paths = &m_paths[index * best];
+			size_t begin = graph.terminal().first;
+			size_t end = graph.terminal().second;
+			if (best == 1)
+			{
+				paths[0].weight = 0;
+				paths[0].nodelist.clear();
+				dag_shortest_path(graph, begin, end, paths[0], buffer);
+				m_path_count[index] = 1;
+			}else{
+				size_t count = dag_k_best_candidates(graph, begin, end, best, buffer);
+				for (size_t rank = 0; rank < count; ++rank)
+					dag_k_best_path(buffer, begin, end, best, rank, paths[rank]);
+				m_path_count[index] = count;
 			}
-			return overall_k_shortest_paths;
 		}
 
+		///	Merge the k best paths of the sub-graphs into the k best segmentations.
+		void combine(const graph_list_type& graphs, size_t graph_count, size_t best)
+		{
+			//	the k best combinations of the paths of sub-graph [0, i] are m_table[i],
+			//	and the only combination of no sub-graph is the empty one.
+			size_t combination_count = 1;
+			if (graph_count > 0)
+			{
+				grow(m_table, graph_count);
+
+				std::vector<combination_type>& first = m_table[0];
+				first.clear();
+				for (size_t j = 0; j < m_path_count[0] && first.size() < best; ++j)
+				{
+					combination_type combination = {m_paths[j].weight, 0, j};
+					first.push_back(combination);
+				}
+				for (size_t i = 1; i < graph_count; ++i)
+				{
+					size_t count = m_path_count[i];
+					const path_type* paths = count ? &m_paths[i * best] : 0;
+					Segment::merge_k_smallest_sums(m_table[i - 1], paths, count, best, m_table[i], m_frontier);
+				}
+				combination_count = m_table[graph_count - 1].size();
+			}
+
+			//	construct the segmentations
+			resize_segments(combination_count);
+			m_choice.resize(graph_count);
+			for (size_t r = 0; r < combination_count; ++r)
+			{
+				//	trace back the path of each sub-graph
+				for (size_t i = graph_count, rank = r; i-- > 0; )
+				{
+					const combination_type& combination = m_table[i][rank];
+					m_choice[i] = i * best + combination.path;
+					rank = combination.rank;
+				}
+
+				segment_type& seg = m_segments[r];
+				seg.weight = 0;
+				seg.words.clear();
+				for (size_t i = 0; i < graph_count; ++i)
+				{
+					const path_type& path = m_paths[m_choice[i]];
+					seg.weight += path.weight;
+
+					//	the last node of a path is the first node of next sub-graph
+					const WordLattice& graph = graphs[i];
+					for (size_t n = 0; n + 1 < path.nodelist.size(); ++n)
+						seg.words.push_back(graph[path.nodelist[n]].to_word_information(path.nodelist[n]));
+				}
+			}
+		}
+
+	private:
+		//	the result is returned by reference, and it's changed by the next call, so copy is not allowed.
+		SegmenterContext(const SegmenterContext&);
+		SegmenterContext& operator=(const SegmenterContext&);
+
+	protected:
+		size_t m_max_reused_length;
+		ThreadPool* m_pool;
+		std::vector<WordNode> m_atoms;
+		std::vector<enum SymbolType> m_types;
+		Segment::out_table_type m_out_table;
+		//	the words of the atom ranges of create_out_table_parallel()
+		std::vector<size_t> m_range_first;
+		std::vector<std::vector<WordNode> > m_range_words;
+		std::vector<size_t> m_split_points;
+		//	m_graphs[0, m_graph_count) are the sub-graphs of current text
+		graph_list_type m_graphs;
+		size_t m_graph_count;
+		//	one for each worker
+		std::vector<shortest_path_buffer> m_path_buffers;
+		std::vector<path_type> m_paths;
+		std::vector<size_t> m_path_count;
+		std::vector<std::vector<combination_type> > m_table;
+		std::vector<combination_type> m_frontier;
+		//	the path of each sub-graph in a combination
+		std::vector<size_t> m_choice;
+		std::vector<segment_type> m_segments;
+		//	the words of the segmentations [m_segments.size(), ...), see resize_segments()
+		std::vector<std::vector<WordInformation> > m_spare_words;
+		//	the byte offsets of the symbols of the UTF-8 text, see fill_byte_offsets()
+		std::vector<size_t> m_byte_offsets;
+		SegmentBatch m_batch;
+		//	the results of the ranges of a batch, and the contexts of the workers
+		std::vector<SegmentBatch> m_batch_parts;
+		std::vector<shared_ptr<SegmenterContext> > m_workers;
+		//	the bytes of current chunk of segment_stream()
+		std::vector<char> m_chunk;
 	};
+
+	inline std::vector<Segment::segment_type> Segment::segment(const std::wstring& text, const Dictionary& dict, int k)
+	{
+		SegmenterContext context;
+		return context.segment(text, dict, k);
+	}
+
+	inline std::vector<Segment::segment_type> Segment::segment(graph_list_type& graphs, int k)
+	{
+		SegmenterContext context;
+		return context.segment(graphs, k);
+	}
+
+	inline std::vector<Segment::segment_type> Segment::segment_utf8(const std::string& text, const Dictionary& dict, int k)
+	{
+		SegmenterContext context;
+		return context.segment_utf8(text, dict, k);
+	}
 }
 //	_OPENCLAS_SEGMENT_HPP_
 #endif
@@ -13,10 +13,12 @@
 #include "utility.hpp"
 #include <fstream>
 #include <iostream>
+#include <cstring>	//	for std::memset, std::memcpy
 
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace openclas {
 
@@ -204,13 +206,7 @@ namespace openclas {
 								second = get_special_word_string(get_special_word_tag(second));
 
 							//	TODO: add new entry to dict if cannot find the entry
-							DictEntry* first_entry = dict.get_word(first.begin(), first.end());
-							if (first_entry)
-								first_entry->forward[second] = header.weight;
-
-							DictEntry* second_entry = dict.get_word(second.begin(), second.end());
-							if (second_entry)
-								second_entry->backward[first] = header.weight;
+							dict.add_word_transit_weight(first, second, header.weight);
 						}else{
 							std::cerr << "Cannot find '@' in the word content." << std::endl;
 						}
@@ -412,6 +408,31 @@ namespace openclas {
 		int weight;
 	};
 
+	struct PendingTransit {
+		DictEntry* entry;
+		std::wstring word;
+		int weight;
+	};
+
+	//	write the transits of a word in OCD format
+	struct ocd_transit_writer {
+		const Dictionary& dict;
+		std::ostream& out;
+		ocd_transit_writer(const Dictionary& dict, std::ostream& out)
+			: dict(dict), out(out)
+		{}
+		void operator() (size_t next_id, double weight)
+		{
+			std::string narrow_transit_word = narrow(dict.get_word_string(next_id), locale_utf8);
+			TransitHeader transit_header;
+			transit_header.length = static_cast<int>(narrow_transit_word.length());
+			transit_header.weight = static_cast<int>(weight);
+			out.write(reinterpret_cast<const char*>(&transit_header), sizeof(TransitHeader));
+			out.write(narrow_transit_word.c_str(), static_cast<std::streamsize>(narrow_transit_word.length()));
+		}
+	};
+
+	///	Save the dictionary in OCD format, the words are read by id, so it works for a read-only dictionary too.
 	static void save_to_ocd_file(const Dictionary& dict, const char* filename)
 	{
 		std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
@@ -420,7 +441,7 @@ namespace openclas {
 		DictHeader header;
 		header.magic_code = DICT_MAGIC_CODE;
 		header.tag_count = static_cast<unsigned short>(dict.tags().size());
-		header.word_count = static_cast<int>(dict.words().size());
+		header.word_count = static_cast<int>(dict.word_count());
 		out.write(reinterpret_cast<const char *>(&header), sizeof(DictHeader));
 
 		//	Write all tags
@@ -434,20 +455,22 @@ namespace openclas {
 
 		out.write(reinterpret_cast<const char*>(tags_transit.get()), static_cast<int>(sizeof(int) * dict.tags_transit().size()));
 		//	Write all words
-		for (Dictionary::word_dict_type::const_iterator iter = dict.words().begin(); iter != dict.words().end(); ++iter)
+		ocd_transit_writer transit_writer(dict, out);
+		for (size_t id = 0; id < dict.word_count(); ++id)
 		{
-			std::string narrow_word = narrow((*iter)->word, locale_utf8);
+			std::string narrow_word = narrow(dict.get_word_string(id), locale_utf8);
+			Dictionary::tag_range_type tag_range = dict.get_word_tags(id);
 
 			WordHeader word_header;
 			word_header.length = static_cast<unsigned char>(narrow_word.length());
-			word_header.tag_count = static_cast<unsigned char>((*iter)->tags.size());
-			word_header.transit_count = static_cast<unsigned short>((*iter)->forward.size());
+			word_header.tag_count = static_cast<unsigned char>(tag_range.second - tag_range.first);
+			word_header.transit_count = static_cast<unsigned short>(dict.get_word_transit_count(id));
 			//	Word Header
 			out.write(reinterpret_cast<const char*>(&word_header), sizeof(WordHeader));
 			//	Word content
 			out.write(reinterpret_cast<const char*>(narrow_word.c_str()), static_cast<int>(narrow_word.length()));
 			//	Word Tags
-			for (std::vector<TagEntry>::iterator it = (*iter)->tags.begin(); it != (*iter)->tags.end(); ++it)
+			for (const TagEntry* it = tag_range.first; it != tag_range.second; ++it)
 			{
 				TagItem tag;
 				tag.tag = it->tag;
@@ -455,15 +478,7 @@ namespace openclas {
 				out.write(reinterpret_cast<const char*>(&tag), sizeof(TagItem));
 			}
 			//	Word Transit
-			for (DictEntry::transit_type::iterator it = (*iter)->forward.begin(); it != (*iter)->forward.end(); ++it)
-			{
-				std::string narrow_transit_word = narrow(it->first, locale_utf8);
-				TransitHeader transit_header;
-				transit_header.length = static_cast<int>(narrow_transit_word.length());
-				transit_header.weight = static_cast<int>(it->second);
-				out.write(reinterpret_cast<const char*>(&transit_header), sizeof(TransitHeader));
-				out.write(narrow_transit_word.c_str(), static_cast<std::streamsize>(narrow_transit_word.length()));
-			}
+			dict.for_each_word_transit(id, transit_writer);
 		}
 	}
 
@@ -497,6 +512,8 @@ namespace openclas {
 			dict.add_tag_transit_weight(i, tags_transit[i]);
 		}
 		//	Read all words
+		//		the transit words might not be loaded yet, so resolve them after all words are loaded.
+		std::vector<PendingTransit> transits;
 		for (int i = 0; i < header.word_count; ++i)
 		{
 			//	Word Header
@@ -523,12 +540,181 @@ namespace openclas {
 				scoped_array<char> transit_word_ptr(new char[transit_header.length]);
 				in.read(transit_word_ptr.get(), transit_header.length);
 				std::string narrow_word(transit_word_ptr.get(), transit_word_ptr.get() + transit_header.length);
-				std::wstring transit_word = widen(narrow_word, locale_utf8);
-				entry->forward[transit_word] = transit_header.weight;
+				PendingTransit transit;
+				transit.entry = entry;
+				transit.word = widen(narrow_word, locale_utf8);
+				transit.weight = transit_header.weight;
+				transits.push_back(transit);
+			}
+		}
+		//	Resolve word transits
+		for (std::vector<PendingTransit>::iterator iter = transits.begin(); iter != transits.end(); ++iter)
+		{
+			DictEntry* next_entry = dict.get_word(iter->word);
+			if (next_entry)
+			{
+				iter->entry->forward.set(next_entry->id, iter->weight);
+				next_entry->backward.set(iter->entry->id, iter->weight);
 			}
 		}
 	}
 
+	/*******************************************************************
+	*
+	*	OCD v2 (DictionaryImage)
+	*
+	********************************************************************/
+
+	inline size_t align_image_offset(size_t offset)
+	{
+		return (offset + DICT_IMAGE_ALIGNMENT - 1) / DICT_IMAGE_ALIGNMENT * DICT_IMAGE_ALIGNMENT;
+	}
+
+	template <typename T>
+	inline T* image_section(std::vector<char>& buffer, const DictImageHeader& header, DictImageSection section)
+	{
+		return reinterpret_cast<T*>(&buffer[0] + header.offset[section]);
+	}
+
+	///	Build the OCD v2 image of given dictionary into buffer.
+	static void build_image(const Dictionary& dict, std::vector<char>& buffer)
+	{
+		if (dict.is_read_only())
+		{
+			buffer.assign(dict.image().data(), dict.image().data() + dict.image().size());
+			return;
+		}
+
+		//	use the frozen indexer if possible, the value of the indexer is the word id.
+		DoubleArrayIndexer local_indexer;
+		const DoubleArrayIndexer* indexer = &dict.frozen_indexer();
+		if (!dict.is_frozen())
+		{
+			std::vector<DoubleArrayIndexer::key_type> keys;
+			keys.reserve(dict.words().size());
+			for (size_t i = 0; i < dict.words().size(); ++i)
+				keys.push_back(DoubleArrayIndexer::key_type(dict.words()[i]->word, static_cast<int>(i)));
+			local_indexer.build(keys);
+			indexer = &local_indexer;
+		}
+
+		//	Header
+		DictImageHeader header;
+		std::memset(&header, 0, sizeof(DictImageHeader));
+		header.magic_code = DICT_IMAGE_MAGIC_CODE;
+		header.version = DICT_IMAGE_VERSION;
+		header.wchar_size = sizeof(wchar_t);
+		header.tag_count = static_cast<unsigned int>(dict.tags().size());
+		header.tag_total_weight = dict.get_tag_total_weight();
+		header.word_count = static_cast<unsigned int>(dict.words().size());
+		header.longest_word_length = static_cast<unsigned int>(dict.longest_word_length());
+		header.state_count = static_cast<unsigned int>(indexer->size());
+		header.extra_code_count = static_cast<unsigned int>(indexer->extra_code_count());
+		for (Dictionary::word_dict_type::const_iterator iter = dict.words().begin(); iter != dict.words().end(); ++iter)
+		{
+			header.tag_item_count += static_cast<unsigned int>((*iter)->tags.size());
+			header.transit_count += static_cast<unsigned int>((*iter)->forward.size());
+			header.text_length += static_cast<unsigned int>((*iter)->word.length());
+		}
+
+		size_t offset = align_image_offset(sizeof(DictImageHeader));
+		for (int i = 0; i < IMAGE_SECTION_COUNT; ++i)
+		{
+			header.offset[i] = static_cast<unsigned int>(offset);
+			offset = align_image_offset(offset + DictionaryImage::section_size(header, static_cast<DictImageSection>(i)));
+		}
+		buffer.assign(offset, 0);
+		std::memcpy(&buffer[0], &header, sizeof(DictImageHeader));
+
+		//	Tags
+		std::copy(dict.tags().begin(), dict.tags().end(), image_section<int>(buffer, header, IMAGE_TAG));
+		std::copy(dict.tags_transit().begin(), dict.tags_transit().end(), image_section<int>(buffer, header, IMAGE_TAG_TRANSIT));
+
+		//	Index
+		std::copy(indexer->base(), indexer->base() + header.state_count, image_section<int>(buffer, header, IMAGE_BASE));
+		std::copy(indexer->check(), indexer->check() + header.state_count, image_section<int>(buffer, header, IMAGE_CHECK));
+		std::copy(indexer->value(), indexer->value() + header.state_count, image_section<int>(buffer, header, IMAGE_VALUE));
+		std::copy(indexer->bmp_code(), indexer->bmp_code() + DoubleArrayIndexer::BMP_CODE_SIZE, image_section<unsigned short>(buffer, header, IMAGE_BMP_CODE));
+		std::copy(indexer->extra_code(), indexer->extra_code() + header.extra_code_count,
+			image_section<DoubleArrayIndexer::extra_code_type>(buffer, header, IMAGE_EXTRA_CODE));
+
+		//	Words
+		DictImageEntry* entry = image_section<DictImageEntry>(buffer, header, IMAGE_ENTRY);
+		TagEntry* tag_item = image_section<TagEntry>(buffer, header, IMAGE_TAG_ITEM);
+		DictImageTransit* transit = image_section<DictImageTransit>(buffer, header, IMAGE_TRANSIT);
+		wchar_t* text = image_section<wchar_t>(buffer, header, IMAGE_TEXT);
+		unsigned int tag_offset = 0, transit_offset = 0, text_offset = 0;
+		for (size_t i = 0; i < dict.words().size(); ++i)
+		{
+			const DictEntry* word = dict.words()[i];
+
+			entry[i].text_offset = text_offset;
+			entry[i].length = static_cast<unsigned int>(word->word.length());
+			std::copy(word->word.begin(), word->word.end(), text + text_offset);
+			text_offset += entry[i].length;
+
+			entry[i].tag_offset = tag_offset;
+			entry[i].tag_count = static_cast<unsigned int>(word->tags.size());
+			std::copy(word->tags.begin(), word->tags.end(), tag_item + tag_offset);
+			tag_offset += entry[i].tag_count;
+
+			//	the transit table is sorted by id already
+			entry[i].transit_offset = transit_offset;
+			entry[i].transit_count = static_cast<unsigned int>(word->forward.size());
+			for (DictEntry::transit_type::const_iterator it = word->forward.begin(); it != word->forward.end(); ++it, ++transit_offset)
+			{
+				transit[transit_offset].id = static_cast<unsigned int>(it->id);
+				transit[transit_offset].weight = static_cast<int>(it->weight);
+			}
+		}
+	}
+
+	static void save_to_ocd2_file(const Dictionary& dict, const char* filename)
+	{
+		std::vector<char> buffer;
+		build_image(dict, buffer);
+
+		std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+		if (out.fail())
+			throw std::runtime_error(concat_error_message("Cannot open file", filename));
+		out.write(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+	}
+
+	/**	Map the OCD v2 file read-only and attach it to the dictionary, nothing is parsed or copied
+	*	except the tag tables, and the file stays mapped until the dictionary is destroyed or
+	*	attached to another image. The dictionary becomes read-only.
+	*/
+	static void load_from_ocd2_file(Dictionary& dict, const char* filename)
+	{
+		using boost::iostreams::mapped_file_source;
+
+		boost::shared_ptr<mapped_file_source> file(new mapped_file_source());
+		try {
+			file->open(filename);
+		}catch(std::exception&){
+			throw std::runtime_error(concat_error_message("Cannot open file", filename));
+		}
+		if (!file->is_open())
+			throw std::runtime_error(concat_error_message("Cannot open file", filename));
+
+		dict.attach_image(DictionaryImage(file->data(), file->size(), file));
+	}
+
+	//	write the transits of a word in the bigram text format
+	struct txt_transit_writer {
+		const Dictionary& dict;
+		std::wostream& out;
+		std::wstring word;
+		txt_transit_writer(const Dictionary& dict, std::wostream& out)
+			: dict(dict), out(out)
+		{}
+		void operator() (size_t next_id, double weight)
+		{
+			out << word << " " << dict.get_word_string(next_id) << " " << static_cast<int>(weight) << std::endl;
+		}
+	};
+
+	///	Save the dictionary in text format, the words are read by id, so it works for a read-only dictionary too.
 	static void save_to_txt_stream(const Dictionary& dict, std::wostream& tag_out, std::wostream& unigram_out, std::wostream& bigram_out, bool save_bigram = true)
 	{
 		//	write tag
@@ -559,20 +745,20 @@ namespace openclas {
 		}
 		//	write unigram & bigram
 		{
-			size_t word_count = dict.words().size();
+			size_t word_count = dict.word_count();
+			txt_transit_writer transit_writer(dict, bigram_out);
 			for (size_t i = 0; i < word_count; ++i)
 			{
-				DictEntry* entry = dict.words().at(i);
-				for (std::vector<TagEntry>::iterator iter = entry->tags.begin(); iter != entry->tags.end(); ++iter)
+				std::wstring word = dict.get_word_string(i);
+				Dictionary::tag_range_type tag_range = dict.get_word_tags(i);
+				for (const TagEntry* iter = tag_range.first; iter != tag_range.second; ++iter)
 				{
-					unigram_out << entry->word << " " << iter->tag << " " << iter->weight << std::endl;
+					unigram_out << word << " " << iter->tag << " " << iter->weight << std::endl;
 				}
 				if (save_bigram)
 				{
-					for (DictEntry::transit_type::iterator iter = entry->forward.begin(); iter != entry->forward.end(); ++iter)
-					{
-						bigram_out << entry->word << " " << iter->first << " " << static_cast<int>(iter->second) << std::endl;
-					}
+					transit_writer.word = word;
+					dict.for_each_word_transit(i, transit_writer);
 				}
 			}
 		}
@@ -635,8 +821,8 @@ namespace openclas {
 				bigram_in >> weight;
 
 				if (!word1.empty()) {
-					DictEntry* entry = dict.add_word(word1);
-					entry->forward[word2] = weight;
+					dict.add_word(word1);
+					dict.add_word_transit_weight(word1, word2, weight);
 				}
 			}
 		}
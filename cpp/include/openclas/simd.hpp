@@ -0,0 +1,604 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+#pragma once
+#ifndef _OPENCLAS_SIMD_HPP_
+#define _OPENCLAS_SIMD_HPP_
+
+#include "common.hpp"
+#include <cstddef>
+
+//	SSE2 is always compiled on x86, and AVX2 if the compiler has the intrinsics.
+//	The level is selected at runtime by the CPU, so the binary still runs on old CPUs.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define OPENCLAS_SIMD_SSE2
+#	if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#		define OPENCLAS_SIMD_AVX2
+#	elif defined(_MSC_VER) && _MSC_VER >= 1700
+#		define OPENCLAS_SIMD_AVX2
+#	endif
+#endif
+
+#if defined(OPENCLAS_SIMD_SSE2)
+#	include <emmintrin.h>
+#endif
+#if defined(OPENCLAS_SIMD_AVX2)
+#	include <immintrin.h>
+#endif
+#if defined(OPENCLAS_SIMD_SSE2) && defined(_MSC_VER)
+#	include <intrin.h>
+#elif defined(OPENCLAS_SIMD_SSE2) && defined(__GNUC__)
+#	include <cpuid.h>
+#endif
+
+#if defined(__GNUC__)
+#	define OPENCLAS_TARGET_SSE2 __attribute__((target("sse2")))
+#	define OPENCLAS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#	define OPENCLAS_TARGET_SSE2
+#	define OPENCLAS_TARGET_AVX2
+#endif
+
+namespace openclas {
+
+	enum SimdLevel {
+		SIMD_NONE,	//	scalar code only
+		SIMD_SSE2,
+		SIMD_AVX2
+	};
+
+	/**	Detect the best SIMD level supported by both the CPU and the compiler.
+	*	AVX2 also needs the OS to save the YMM registers.
+	*/
+	inline enum SimdLevel detect_simd_level()
+	{
+#if defined(OPENCLAS_SIMD_SSE2)
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+#	if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		ecx = info[2];
+		edx = info[3];
+#	else
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			return SIMD_NONE;
+#	endif
+		if (!(edx & (1u << 26)))
+			return SIMD_NONE;
+#	if defined(OPENCLAS_SIMD_AVX2)
+		//	OSXSAVE and AVX
+		if ((ecx & (1u << 27)) && (ecx & (1u << 28)))
+		{
+#		if defined(_MSC_VER)
+			unsigned long long xcr0 = _xgetbv(0);
+			__cpuidex(info, 7, 0);
+			ebx = info[1];
+#		else
+			unsigned int xcr0_low = 0, xcr0_high = 0;
+			__asm__ ("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+			unsigned long long xcr0 = xcr0_low;
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+#		endif
+			//	XMM and YMM state, and AVX2
+			if ((xcr0 & 6) == 6 && (ebx & (1u << 5)))
+				return SIMD_AVX2;
+		}
+#	endif
+		return SIMD_SSE2;
+#else
+		return SIMD_NONE;
+#endif
+	}
+
+	inline enum SimdLevel& simd_level_setting()
+	{
+		static enum SimdLevel level = detect_simd_level();
+		return level;
+	}
+
+	///	@returns the SIMD level used by the dispatched functions.
+	inline enum SimdLevel get_simd_level()
+	{
+		return simd_level_setting();
+	}
+
+	/**	Use a lower SIMD level, for tests and benchmarks.
+	*	The level is limited to the detected one. It's not thread-safe, so set it before
+	*	any segmentation starts.
+	* @returns the previous level.
+	*/
+	inline enum SimdLevel set_simd_level(enum SimdLevel level)
+	{
+		enum SimdLevel previous = simd_level_setting();
+		enum SimdLevel detected = detect_simd_level();
+		simd_level_setting() = (level < detected) ? level : detected;
+		return previous;
+	}
+
+	///	@returns the index of the lowest zero bit of mask, mask should not be all ones.
+	inline unsigned int lowest_zero_bit(unsigned int mask)
+	{
+		unsigned int index = 0;
+		while (mask & 1)
+		{
+			mask >>= 1;
+			++index;
+		}
+		return index;
+	}
+
+	/****************************************************
+	*
+	*	ASCII run scanner
+	*
+	****************************************************/
+
+	/**	ASCII letter [A-Za-z] or digit [0-9] of a run.
+	*	letter: fold the case by | 0x20, then 'a' <= symbol <= 'z'
+	*	digit:	'0' <= symbol <= '9'
+	*/
+	template <typename CharType>
+	inline bool is_ascii_run_symbol(CharType symbol, bool letter)
+	{
+		if (letter)
+		{
+			int folded = symbol | 0x20;
+			return folded >= 'a' && folded <= 'z';
+		}else{
+			return symbol >= '0' && symbol <= '9';
+		}
+	}
+
+	template <typename CharType>
+	inline size_t scan_ascii_run_scalar(const CharType* text, size_t length, bool letter)
+	{
+		size_t i = 0;
+		while (i < length && is_ascii_run_symbol(text[i], letter))
+			++i;
+		return i;
+	}
+
+#if defined(OPENCLAS_SIMD_SSE2)
+	//	The lanes of a code unit, 8 bits for UTF-8, and 16 bits (Windows) or 32 bits (others) for wchar_t.
+	//	The signed comparison is fine, since the negative lanes are out of the ranges anyway.
+	template <size_t Size> struct symbol_lanes;
+
+	template <> struct symbol_lanes<1> {
+		OPENCLAS_TARGET_SSE2 static __m128i set1(int value) { return _mm_set1_epi8(static_cast<char>(value)); }
+		OPENCLAS_TARGET_SSE2 static __m128i cmpgt(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+#	if defined(OPENCLAS_SIMD_AVX2)
+		OPENCLAS_TARGET_AVX2 static __m256i set1_256(int value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+		OPENCLAS_TARGET_AVX2 static __m256i cmpgt_256(__m256i a, __m256i b) { return _mm256_cmpgt_epi8(a, b); }
+#	endif
+	};
+
+	template <> struct symbol_lanes<2> {
+		OPENCLAS_TARGET_SSE2 static __m128i set1(int value) { return _mm_set1_epi16(static_cast<short>(value)); }
+		OPENCLAS_TARGET_SSE2 static __m128i cmpgt(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+#	if defined(OPENCLAS_SIMD_AVX2)
+		OPENCLAS_TARGET_AVX2 static __m256i set1_256(int value) { return _mm256_set1_epi16(static_cast<short>(value)); }
+		OPENCLAS_TARGET_AVX2 static __m256i cmpgt_256(__m256i a, __m256i b) { return _mm256_cmpgt_epi16(a, b); }
+#	endif
+	};
+
+	template <> struct symbol_lanes<4> {
+		OPENCLAS_TARGET_SSE2 static __m128i set1(int value) { return _mm_set1_epi32(value); }
+		OPENCLAS_TARGET_SSE2 static __m128i cmpgt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+#	if defined(OPENCLAS_SIMD_AVX2)
+		OPENCLAS_TARGET_AVX2 static __m256i set1_256(int value) { return _mm256_set1_epi32(value); }
+		OPENCLAS_TARGET_AVX2 static __m256i cmpgt_256(__m256i a, __m256i b) { return _mm256_cmpgt_epi32(a, b); }
+#	endif
+	};
+
+	//	16 bytes a time, 16, 8 or 4 symbols.
+	template <typename CharType>
+	OPENCLAS_TARGET_SSE2 inline size_t scan_ascii_run_sse2(const CharType* text, size_t length, bool letter)
+	{
+		typedef symbol_lanes<sizeof(CharType)> lanes;
+		const size_t step = 16 / sizeof(CharType);
+		const __m128i fold = lanes::set1(letter ? 0x20 : 0);
+		const __m128i lower = lanes::set1(letter ? 'a' - 1 : '0' - 1);
+		const __m128i upper = lanes::set1(letter ? 'z' + 1 : '9' + 1);
+
+		size_t i = 0;
+		for (; i + step <= length; i += step)
+		{
+			__m128i symbols = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), fold);
+			__m128i in_run = _mm_and_si128(lanes::cmpgt(symbols, lower), lanes::cmpgt(upper, symbols));
+			unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(in_run));
+			if (mask != 0xFFFF)
+				return i + lowest_zero_bit(mask) / sizeof(CharType);
+		}
+		return i + scan_ascii_run_scalar(text + i, length - i, letter);
+	}
+#endif
+
+#if defined(OPENCLAS_SIMD_AVX2)
+	//	32 bytes a time, 32, 16 or 8 symbols.
+	template <typename CharType>
+	OPENCLAS_TARGET_AVX2 inline size_t scan_ascii_run_avx2(const CharType* text, size_t length, bool letter)
+	{
+		typedef symbol_lanes<sizeof(CharType)> lanes;
+		const size_t step = 32 / sizeof(CharType);
+		const __m256i fold = lanes::set1_256(letter ? 0x20 : 0);
+		const __m256i lower = lanes::set1_256(letter ? 'a' - 1 : '0' - 1);
+		const __m256i upper = lanes::set1_256(letter ? 'z' + 1 : '9' + 1);
+
+		size_t i = 0;
+		unsigned int mask = 0xFFFFFFFFu;
+		for (; i + step <= length; i += step)
+		{
+			__m256i symbols = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), fold);
+			__m256i in_run = _mm256_and_si256(lanes::cmpgt_256(symbols, lower), lanes::cmpgt_256(upper, symbols));
+			mask = static_cast<unsigned int>(_mm256_movemask_epi8(in_run));
+			if (mask != 0xFFFFFFFFu)
+				break;
+		}
+		//	clear the upper halves, or the following SSE code pays for the state transition,
+		//	the compiler doesn't always do it for us.
+		_mm256_zeroupper();
+		if (mask != 0xFFFFFFFFu)
+			return i + lowest_zero_bit(mask) / sizeof(CharType);
+		return i + scan_ascii_run_sse2(text + i, length - i, letter);
+	}
+#endif
+
+	/**	Find the end of a run of ASCII letters, or ASCII digits.
+	*	It works on wchar_t, and on the bytes of UTF-8, where an ASCII symbol is a single byte.
+	* @param letter	true for [A-Za-z], false for [0-9]
+	* @param level	the SIMD level to use, it should be supported by the CPU.
+	* @returns the count of leading symbols of text in the run.
+	*/
+	template <typename CharType>
+	inline size_t scan_ascii_run(const CharType* text, size_t length, bool letter, enum SimdLevel level)
+	{
+		switch (level)
+		{
+#if defined(OPENCLAS_SIMD_AVX2)
+		case SIMD_AVX2:
+			return scan_ascii_run_avx2(text, length, letter);
+#endif
+#if defined(OPENCLAS_SIMD_SSE2)
+		case SIMD_SSE2:
+			return scan_ascii_run_sse2(text, length, letter);
+#endif
+		default:
+			return scan_ascii_run_scalar(text, length, letter);
+		}
+	}
+
+	template <typename CharType>
+	inline size_t scan_ascii_run(const CharType* text, size_t length, bool letter)
+	{
+		return scan_ascii_run(text, length, letter, get_simd_level());
+	}
+
+	/****************************************************
+	*
+	*	Max-plus kernel
+	*
+	****************************************************/
+
+	/**	The max-plus product of a row of scores and one row of the transposed matrix,
+	*	the best of score[i] + column[i], and the first i of the best on a tie.
+	* @returns the index of the best.
+	*/
+	template <typename ValueType>
+	inline size_t max_plus_row_scalar(const ValueType* score, const ValueType* column, size_t count, ValueType& best)
+	{
+		size_t index = 0;
+		best = score[0] + column[0];
+		for (size_t i = 1; i < count; ++i)
+		{
+			ValueType value = score[i] + column[i];
+			if (value > best)
+			{
+				best = value;
+				index = i;
+			}
+		}
+		return index;
+	}
+
+	///	Pick the best of the lanes, and the lowest index on a tie, since each lane keeps its first best.
+	inline size_t max_plus_reduce_lanes(const float* lane_best, const int* lane_index, size_t lanes, float& best)
+	{
+		size_t lane = 0;
+		for (size_t i = 1; i < lanes; ++i)
+		{
+			if (lane_best[i] > lane_best[lane] || (lane_best[i] == lane_best[lane] && lane_index[i] < lane_index[lane]))
+				lane = i;
+		}
+		best = lane_best[lane];
+		return static_cast<size_t>(lane_index[lane]);
+	}
+
+#if defined(OPENCLAS_SIMD_SSE2)
+	//	4 floats a time, each lane keeps its own best and index, then the tail is scalar.
+	OPENCLAS_TARGET_SSE2 inline size_t max_plus_row_sse2(const float* score, const float* column, size_t count, float& best)
+	{
+		if (count < 4)
+			return max_plus_row_scalar(score, column, count, best);
+
+		__m128 best_value = _mm_add_ps(_mm_loadu_ps(score), _mm_loadu_ps(column));
+		__m128i best_index = _mm_set_epi32(3, 2, 1, 0);
+		__m128i index = best_index;
+		const __m128i step = _mm_set1_epi32(4);
+		size_t i = 4;
+		for (; i + 4 <= count; i += 4)
+		{
+			index = _mm_add_epi32(index, step);
+			__m128 value = _mm_add_ps(_mm_loadu_ps(score + i), _mm_loadu_ps(column + i));
+			__m128 greater = _mm_cmpgt_ps(value, best_value);
+			best_value = _mm_or_ps(_mm_and_ps(greater, value), _mm_andnot_ps(greater, best_value));
+			__m128i greater_index = _mm_castps_si128(greater);
+			best_index = _mm_or_si128(_mm_and_si128(greater_index, index), _mm_andnot_si128(greater_index, best_index));
+		}
+
+		float lane_best[4];
+		int lane_index[4];
+		_mm_storeu_ps(lane_best, best_value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+		size_t result = max_plus_reduce_lanes(lane_best, lane_index, 4, best);
+		for (; i < count; ++i)
+		{
+			float value = score[i] + column[i];
+			if (value > best)
+			{
+				best = value;
+				result = i;
+			}
+		}
+		return result;
+	}
+#endif
+
+#if defined(OPENCLAS_SIMD_AVX2)
+	//	8 floats a time, then the halves are merged to continue by 4.
+	OPENCLAS_TARGET_AVX2 inline size_t max_plus_row_avx2(const float* score, const float* column, size_t count, float& best)
+	{
+		if (count < 8)
+			return max_plus_row_sse2(score, column, count, best);
+
+		__m256 best_value = _mm256_add_ps(_mm256_loadu_ps(score), _mm256_loadu_ps(column));
+		__m256i best_index = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+		__m256i index = best_index;
+		const __m256i step = _mm256_set1_epi32(8);
+		size_t i = 8;
+		for (; i + 8 <= count; i += 8)
+		{
+			index = _mm256_add_epi32(index, step);
+			__m256 value = _mm256_add_ps(_mm256_loadu_ps(score + i), _mm256_loadu_ps(column + i));
+			__m256 greater = _mm256_cmp_ps(value, best_value, _CMP_GT_OQ);
+			best_value = _mm256_blendv_ps(best_value, value, greater);
+			best_index = _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(greater));
+		}
+
+		//	the upper lane wins if it is greater, or equal with a lower index
+		__m128 low_value = _mm256_castps256_ps128(best_value);
+		__m128 high_value = _mm256_extractf128_ps(best_value, 1);
+		__m128i low_index = _mm256_castsi256_si128(best_index);
+		__m128i high_index = _mm256_extracti128_si256(best_index, 1);
+		__m128 high_wins = _mm_or_ps(_mm_cmpgt_ps(high_value, low_value),
+			_mm_and_ps(_mm_cmpeq_ps(high_value, low_value), _mm_castsi128_ps(_mm_cmplt_epi32(high_index, low_index))));
+		__m128 half_value = _mm_blendv_ps(low_value, high_value, high_wins);
+		__m128i half_index = _mm_blendv_epi8(low_index, high_index, _mm_castps_si128(high_wins));
+		if (i + 4 <= count)
+		{
+			__m128i next_index = _mm_add_epi32(_mm256_castsi256_si128(index), _mm_set1_epi32(8));
+			__m128 value = _mm_add_ps(_mm_loadu_ps(score + i), _mm_loadu_ps(column + i));
+			__m128 greater = _mm_cmpgt_ps(value, half_value);
+			half_value = _mm_blendv_ps(half_value, value, greater);
+			half_index = _mm_blendv_epi8(half_index, next_index, _mm_castps_si128(greater));
+			i += 4;
+		}
+		_mm256_zeroupper();
+
+		float lane_best[4];
+		int lane_index[4];
+		_mm_storeu_ps(lane_best, half_value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index), half_index);
+		size_t result = max_plus_reduce_lanes(lane_best, lane_index, 4, best);
+		for (; i < count; ++i)
+		{
+			float value = score[i] + column[i];
+			if (value > best)
+			{
+				best = value;
+				result = i;
+			}
+		}
+		return result;
+	}
+#endif
+
+	/**	The max-plus matrix-vector product of a Viterbi step.
+	*	next[j] = max(score[i] + transposed[j * source_count + i]) for i in [0, source_count),
+	*	and backpointer[j] is the first i of the max.
+	* @param transposed	the transposed transition matrix, target_count rows of source_count.
+	* @param level	the SIMD level to use, it should be supported by the CPU.
+	*/
+	template <typename StateIndex>
+	inline void max_plus(const float* score, const float* transposed, size_t source_count, size_t target_count,
+		float* next, StateIndex* backpointer, enum SimdLevel level)
+	{
+		for (size_t j = 0; j < target_count; ++j)
+		{
+			const float* column = transposed + j * source_count;
+			size_t index;
+			switch (level)
+			{
+#if defined(OPENCLAS_SIMD_AVX2)
+			case SIMD_AVX2:
+				index = max_plus_row_avx2(score, column, source_count, next[j]);
+				break;
+#endif
+#if defined(OPENCLAS_SIMD_SSE2)
+			case SIMD_SSE2:
+				index = max_plus_row_sse2(score, column, source_count, next[j]);
+				break;
+#endif
+			default:
+				index = max_plus_row_scalar(score, column, source_count, next[j]);
+				break;
+			}
+			backpointer[j] = static_cast<StateIndex>(index);
+		}
+	}
+
+	///	The scalar max-plus product for the other value types.
+	template <typename ValueType, typename StateIndex>
+	inline void max_plus(const ValueType* score, const ValueType* transposed, size_t source_count, size_t target_count,
+		ValueType* next, StateIndex* backpointer, enum SimdLevel /*level*/)
+	{
+		for (size_t j = 0; j < target_count; ++j)
+			backpointer[j] = static_cast<StateIndex>(max_plus_row_scalar(score, transposed + j * source_count, source_count, next[j]));
+	}
+
+	template <typename ValueType, typename StateIndex>
+	inline void max_plus(const ValueType* score, const ValueType* transposed, size_t source_count, size_t target_count,
+		ValueType* next, StateIndex* backpointer)
+	{
+		max_plus(score, transposed, source_count, target_count, next, backpointer, get_simd_level());
+	}
+
+	/****************************************************
+	*
+	*	Max-plus kernel across lanes
+	*
+	****************************************************/
+
+	//	the lanes of a batch, such as the sequences of a batched Viterbi
+	enum { MAX_PLUS_LANES = 8 };
+
+	/**	The max-plus product for MAX_PLUS_LANES independent rows at once. The source scores are
+	*	laid out structure-of-arrays, source[i * MAX_PLUS_LANES + lane], and the column is shared.
+	*	next[lane] = max(source[i * MAX_PLUS_LANES + lane] + column[i]) for i in [0, source_count),
+	*	and backpointer[lane] is the first i of the max, source_count should be at least 1.
+	*/
+	template <typename ValueType, typename StateIndex>
+	inline void max_plus_lanes_scalar(const ValueType* source, const ValueType* column, size_t source_count,
+		ValueType* next, StateIndex* backpointer)
+	{
+		for (size_t lane = 0; lane < MAX_PLUS_LANES; ++lane)
+		{
+			next[lane] = source[lane] + column[0];
+			backpointer[lane] = StateIndex(0);
+		}
+		for (size_t i = 1; i < source_count; ++i)
+		{
+			const ValueType* row = source + i * MAX_PLUS_LANES;
+			for (size_t lane = 0; lane < MAX_PLUS_LANES; ++lane)
+			{
+				ValueType value = row[lane] + column[i];
+				if (value > next[lane])
+				{
+					next[lane] = value;
+					backpointer[lane] = static_cast<StateIndex>(i);
+				}
+			}
+		}
+	}
+
+#if defined(OPENCLAS_SIMD_SSE2)
+	//	the 8 lanes in two registers
+	template <typename StateIndex>
+	OPENCLAS_TARGET_SSE2 inline void max_plus_lanes_sse2(const float* source, const float* column, size_t source_count,
+		float* next, StateIndex* backpointer)
+	{
+		__m128 column_value = _mm_set1_ps(column[0]);
+		__m128 best_low = _mm_add_ps(_mm_loadu_ps(source), column_value);
+		__m128 best_high = _mm_add_ps(_mm_loadu_ps(source + 4), column_value);
+		__m128i index_low = _mm_setzero_si128();
+		__m128i index_high = _mm_setzero_si128();
+		for (size_t i = 1; i < source_count; ++i)
+		{
+			const float* row = source + i * MAX_PLUS_LANES;
+			column_value = _mm_set1_ps(column[i]);
+			__m128i index = _mm_set1_epi32(static_cast<int>(i));
+
+			__m128 value = _mm_add_ps(_mm_loadu_ps(row), column_value);
+			__m128 greater = _mm_cmpgt_ps(value, best_low);
+			best_low = _mm_or_ps(_mm_and_ps(greater, value), _mm_andnot_ps(greater, best_low));
+			index_low = _mm_or_si128(_mm_and_si128(_mm_castps_si128(greater), index), _mm_andnot_si128(_mm_castps_si128(greater), index_low));
+
+			value = _mm_add_ps(_mm_loadu_ps(row + 4), column_value);
+			greater = _mm_cmpgt_ps(value, best_high);
+			best_high = _mm_or_ps(_mm_and_ps(greater, value), _mm_andnot_ps(greater, best_high));
+			index_high = _mm_or_si128(_mm_and_si128(_mm_castps_si128(greater), index), _mm_andnot_si128(_mm_castps_si128(greater), index_high));
+		}
+
+		int lane_index[MAX_PLUS_LANES];
+		_mm_storeu_ps(next, best_low);
+		_mm_storeu_ps(next + 4, best_high);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index), index_low);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index + 4), index_high);
+		for (size_t lane = 0; lane < MAX_PLUS_LANES; ++lane)
+			backpointer[lane] = static_cast<StateIndex>(lane_index[lane]);
+	}
+#endif
+
+#if defined(OPENCLAS_SIMD_AVX2)
+	//	the 8 lanes in one register
+	template <typename StateIndex>
+	OPENCLAS_TARGET_AVX2 inline void max_plus_lanes_avx2(const float* source, const float* column, size_t source_count,
+		float* next, StateIndex* backpointer)
+	{
+		__m256 best = _mm256_add_ps(_mm256_loadu_ps(source), _mm256_set1_ps(column[0]));
+		__m256i best_index = _mm256_setzero_si256();
+		for (size_t i = 1; i < source_count; ++i)
+		{
+			__m256 value = _mm256_add_ps(_mm256_loadu_ps(source + i * MAX_PLUS_LANES), _mm256_set1_ps(column[i]));
+			__m256 greater = _mm256_cmp_ps(value, best, _CMP_GT_OQ);
+			best = _mm256_blendv_ps(best, value, greater);
+			best_index = _mm256_blendv_epi8(best_index, _mm256_set1_epi32(static_cast<int>(i)), _mm256_castps_si256(greater));
+		}
+
+		int lane_index[MAX_PLUS_LANES];
+		_mm256_storeu_ps(next, best);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_index), best_index);
+		_mm256_zeroupper();
+		for (size_t lane = 0; lane < MAX_PLUS_LANES; ++lane)
+			backpointer[lane] = static_cast<StateIndex>(lane_index[lane]);
+	}
+#endif
+
+	/**	The max-plus product of a batched Viterbi step, see max_plus_lanes_scalar().
+	* @param level	the SIMD level to use, it should be supported by the CPU.
+	*/
+	template <typename StateIndex>
+	inline void max_plus_lanes(const float* source, const float* column, size_t source_count,
+		float* next, StateIndex* backpointer, enum SimdLevel level)
+	{
+		switch (level)
+		{
+#if defined(OPENCLAS_SIMD_AVX2)
+		case SIMD_AVX2:
+			max_plus_lanes_avx2(source, column, source_count, next, backpointer);
+			break;
+#endif
+#if defined(OPENCLAS_SIMD_SSE2)
+		case SIMD_SSE2:
+			max_plus_lanes_sse2(source, column, source_count, next, backpointer);
+			break;
+#endif
+		default:
+			max_plus_lanes_scalar(source, column, source_count, next, backpointer);
+			break;
+		}
+	}
+
+	///	The scalar one for the other value types.
+	template <typename ValueType, typename StateIndex>
+	inline void max_plus_lanes(const ValueType* source, const ValueType* column, size_t source_count,
+		ValueType* next, StateIndex* backpointer, enum SimdLevel /*level*/)
+	{
+		max_plus_lanes_scalar(source, column, source_count, next, backpointer);
+	}
+}
+
+//	_OPENCLAS_SIMD_HPP_
+#endif
@@ -0,0 +1,242 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+#pragma once
+#ifndef _OPENCLAS_THREAD_POOL_HPP_
+#define _OPENCLAS_THREAD_POOL_HPP_
+
+#include "common.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+namespace openclas {
+
+	/**	Work-stealing thread pool for loops of independent tasks.
+	*	run(count, task) calls task(index, worker) for every index in [0, count). The indices
+	*	are split into one contiguous range for each worker at first, and a worker running out
+	*	of its range steals the back half of the range of another worker. So the neighbouring
+	*	tasks usually run on the same worker, and the uneven tasks are balanced anyway.
+	*	The calling thread is worker 0, and the other threads sleep between runs.
+	*	Only one run() at a time, the concurrent calls are serialized.
+	*/
+	class ThreadPool {
+	public:
+		///	@param worker_count	the count of workers including the calling thread, 0 for the count of CPU cores.
+		explicit ThreadPool(size_t worker_count = 0)
+			: m_generation(0), m_running(0), m_stopped(false), m_task(0), m_invoke(0)
+		{
+			if (worker_count == 0)
+				worker_count = boost::thread::hardware_concurrency();
+			if (worker_count == 0)
+				worker_count = 1;
+
+			for (size_t i = 0; i < worker_count; ++i)
+				m_ranges.push_back(new range_type());
+			for (size_t i = 1; i < worker_count; ++i)
+				m_threads.push_back(new boost::thread(thread_main(*this, i)));
+		}
+
+		~ThreadPool()
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_stopped = true;
+			}
+			m_start.notify_all();
+			for (size_t i = 0; i < m_threads.size(); ++i)
+			{
+				m_threads[i]->join();
+				delete m_threads[i];
+			}
+			for (size_t i = 0; i < m_ranges.size(); ++i)
+				delete m_ranges[i];
+		}
+
+		///	@returns the count of workers, including the calling thread.
+		size_t size() const
+		{
+			return m_ranges.size();
+		}
+
+		/**	Call task(size_t index, size_t worker) for each index in [0, count), and wait for all of them.
+		*	worker is in [0, size()), and the tasks of a worker run one by one, so the worker can be
+		*	used to pick a per-worker buffer. If any task throws, the first error is thrown
+		*	as std::runtime_error after all the tasks are done.
+		*/
+		template <class Task>
+		void run(size_t count, Task& task)
+		{
+			boost::mutex::scoped_lock run_lock(m_run_mutex);
+			if (count == 0)
+				return;
+
+			//	split the indices evenly
+			size_t workers = size();
+			for (size_t i = 0; i < workers; ++i)
+			{
+				m_ranges[i]->begin = count * i / workers;
+				m_ranges[i]->end = count * (i + 1) / workers;
+			}
+			m_error.clear();
+
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_task = &task;
+				m_invoke = &invoke<Task>;
+				m_running = workers - 1;
+				++m_generation;
+			}
+			m_start.notify_all();
+
+			work(0);
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (m_running > 0)
+				m_done.wait(lock);
+			m_task = 0;
+			m_invoke = 0;
+			if (!m_error.empty())
+				throw std::runtime_error(m_error);
+		}
+
+	private:
+		//	the threads refer to the pool, so copy is not allowed.
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+	protected:
+		///	[begin, end) are the indices left to a worker
+		struct range_type {
+			boost::mutex mutex;
+			size_t begin;
+			size_t end;
+			range_type() : begin(0), end(0) {}
+		};
+
+		struct thread_main {
+			ThreadPool& pool;
+			size_t worker;
+			thread_main(ThreadPool& pool, size_t worker)
+				: pool(pool), worker(worker)
+			{}
+			void operator() ()
+			{
+				pool.wait_and_work(worker);
+			}
+		};
+
+		template <class Task>
+		static void invoke(void* task, size_t index, size_t worker)
+		{
+			(*static_cast<Task*>(task))(index, worker);
+		}
+
+		void wait_and_work(size_t worker)
+		{
+			size_t generation = 0;
+			for (;;)
+			{
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					while (!m_stopped && m_generation == generation)
+						m_start.wait(lock);
+					if (m_stopped)
+						return;
+					generation = m_generation;
+				}
+
+				work(worker);
+
+				boost::mutex::scoped_lock lock(m_mutex);
+				if (--m_running == 0)
+					m_done.notify_one();
+			}
+		}
+
+		void work(size_t worker)
+		{
+			size_t index;
+			while (pop(worker, index) || (steal(worker) && pop(worker, index)))
+			{
+				try {
+					m_invoke(m_task, index, worker);
+				}catch(std::exception& e){
+					set_error(e.what());
+				}catch(...){
+					set_error("Unknown exception in ThreadPool task.");
+				}
+			}
+		}
+
+		///	Take the front index of the own range.
+		bool pop(size_t worker, size_t& index)
+		{
+			range_type& range = *m_ranges[worker];
+			boost::mutex::scoped_lock lock(range.mutex);
+			if (range.begin == range.end)
+				return false;
+			index = range.begin++;
+			return true;
+		}
+
+		///	Move the back half of the range of another worker to the own range.
+		///	@returns false if all the ranges are empty.
+		bool steal(size_t worker)
+		{
+			size_t workers = size();
+			for (size_t i = 1; i < workers; ++i)
+			{
+				range_type& victim = *m_ranges[(worker + i) % workers];
+				size_t begin, end;
+				{
+					boost::mutex::scoped_lock lock(victim.mutex);
+					if (victim.begin == victim.end)
+						continue;
+					end = victim.end;
+					begin = victim.begin + (victim.end - victim.begin) / 2;
+					victim.end = begin;
+				}
+				range_type& range = *m_ranges[worker];
+				boost::mutex::scoped_lock lock(range.mutex);
+				range.begin = begin;
+				range.end = end;
+				return true;
+			}
+			return false;
+		}
+
+		void set_error(const char* message)
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (m_error.empty())
+				m_error = message;
+		}
+
+	protected:
+		std::vector<range_type*> m_ranges;
+		std::vector<boost::thread*> m_threads;
+		//	m_mutex guards the fields below
+		boost::mutex m_mutex;
+		boost::condition_variable m_start;
+		boost::condition_variable m_done;
+		size_t m_generation;
+		size_t m_running;
+		bool m_stopped;
+		void* m_task;
+		void (*m_invoke)(void* task, size_t index, size_t worker);
+		std::string m_error;
+		//	serialize the runs
+		boost::mutex m_run_mutex;
+	};
+}
+
+//	_OPENCLAS_THREAD_POOL_HPP_
+#endif
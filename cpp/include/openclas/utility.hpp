@@ -14,9 +14,15 @@
 #endif
 
 #include "common.hpp"
+#include "symbol_type_table.hpp"
+#include "simd.hpp"
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
 #include <locale>
+#include <sstream>
 
 #if defined(_MSC_VER)
 //	Microsoft Visual C++ will need utf8_codecvt_facet.hpp for utf8 encoding.
@@ -174,6 +180,73 @@ namespace openclas {
 		L"END",		//	句子结束
 	};
 
+	///	The tag names in UTF-8 with their lengths, the same as WORD_TAG_NAME, so the tags
+	///	can be written to UTF-8 output without any conversion.
+	struct TagNameUtf8 {
+		const char* name;
+		size_t length;
+	};
+
+	static const TagNameUtf8 WORD_TAG_NAME_UTF8[] =
+	{
+		{"", 0},
+		{"ag", 2},
+		{"a", 1},
+		{"ad", 2},
+		{"an", 2},
+		{"b", 1},
+		{"bg", 2},
+		{"c", 1},
+		{"dg", 2},
+		{"d", 1},
+		{"e", 1},
+		{"f", 1},
+		{"g", 1},
+		{"h", 1},
+		{"i", 1},
+		{"j", 1},
+		{"k", 1},
+		{"l", 1},
+		{"m", 1},
+		{"mg", 2},
+		{"ng", 2},
+		{"n", 1},
+		{"nr", 2},
+		{"ns", 2},
+		{"nt", 2},
+		{"nx", 2},
+		{"nz", 2},
+		{"o", 1},
+		{"p", 1},
+		{"q", 1},
+		{"r", 1},
+		{"rg", 2},
+		{"s", 1},
+		{"tg", 2},
+		{"t", 1},
+		{"u", 1},
+		{"ud", 2},
+		{"ug", 2},
+		{"uj", 2},
+		{"ul", 2},
+		{"uv", 2},
+		{"uz", 2},
+		{"vg", 2},
+		{"v", 1},
+		{"vd", 2},
+		{"vn", 2},
+		{"w", 1},
+		{"x", 1},
+		{"y", 1},
+		{"yg", 2},
+		{"z", 1},
+		{"BEGIN", 5},
+		{"END", 3},
+	};
+
+	//	the length of the longest tag name, L"BEGIN"
+	const size_t WORD_TAG_NAME_UTF8_MAX_LENGTH = 5;
+
 	enum SymbolType{
 		SYMBOL_TYPE_UNKNOWN,
 		SYMBOL_TYPE_BEGIN,
@@ -263,6 +336,18 @@ namespace openclas {
 		return oss.str();
 	}
 
+	inline std::vector<std::wstring> create_special_word_strings()
+	{
+		std::vector<std::wstring> words;
+		for (int tag = 0; tag < WORD_TAG_SIZE; ++tag)
+			words.push_back(get_special_word_string(static_cast<enum WordTag>(tag)));
+		return words;
+	}
+
+	///	get_special_word_string() of all tags, so the lookup of special words
+	///	during segmentation doesn't build the string each time.
+	static const std::vector<std::wstring> SPECIAL_WORD_STRING = create_special_word_strings();
+
 	/**	Check the value whether is in the given range or not
 	*
 	*  Notice: the boundary is included in the range. That is the expression is as following:
@@ -278,9 +363,11 @@ namespace openclas {
 	/** Detect the symbol type by unicode range
 	*	the range is defined by unicode range.
 	*	see reference: http://orwell.ru/test/Unicode/
+	*	It's the definition of the symbol types, and symbol_type_table.hpp is generated from it
+	*	by script/symbol_type_table.cpp, so regenerate the table after changing the ranges.
 	* @returns the symbol type (enum SymbolType)
 	*/
-	static enum SymbolType get_symbol_type(wchar_t symbol) {
+	static enum SymbolType get_symbol_type_by_range(wchar_t symbol) {
 		//	the range might be able to merge to increase the performance a little,
 		//	however, the seperated ranges make defination of the ranges more clear.
 		if (in_range(symbol, 0x4E00, 0x9FFF)	//	CJK Unified Ideographs
@@ -357,6 +444,34 @@ namespace openclas {
 		return SYMBOL_TYPE_OTHER;
 	}
 
+	/** Detect the symbol type by the table of BMP, one load for the block and one for the symbol.
+	*	Same as get_symbol_type_by_range(), and the symbols out of BMP are SYMBOL_TYPE_OTHER.
+	* @returns the symbol type (enum SymbolType)
+	*/
+	inline enum SymbolType get_symbol_type(wchar_t symbol) {
+		unsigned long code = static_cast<unsigned long>(symbol);
+		if (code > 0xFFFF)
+			return SYMBOL_TYPE_OTHER;
+		return static_cast<enum SymbolType>(SYMBOL_TYPE_BLOCK[SYMBOL_TYPE_BLOCK_INDEX[code >> 8]][code & 0xFF]);
+	}
+
+	/** Detect the symbol types of a string.
+	*	types[i] = get_symbol_type(text[i]), for i in [0, length)
+	*	The ASCII letters or digits following a letter or digit are found by scan_ascii_run().
+	*/
+	inline void classify(const wchar_t* text, size_t length, enum SymbolType* types)
+	{
+		for (size_t i = 0; i < length; )
+		{
+			enum SymbolType type = get_symbol_type(text[i]);
+			size_t run = 1;
+			if (type == SYMBOL_TYPE_LETTER || type == SYMBOL_TYPE_NUMBER)
+				run += scan_ascii_run(text + i + 1, length - i - 1, type == SYMBOL_TYPE_LETTER);
+			std::fill(types + i, types + i + run, type);
+			i += run;
+		}
+	}
+
 	/** Check whether the given symbol exist in a given collection
 	*	The given input has to be either char or wchar_t
 	*	the given collection should be an \0 terminated string.
@@ -371,6 +486,254 @@ namespace openclas {
 		return false;
 	}
 
+	/****************************************************
+	*
+	*	UTF-8
+	*
+	****************************************************/
+
+	const wchar_t UTF8_REPLACEMENT_SYMBOL = 0xFFFD;
+	const size_t UTF8_MAX_LENGTH = 4;
+
+	///	@returns the count of bytes of the sequence by its first byte, or 1 if it's not a first byte.
+	inline size_t utf8_sequence_length(char first)
+	{
+		unsigned char byte = static_cast<unsigned char>(first);
+		if (byte < 0x80 || (byte & 0xC0) == 0x80)
+			return 1;
+		else if ((byte & 0xE0) == 0xC0)
+			return 2;
+		else if ((byte & 0xF0) == 0xE0)
+			return 3;
+		else if ((byte & 0xF8) == 0xF0)
+			return 4;
+		else
+			return 1;
+	}
+
+	/** Decode the symbol at the beginning of a UTF-8 byte range, without any locale.
+	*	An invalid or truncated sequence, an overlong form or a surrogate is decoded
+	*	as a single byte of UTF8_REPLACEMENT_SYMBOL, so every byte belongs to one symbol.
+	*	The symbols out of BMP are UTF8_REPLACEMENT_SYMBOL as well if wchar_t is 16 bits.
+	* @param length	output, the count of bytes of the symbol
+	* @returns the symbol
+	*/
+	inline wchar_t decode_utf8(const char* text, const char* end, size_t& length)
+	{
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(text);
+		unsigned long code = p[0];
+		length = 1;
+		if (code < 0x80)
+			return static_cast<wchar_t>(code);
+
+		size_t count;
+		unsigned long minimum;
+		if ((code & 0xE0) == 0xC0) {
+			count = 2;	code &= 0x1F;	minimum = 0x80;
+		}else if ((code & 0xF0) == 0xE0){
+			count = 3;	code &= 0x0F;	minimum = 0x800;
+		}else if ((code & 0xF8) == 0xF0){
+			count = 4;	code &= 0x07;	minimum = 0x10000;
+		}else{
+			return UTF8_REPLACEMENT_SYMBOL;
+		}
+		if (static_cast<size_t>(end - text) < count)
+			return UTF8_REPLACEMENT_SYMBOL;
+		for (size_t i = 1; i < count; ++i)
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				return UTF8_REPLACEMENT_SYMBOL;
+			code = (code << 6) | (p[i] & 0x3F);
+		}
+		if (code < minimum || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+			return UTF8_REPLACEMENT_SYMBOL;
+		if (sizeof(wchar_t) < 4 && code > 0xFFFF)
+			return UTF8_REPLACEMENT_SYMBOL;
+
+		length = count;
+		return static_cast<wchar_t>(code);
+	}
+
+	/**	Forward iterator decoding the symbols of a UTF-8 byte range on the fly.
+	*	It can be used wherever a wstring iterator is walked forward, such as
+	*	Dictionary::for_each_prefix(), so the text never has to be widened.
+	*/
+	class Utf8Iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef wchar_t value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const wchar_t* pointer;
+		typedef const wchar_t& reference;
+	public:
+		Utf8Iterator()
+			: m_position(0), m_end(0), m_symbol(0), m_length(0)
+		{}
+
+		///	The iterator of the symbol at position, position should be the first byte of a symbol.
+		Utf8Iterator(const char* position, const char* end)
+			: m_position(position), m_end(end), m_symbol(0), m_length(0)
+		{
+			decode();
+		}
+
+		reference operator* () const
+		{
+			return m_symbol;
+		}
+
+		Utf8Iterator& operator++ ()
+		{
+			m_position += m_length;
+			decode();
+			return *this;
+		}
+
+		Utf8Iterator operator++ (int)
+		{
+			Utf8Iterator previous = *this;
+			++(*this);
+			return previous;
+		}
+
+		bool operator== (const Utf8Iterator& other) const
+		{
+			return m_position == other.m_position;
+		}
+
+		bool operator!= (const Utf8Iterator& other) const
+		{
+			return m_position != other.m_position;
+		}
+
+		///	@returns the first byte of current symbol.
+		const char* base() const
+		{
+			return m_position;
+		}
+
+		const char* end() const
+		{
+			return m_end;
+		}
+
+	protected:
+		void decode()
+		{
+			if (m_position < m_end)
+			{
+				m_symbol = decode_utf8(m_position, m_end, m_length);
+			}else{
+				m_symbol = 0;
+				m_length = 0;
+			}
+		}
+
+	protected:
+		const char* m_position;
+		const char* m_end;
+		wchar_t m_symbol;
+		size_t m_length;
+	};
+
+	/**	Skip the ASCII letters or digits following iter, see scan_ascii_run().
+	*	last is set to the last skipped symbol, if there is any.
+	* @returns the count of skipped symbols.
+	*/
+	inline size_t skip_ascii_run(const wchar_t*& iter, const wchar_t* end, bool letter, wchar_t& last)
+	{
+		size_t run = scan_ascii_run(iter, end - iter, letter);
+		iter += run;
+		if (run > 0)
+			last = iter[-1];
+		return run;
+	}
+
+	///	ASCII symbols are single bytes in UTF-8, so the bytes are scanned directly.
+	inline size_t skip_ascii_run(Utf8Iterator& iter, const Utf8Iterator& end, bool letter, wchar_t& last)
+	{
+		const char* position = iter.base();
+		size_t run = scan_ascii_run(position, end.base() - position, letter);
+		if (run > 0)
+		{
+			iter = Utf8Iterator(position + run, iter.end());
+			last = static_cast<wchar_t>(position[run - 1]);
+		}
+		return run;
+	}
+
+	///	Append the UTF-8 bytes of a symbol, a surrogate pair of 16 bits wchar_t should be combined first.
+	inline size_t write_utf8(unsigned long code, char* out)
+	{
+		if (code < 0x80) {
+			out[0] = static_cast<char>(code);
+			return 1;
+		}else if (code < 0x800){
+			out[0] = static_cast<char>(0xC0 | (code >> 6));
+			out[1] = static_cast<char>(0x80 | (code & 0x3F));
+			return 2;
+		}else if (code < 0x10000){
+			out[0] = static_cast<char>(0xE0 | (code >> 12));
+			out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			out[2] = static_cast<char>(0x80 | (code & 0x3F));
+			return 3;
+		}else{
+			out[0] = static_cast<char>(0xF0 | (code >> 18));
+			out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+			out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			out[3] = static_cast<char>(0x80 | (code & 0x3F));
+			return 4;
+		}
+	}
+
+	inline void append_utf8(unsigned long code, std::string& out)
+	{
+		char bytes[UTF8_MAX_LENGTH];
+		out.append(bytes, write_utf8(code, bytes));
+	}
+
+	/** Encode the symbols [text, text + length) to UTF-8 without any locale.
+	*	The surrogate pairs of 16 bits wchar_t are combined.
+	* @param out	the buffer of at least length * UTF8_MAX_LENGTH bytes.
+	* @returns the count of bytes written.
+	*/
+	inline size_t encode_utf8(const wchar_t* text, size_t length, char* out)
+	{
+		char* begin = out;
+		for (size_t i = 0; i < length; ++i)
+		{
+			unsigned long code = static_cast<unsigned long>(text[i]);
+			if (code < 0x80)
+			{
+				*out++ = static_cast<char>(code);
+				continue;
+			}
+			if (code >= 0xD800 && code <= 0xDBFF && i + 1 < length)
+			{
+				unsigned long low = static_cast<unsigned long>(text[i + 1]);
+				if (low >= 0xDC00 && low <= 0xDFFF)
+				{
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					++i;
+				}
+			}
+			out += write_utf8(code, out);
+		}
+		return out - begin;
+	}
+
+	/** Encode a wide string to UTF-8 without any locale.
+	*	The surrogate pairs of 16 bits wchar_t are combined.
+	* @returns the UTF-8 string.
+	*/
+	inline std::string encode_utf8(const std::wstring& text)
+	{
+		std::string out(text.size() * UTF8_MAX_LENGTH, '\0');
+		if (!text.empty())
+			out.resize(encode_utf8(text.data(), text.size(), &out[0]));
+		return out;
+	}
+
 	const std::locale make_locale(enum Charset charset)
 	{
 #if defined(_MSC_VER)
@@ -13,8 +13,13 @@
 #ifndef _OPENCLAS_VITERBI_HPP_
 #define _OPENCLAS_VITERBI_HPP_
 
+#include "simd.hpp"
 #include <vector>
 #include <iostream>
+#include <algorithm>	//	for std::fill(), std::swap()
+#include <limits>
+#include <stdexcept>	//	for std::out_of_range, std::length_error, std::logic_error
+#include <cmath>	//	for log(), exp()
 
 namespace openclas {
 
@@ -50,6 +55,546 @@ namespace openclas {
 		}
 	};
 
+	///	@returns log(exp(a) + exp(b)) without underflow.
+	template <typename ValueType>
+	inline ValueType log_add(ValueType a, ValueType b)
+	{
+		if (a < b)
+			std::swap(a, b);
+		if (b == -std::numeric_limits<ValueType>::infinity())
+			return a;
+		return a + std::log(1 + std::exp(b - a));
+	}
+
+	/**	Viterbi decoder in log space.
+	*	The inputs are the logarithm of the probabilities, in the same layout as forward_viterbi(),
+	*	so the scores are added instead of multiplied, and long sequences never underflow.
+	*	It keeps two rows of scores and a (number of observations) x (number of states) matrix
+	*	of backpointers, and reconstructs the path once at the end. The buffers are reused by
+	*	the following calls, so keep a decoder for many sequences.
+	*	Each step is a max-plus product with the transposed transition matrix, see max_plus(),
+	*	which is vectorized for float.
+	*	StateIndex is the type of the backpointers, unsigned short for at most 65536 states.
+	*/
+	template <typename ValueType, typename StateIndex = unsigned short>
+	class ViterbiDecoder {
+	public:
+		typedef ValueType value_type;
+		typedef StateIndex state_index_type;
+	public:
+		/**	Decode the most likely state sequence of the observations.
+		*	@param path	the states, one more than the observations, the first one is the start state.
+		*	@returns the log probability of the path, or -infinity if there is no path, then the path is empty.
+		*/
+		template <typename ContainerStart, typename ContainerTrans, typename ContainerEmit>
+		ValueType decode(size_t number_of_states,
+			size_t number_of_observations,
+			const std::vector<size_t>& obs_s,
+			const ContainerStart& log_start_p,
+			const ContainerTrans& log_trans_p,
+			const ContainerEmit& log_emit_p,
+			std::vector<size_t>& path
+			)
+		{
+			path.clear();
+			if (number_of_states == 0)
+				return -std::numeric_limits<ValueType>::infinity();
+			if (number_of_states - 1 > static_cast<size_t>(std::numeric_limits<StateIndex>::max()))
+				throw std::length_error("too many states for the backpointer type");
+
+			size_t steps = obs_s.size();
+			m_score.resize(number_of_states);
+			m_next_score.resize(number_of_states);
+			m_backpointer.resize(steps * number_of_states);
+
+			//	the transitions into state j are the row j of the transposed matrix
+			m_transposed.resize(number_of_states * number_of_states);
+			for (size_t source_state = 0; source_state < number_of_states; ++source_state)
+				for (size_t next_state = 0; next_state < number_of_states; ++next_state)
+					m_transposed[next_state * number_of_states + source_state] = log_trans_p[source_state * number_of_states + next_state];
+
+			for (size_t state = 0; state < number_of_states; ++state)
+				m_score[state] = log_start_p[state];
+
+			for (size_t step = 0; step < steps; ++step)
+			{
+				size_t output = obs_s[step];
+				if (output >= number_of_observations)
+					throw std::out_of_range("out of range of matrix");
+
+				//	the source state emits the output, then moves to the next state.
+				for (size_t source_state = 0; source_state < number_of_states; ++source_state)
+					m_score[source_state] += log_emit_p[source_state * number_of_observations + output];
+				max_plus(&m_score[0], &m_transposed[0], number_of_states, number_of_states,
+					&m_next_score[0], &m_backpointer[step * number_of_states]);
+				m_score.swap(m_next_score);
+			}
+
+			//	the best final state
+			size_t best_state = 0;
+			for (size_t state = 1; state < number_of_states; ++state)
+			{
+				if (m_score[state] > m_score[best_state])
+					best_state = state;
+			}
+			ValueType best = m_score[best_state];
+			if (best == -std::numeric_limits<ValueType>::infinity())
+				return best;
+
+			//	follow the backpointers
+			path.resize(steps + 1);
+			path[steps] = best_state;
+			for (size_t step = steps; step > 0; --step)
+				path[step - 1] = m_backpointer[(step - 1) * number_of_states + path[step]];
+			return best;
+		}
+
+	protected:
+		std::vector<ValueType> m_score;
+		std::vector<ValueType> m_next_score;
+		std::vector<ValueType> m_transposed;
+		std::vector<StateIndex> m_backpointer;
+	};
+
+	///	The dense transitions of a sparse Viterbi, log_trans_p[previous_state * number_of_states + state].
+	template <typename ValueType>
+	struct dense_transit {
+		const ValueType* log_trans_p;
+		size_t number_of_states;
+		dense_transit(const ValueType* log_trans_p, size_t number_of_states)
+			: log_trans_p(log_trans_p), number_of_states(number_of_states)
+		{}
+		dense_transit(const std::vector<ValueType>& log_trans_p, size_t number_of_states)
+			: log_trans_p(log_trans_p.empty() ? 0 : &log_trans_p[0]), number_of_states(number_of_states)
+		{}
+		ValueType operator()(size_t previous_state, size_t state) const
+		{
+			return log_trans_p[previous_state * number_of_states + state];
+		}
+	};
+
+	/**	Viterbi decoder in log space over a ragged lattice of candidates.
+	*	Each position has its own candidate states with their log probabilities, such as the
+	*	possible tags of a word, and only the transitions between the candidates of adjacent
+	*	positions are visited, so the cost is the sum of |candidates of i| x |candidates of i + 1|
+	*	instead of (number of states)^2 per position.
+	*	Build the lattice by add_position() and add_candidate(), then decode() it with the
+	*	transitions, such as dense_transit. The lattice is not changed by decode(), so it can be
+	*	decoded again with other transitions. The buffers are reused after clear().
+	*	StateIndex is the type of the backpointers, which are the indices of the candidates of
+	*	the previous position, so it limits the candidates of a position, not the states.
+	*/
+	template <typename ValueType, typename StateIndex = unsigned short>
+	class SparseViterbiDecoder {
+	public:
+		typedef ValueType value_type;
+		typedef StateIndex state_index_type;
+	public:
+		void clear()
+		{
+			m_state.clear();
+			m_log_p.clear();
+			m_begin.assign(1, 0);
+		}
+
+		size_t position_count() const
+		{
+			return m_begin.empty() ? 0 : m_begin.size() - 1;
+		}
+
+		///	Start the next position, the candidates are added to it.
+		void add_position()
+		{
+			if (m_begin.empty())
+				m_begin.push_back(0);
+			m_begin.push_back(m_state.size());
+		}
+
+		///	Add a candidate state with its log probability to the last position.
+		///	It throws std::logic_error if no position has been added since clear().
+		void add_candidate(size_t state, ValueType log_p)
+		{
+			if (m_begin.size() < 2)
+				throw std::logic_error("add_position() should be called before add_candidate()");
+			if (m_state.size() - m_begin[m_begin.size() - 2] > static_cast<size_t>(std::numeric_limits<StateIndex>::max()))
+				throw std::length_error("too many candidates of a position for the backpointer type");
+			m_state.push_back(state);
+			m_log_p.push_back(log_p);
+			m_begin.back() = m_state.size();
+		}
+
+		/**	Decode the most likely candidate of each position.
+		*	The first of the best previous candidates wins a tie.
+		* @param log_trans	log_trans(previous_state, state) is the log probability of the transition.
+		* @param path	the states of the candidates, one for each position.
+		* @returns the log probability of the path, or -infinity if there is no path, then the
+		*	path is empty. A position without candidate has no path either.
+		*/
+		template <class Transit>
+		ValueType decode(const Transit& log_trans, std::vector<size_t>& path)
+		{
+			path.clear();
+			size_t count = position_count();
+			if (count == 0)
+				return -std::numeric_limits<ValueType>::infinity();
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (m_begin[i] == m_begin[i + 1])
+					return -std::numeric_limits<ValueType>::infinity();
+			}
+
+			//	the scores are accumulated apart from the log probabilities of the candidates
+			m_score.assign(m_log_p.begin(), m_log_p.end());
+			m_backpointer.resize(m_state.size());
+			for (size_t i = 1; i < count; ++i)
+			{
+				size_t previous_begin = m_begin[i - 1];
+				for (size_t c = m_begin[i]; c < m_begin[i + 1]; ++c)
+				{
+					ValueType best = -std::numeric_limits<ValueType>::infinity();
+					size_t best_previous = 0;
+					for (size_t p = previous_begin; p < m_begin[i]; ++p)
+					{
+						ValueType score = m_score[p] + log_trans(m_state[p], m_state[c]);
+						if (score > best)
+						{
+							best = score;
+							best_previous = p - previous_begin;
+						}
+					}
+					m_score[c] += best;
+					m_backpointer[c] = static_cast<StateIndex>(best_previous);
+				}
+			}
+
+			//	the best last candidate, then follow the backpointers
+			size_t c = m_begin[count - 1];
+			for (size_t last = c + 1; last < m_begin[count]; ++last)
+			{
+				if (m_score[last] > m_score[c])
+					c = last;
+			}
+			ValueType best = m_score[c];
+			if (best == -std::numeric_limits<ValueType>::infinity())
+				return best;
+
+			path.resize(count);
+			for (size_t i = count; i > 0; --i)
+			{
+				path[i - 1] = m_state[c];
+				if (i > 1)
+					c = m_begin[i - 2] + m_backpointer[c];
+			}
+			return best;
+		}
+
+	protected:
+		//	the candidates of position i are [m_begin[i], m_begin[i + 1])
+		std::vector<size_t> m_state;
+		std::vector<ValueType> m_log_p;
+		//	the scores of the best paths to the candidates, by decode()
+		std::vector<ValueType> m_score;
+		std::vector<StateIndex> m_backpointer;
+		std::vector<size_t> m_begin;
+	};
+
+	///	The paths of a batch of sequences, see BatchViterbiDecoder.
+	template <typename ValueType>
+	struct ViterbiBatch {
+		std::vector<size_t> states;
+		//	the path of sequence i is states[offsets[i], offsets[i + 1]), empty if there is no path
+		std::vector<size_t> offsets;
+		//	the log probability of the path of each sequence, or -infinity
+		std::vector<ValueType> scores;
+
+		ViterbiBatch() : offsets(1, 0) {}
+
+		///	@returns the count of sequences.
+		size_t size() const
+		{
+			return scores.size();
+		}
+
+		void clear()
+		{
+			states.clear();
+			offsets.assign(1, 0);
+			scores.clear();
+		}
+
+		const size_t* begin(size_t sequence) const
+		{
+			return states.empty() ? 0 : &states[0] + offsets[sequence];
+		}
+
+		const size_t* end(size_t sequence) const
+		{
+			return states.empty() ? 0 : &states[0] + offsets[sequence + 1];
+		}
+	};
+
+	/**	Viterbi decoder of many sequences sharing one model.
+	*	The sequences are decoded MAX_PLUS_LANES at a time, longest first, and the scores of a group
+	*	are laid out structure-of-arrays, score[state * MAX_PLUS_LANES + lane], so each lane of a step
+	*	is a different sequence, see max_plus_lanes(). The shorter sequences of a group keep their
+	*	final scores when they end. The paths are the same as ViterbiDecoder, sequence by sequence.
+	*/
+	template <typename ValueType, typename StateIndex = unsigned short>
+	class BatchViterbiDecoder {
+	public:
+		typedef ValueType value_type;
+		typedef StateIndex state_index_type;
+	public:
+		/**	Decode the most likely state sequences of count observation sequences.
+		*	@param result	the paths and their log probabilities, in the order of the sequences.
+		*/
+		template <typename ContainerStart, typename ContainerTrans, typename ContainerEmit>
+		void decode(size_t number_of_states,
+			size_t number_of_observations,
+			const std::vector<size_t>* obs_s,
+			size_t count,
+			const ContainerStart& log_start_p,
+			const ContainerTrans& log_trans_p,
+			const ContainerEmit& log_emit_p,
+			ViterbiBatch<ValueType>& result
+			)
+		{
+			result.clear();
+			result.scores.resize(count, -std::numeric_limits<ValueType>::infinity());
+			if (number_of_states == 0 || count == 0)
+			{
+				result.offsets.resize(count + 1, 0);
+				return;
+			}
+			if (number_of_states - 1 > static_cast<size_t>(std::numeric_limits<StateIndex>::max()))
+				throw std::length_error("too many states for the backpointer type");
+			for (size_t sequence = 0; sequence < count; ++sequence)
+			{
+				for (size_t step = 0; step < obs_s[sequence].size(); ++step)
+				{
+					if (obs_s[sequence][step] >= number_of_observations)
+						throw std::out_of_range("out of range of matrix");
+				}
+			}
+
+			m_transposed.resize(number_of_states * number_of_states);
+			for (size_t source_state = 0; source_state < number_of_states; ++source_state)
+				for (size_t next_state = 0; next_state < number_of_states; ++next_state)
+					m_transposed[next_state * number_of_states + source_state] = log_trans_p[source_state * number_of_states + next_state];
+
+			//	every path is one longer than its sequence, they are dropped if there is none
+			for (size_t sequence = 0; sequence < count; ++sequence)
+				result.offsets.push_back(result.offsets.back() + obs_s[sequence].size() + 1);
+			result.states.resize(result.offsets.back());
+
+			//	the groups of similar lengths waste less steps
+			m_order.resize(count);
+			for (size_t sequence = 0; sequence < count; ++sequence)
+				m_order[sequence] = sequence;
+			std::stable_sort(m_order.begin(), m_order.end(), longer(obs_s));
+
+			bool missing = false;
+			for (size_t first = 0; first < count; first += MAX_PLUS_LANES)
+			{
+				size_t lanes = std::min(static_cast<size_t>(MAX_PLUS_LANES), count - first);
+				if (!decode_group(number_of_states, number_of_observations, obs_s, &m_order[first], lanes,
+					log_start_p, log_emit_p, result))
+					missing = true;
+			}
+
+			if (missing)
+			{
+				//	compact the paths of the sequences without any
+				size_t position = 0;
+				for (size_t sequence = 0; sequence < count; ++sequence)
+				{
+					size_t begin = result.offsets[sequence];
+					size_t end = result.offsets[sequence + 1];
+					result.offsets[sequence] = position;
+					if (result.scores[sequence] == -std::numeric_limits<ValueType>::infinity())
+						continue;
+					for (size_t index = begin; index < end; ++index)
+						result.states[position++] = result.states[index];
+				}
+				result.offsets[count] = position;
+				result.states.resize(position);
+			}
+		}
+
+		template <typename ContainerStart, typename ContainerTrans, typename ContainerEmit>
+		void decode(size_t number_of_states,
+			size_t number_of_observations,
+			const std::vector<std::vector<size_t> >& obs_s,
+			const ContainerStart& log_start_p,
+			const ContainerTrans& log_trans_p,
+			const ContainerEmit& log_emit_p,
+			ViterbiBatch<ValueType>& result
+			)
+		{
+			decode(number_of_states, number_of_observations, obs_s.empty() ? 0 : &obs_s[0], obs_s.size(),
+				log_start_p, log_trans_p, log_emit_p, result);
+		}
+
+	protected:
+		struct longer {
+			const std::vector<size_t>* obs_s;
+
+			longer(const std::vector<size_t>* sequences) : obs_s(sequences) {}
+
+			bool operator()(size_t left, size_t right) const
+			{
+				return obs_s[left].size() > obs_s[right].size();
+			}
+		};
+
+		/**	Decode the sequences of a group, one per lane, the first one is the longest.
+		*	@returns false if any of them has no path.
+		*/
+		template <typename ContainerStart, typename ContainerEmit>
+		bool decode_group(size_t number_of_states,
+			size_t number_of_observations,
+			const std::vector<size_t>* obs_s,
+			const size_t* sequences,
+			size_t lanes,
+			const ContainerStart& log_start_p,
+			const ContainerEmit& log_emit_p,
+			ViterbiBatch<ValueType>& result
+			)
+		{
+			size_t steps = obs_s[sequences[0]].size();
+			size_t row_size = number_of_states * MAX_PLUS_LANES;
+			m_score.resize(row_size);
+			m_next_score.resize(row_size);
+			m_final_score.resize(row_size);
+			m_backpointer.resize(steps * row_size);
+
+			for (size_t state = 0; state < number_of_states; ++state)
+				for (size_t lane = 0; lane < MAX_PLUS_LANES; ++lane)
+					m_score[state * MAX_PLUS_LANES + lane] = log_start_p[state];
+			keep_final_scores(sequences, lanes, obs_s, 0, number_of_states);
+
+			enum SimdLevel level = get_simd_level();
+			for (size_t step = 0; step < steps; ++step)
+			{
+				//	the source states emit the outputs, the ended lanes and the unused ones emit nothing
+				for (size_t lane = 0; lane < lanes; ++lane)
+				{
+					const std::vector<size_t>& sequence = obs_s[sequences[lane]];
+					if (step >= sequence.size())
+						break;
+					size_t output = sequence[step];
+					for (size_t source_state = 0; source_state < number_of_states; ++source_state)
+						m_score[source_state * MAX_PLUS_LANES + lane] += log_emit_p[source_state * number_of_observations + output];
+				}
+				for (size_t next_state = 0; next_state < number_of_states; ++next_state)
+				{
+					max_plus_lanes(&m_score[0], &m_transposed[next_state * number_of_states], number_of_states,
+						&m_next_score[next_state * MAX_PLUS_LANES], &m_backpointer[step * row_size + next_state * MAX_PLUS_LANES], level);
+				}
+				m_score.swap(m_next_score);
+				keep_final_scores(sequences, lanes, obs_s, step + 1, number_of_states);
+			}
+
+			bool found = true;
+			for (size_t lane = 0; lane < lanes; ++lane)
+			{
+				size_t sequence = sequences[lane];
+				size_t best_state = 0;
+				for (size_t state = 1; state < number_of_states; ++state)
+				{
+					if (m_final_score[state * MAX_PLUS_LANES + lane] > m_final_score[best_state * MAX_PLUS_LANES + lane])
+						best_state = state;
+				}
+				ValueType best = m_final_score[best_state * MAX_PLUS_LANES + lane];
+				result.scores[sequence] = best;
+				if (best == -std::numeric_limits<ValueType>::infinity())
+				{
+					found = false;
+					continue;
+				}
+
+				//	follow the backpointers of the lane
+				size_t* path = &result.states[result.offsets[sequence]];
+				size_t length = obs_s[sequence].size();
+				path[length] = best_state;
+				for (size_t step = length; step > 0; --step)
+					path[step - 1] = m_backpointer[(step - 1) * row_size + path[step] * MAX_PLUS_LANES + lane];
+			}
+			return found;
+		}
+
+		//	keep the scores of the lanes ending after the steps
+		void keep_final_scores(const size_t* sequences, size_t lanes, const std::vector<size_t>* obs_s,
+			size_t steps, size_t number_of_states)
+		{
+			for (size_t lane = 0; lane < lanes; ++lane)
+			{
+				if (obs_s[sequences[lane]].size() != steps)
+					continue;
+				for (size_t state = 0; state < number_of_states; ++state)
+					m_final_score[state * MAX_PLUS_LANES + lane] = m_score[state * MAX_PLUS_LANES + lane];
+			}
+		}
+
+	protected:
+		std::vector<size_t> m_order;
+		std::vector<ValueType> m_score;
+		std::vector<ValueType> m_next_score;
+		std::vector<ValueType> m_final_score;
+		std::vector<ValueType> m_transposed;
+		std::vector<StateIndex> m_backpointer;
+	};
+
+	///	@returns the log of the total probability of the observations, the log-space forward algorithm.
+	///	The decoders don't compute it, so the callers who need it pay for this extra pass.
+	template <typename ValueType, typename ContainerStart, typename ContainerTrans, typename ContainerEmit>
+	ValueType log_forward_probability(size_t number_of_states,
+		size_t number_of_observations,
+		const std::vector<size_t>& obs_s,
+		const ContainerStart& log_start_p,
+		const ContainerTrans& log_trans_p,
+		const ContainerEmit& log_emit_p
+		)
+	{
+		std::vector<ValueType> alpha(number_of_states), next_alpha(number_of_states);
+		for (size_t state = 0; state < number_of_states; ++state)
+			alpha[state] = log_start_p[state];
+
+		for (std::vector<size_t>::const_iterator output = obs_s.begin(); output != obs_s.end(); ++output)
+		{
+			if (*output >= number_of_observations)
+				throw std::out_of_range("out of range of matrix");
+			std::fill(next_alpha.begin(), next_alpha.end(), -std::numeric_limits<ValueType>::infinity());
+			for (size_t source_state = 0; source_state < number_of_states; ++source_state)
+			{
+				ValueType source = alpha[source_state] + log_emit_p[source_state * number_of_observations + *output];
+				for (size_t next_state = 0; next_state < number_of_states; ++next_state)
+					next_alpha[next_state] = log_add(next_alpha[next_state], source + log_trans_p[source_state * number_of_states + next_state]);
+			}
+			alpha.swap(next_alpha);
+		}
+
+		ValueType total = -std::numeric_limits<ValueType>::infinity();
+		for (size_t state = 0; state < number_of_states; ++state)
+			total = log_add(total, alpha[state]);
+		return total;
+	}
+
+	template <typename ValueType, typename Container>
+	std::vector<ValueType> log_of(const Container& probability, size_t count)
+	{
+		std::vector<ValueType> result(count);
+		for (size_t i = 0; i < count; ++i)
+			result[i] = std::log(static_cast<ValueType>(probability[i]));
+		return result;
+	}
+
+	/**	The Viterbi algorithm on the probabilities, which adds the total probability of the
+	*	observations to result.prob, and keeps the most likely path in result if it's more likely.
+	*	The sum and the max are taken in the same pass over two rows of each, and the path is
+	*	reconstructed once from a backpointer matrix. It multiplies the probabilities as it did,
+	*	so a long sequence underflows, decode it with ViterbiDecoder in log space instead.
+	*/
 	template <typename ValueType, typename ContainerStart, typename ContainerTrans, typename ContainerEmit>
 	void forward_viterbi(size_t number_of_states,
 		size_t number_of_observations,
@@ -60,51 +605,61 @@ namespace openclas {
 		viterbi_info<ValueType>& result
 		)
 	{
-		matrix_wrapper<ValueType, ContainerTrans> trans_p(number_of_states, number_of_states, trans_probability);
-		matrix_wrapper<ValueType, ContainerEmit> emit_p(number_of_states, number_of_observations, emit_probability);
-
-		typedef viterbi_info<ValueType> viterbi_info_type;
-		std::vector<viterbi_info_type> T(number_of_states);
+		size_t steps = obs_s.size();
+		std::vector<ValueType> prob(number_of_states), next_prob(number_of_states);
+		std::vector<ValueType> v_prob(number_of_states), next_v_prob(number_of_states);
+		std::vector<size_t> backpointer(steps * number_of_states);
 		for (size_t state = 0; state < number_of_states; ++state)
-		{
-			//           prob.           V. prob.        V. path  
-			T[state].set(start_p[state], start_p[state], state);
-		}
+			prob[state] = v_prob[state] = start_p[state];
 
-		for (std::vector<size_t>::const_iterator output = obs_s.begin(); output != obs_s.end(); ++output)
+		for (size_t step = 0; step < steps; ++step)
 		{
-			std::vector<viterbi_info_type> U(number_of_states);
-			for (size_t next_state = 0; next_state < number_of_states; ++next_state)
+			size_t output = obs_s[step];
+			if (output >= number_of_observations)
+				throw std::out_of_range("out of range of matrix");
+
+			std::fill(next_prob.begin(), next_prob.end(), ValueType(0));
+			std::fill(next_v_prob.begin(), next_v_prob.end(), ValueType(0));
+			size_t* back = &backpointer[step * number_of_states];
+			for (size_t source_state = 0; source_state < number_of_states; ++source_state)
 			{
-				viterbi_info_type& next = U[next_state];
-				for(size_t source_state = 0; source_state < number_of_states; ++source_state)
+				ValueType emit = emit_probability[source_state * number_of_observations + output];
+				ValueType source_prob = prob[source_state] * emit;
+				ValueType source_v_prob = v_prob[source_state] * emit;
+				for (size_t next_state = 0; next_state < number_of_states; ++next_state)
 				{
-					viterbi_info_type source = T[source_state];
-					double p = emit_p(source_state, *output) * trans_p(source_state, next_state);
-					source.prob *= p;
-					source.v_prob *= p;
-					next.prob += source.prob;
-					if (source.v_prob > next.v_prob)
+					ValueType trans = trans_probability[source_state * number_of_states + next_state];
+					next_prob[next_state] += source_prob * trans;
+					if (source_v_prob * trans > next_v_prob[next_state])
 					{
-						next.v_path.assign(source.v_path.begin(), source.v_path.end());
-						next.v_path.push_back(next_state);
-						next.v_prob = source.v_prob;
+						next_v_prob[next_state] = source_v_prob * trans;
+						back[next_state] = source_state;
 					}
 				}
 			}
-			T = U;
+			prob.swap(next_prob);
+			v_prob.swap(next_v_prob);
 		}
+
 		// apply sum/max to the final states:
+		size_t best_state = number_of_states;
 		for (size_t state = 0; state < number_of_states; ++state)
 		{
-			viterbi_info_type& t = T[state];
-			result.prob += t.prob;	/*total*/
-			if (t.v_prob > result.v_prob)	 /*valmax*/
+			result.prob += prob[state];	/*total*/
+			if (v_prob[state] > result.v_prob)	 /*valmax*/
 			{
-				result.v_path = t.v_path;
-				result.v_prob = t.v_prob;
+				result.v_prob = v_prob[state];
+				best_state = state;
 			}
 		}
+		if (best_state == number_of_states)
+			return;
+
+		//	follow the backpointers
+		result.v_path.resize(steps + 1);
+		result.v_path[steps] = best_state;
+		for (size_t step = steps; step > 0; --step)
+			result.v_path[step - 1] = backpointer[(step - 1) * number_of_states + result.v_path[step]];
 	}
 
 	template <typename ValueType>
@@ -0,0 +1,85 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+
+//	Generate include/openclas/symbol_type_table.hpp from get_symbol_type_by_range().
+//	Usage: symbol_type_table > ../include/openclas/symbol_type_table.hpp
+
+#include <openclas/utility.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace openclas;
+
+int main()
+{
+	const size_t BLOCK_SIZE = 256;
+	const size_t BLOCK_COUNT = 0x10000 / BLOCK_SIZE;
+
+	//	the same blocks are stored once
+	std::vector<std::vector<int> > blocks;
+	std::vector<size_t> index(BLOCK_COUNT);
+	for (size_t b = 0; b < BLOCK_COUNT; ++b)
+	{
+		std::vector<int> block(BLOCK_SIZE);
+		for (size_t i = 0; i < BLOCK_SIZE; ++i)
+			block[i] = get_symbol_type_by_range(static_cast<wchar_t>(b * BLOCK_SIZE + i));
+
+		size_t k = 0;
+		while (k < blocks.size() && blocks[k] != block)
+			++k;
+		if (k == blocks.size())
+			blocks.push_back(block);
+		index[b] = k;
+	}
+
+	std::cout << "\xEF\xBB\xBF/*\r\n"
+		" * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>\r\n"
+		" * See the file \"LICENSE.txt\" for usage and redistribution license requirements\r\n"
+		" *\r\n"
+		" *\t$Id$\r\n"
+		" */\r\n"
+		"\r\n"
+		"//\tGenerated by script/symbol_type_table.cpp from get_symbol_type_by_range(), do not edit.\r\n"
+		"\r\n"
+		"#pragma once\r\n"
+		"#ifndef _OPENCLAS_SYMBOL_TYPE_TABLE_HPP_\r\n"
+		"#define _OPENCLAS_SYMBOL_TYPE_TABLE_HPP_\r\n"
+		"\r\n"
+		"namespace openclas {\r\n"
+		"\r\n"
+		"\t///\tThe block of symbol [c] is SYMBOL_TYPE_BLOCK_INDEX[c >> 8]\r\n"
+		"\tstatic const unsigned char SYMBOL_TYPE_BLOCK_INDEX[" << BLOCK_COUNT << "] = {\r\n";
+	for (size_t b = 0; b < BLOCK_COUNT; ++b)
+	{
+		if (b % 32 == 0)
+			std::cout << "\t\t";
+		std::cout << index[b] << ",";
+		std::cout << ((b % 32 == 31) ? "\r\n" : " ");
+	}
+	std::cout << "\t};\r\n"
+		"\r\n"
+		"\t///\tThe symbol type (enum SymbolType) of symbol [c] is SYMBOL_TYPE_BLOCK[block][c & 0xFF]\r\n"
+		"\tstatic const unsigned char SYMBOL_TYPE_BLOCK[" << blocks.size() << "][" << BLOCK_SIZE << "] = {\r\n";
+	for (size_t k = 0; k < blocks.size(); ++k)
+	{
+		std::cout << "\t\t{\r\n";
+		for (size_t i = 0; i < BLOCK_SIZE; ++i)
+		{
+			if (i % 32 == 0)
+				std::cout << "\t\t\t";
+			std::cout << blocks[k][i] << ",";
+			std::cout << ((i % 32 == 31) ? "\r\n" : " ");
+		}
+		std::cout << "\t\t},\r\n";
+	}
+	std::cout << "\t};\r\n"
+		"}\r\n"
+		"\r\n"
+		"//\t_OPENCLAS_SYMBOL_TYPE_TABLE_HPP_\r\n"
+		"#endif\r\n";
+	return 0;
+}
@@ -9,6 +9,9 @@
 #define BOOST_TEST_MAIN
 
 #include <boost/test/included/unit_test.hpp>
+#include <openclas/serialization.hpp>
+#include <vector>
+#include <cstdlib>	//	for srand(), rand()
 
 using namespace boost::unit_test;
 
@@ -34,10 +37,65 @@ const int sample_count = 14;
 
 static const char* mini_dict_base_name = "data/mini";
 
+///	The fixture of the tests on the mini dictionary, which is loaded with the bigrams.
+struct mini_dictionary_fixture {
+	openclas::Dictionary dict;
+	mini_dictionary_fixture()
+	{
+		openclas::load_from_txt_file(dict, mini_dict_base_name, true);
+	}
+};
+
+///	@returns all the samples in order, each one followed by the separator.
+inline std::wstring join_samples(const std::wstring& separator = std::wstring())
+{
+	std::wstring text;
+	for (int i = 0; i < sample_count; ++i)
+		text += sample[i] + separator;
+	return text;
+}
+
+///	@returns the unit repeated until the size reaches given size.
+template <class String>
+String repeat_to_size(const String& unit, size_t size)
+{
+	String text;
+	while (text.size() < size)
+		text += unit;
+	return text;
+}
+
+///	The seed of rand() for the randomized tests, so they see the same numbers on every run.
+const unsigned int random_seed = 20100101;
+
+///	The random log probabilities of a hidden Markov model, each in [-9.99, 0], drawn by rand().
+template <typename ValueType>
+struct random_log_model {
+	std::vector<ValueType> start_p;
+	//	trans_p[source * states + next]
+	std::vector<ValueType> trans_p;
+	//	emit_p[state * outputs + output]
+	std::vector<ValueType> emit_p;
+	random_log_model(size_t states, size_t outputs)
+		: start_p(states), trans_p(states * states), emit_p(states * outputs)
+	{
+		fill(start_p);
+		fill(trans_p);
+		fill(emit_p);
+	}
+	static void fill(std::vector<ValueType>& log_p)
+	{
+		for (size_t i = 0; i < log_p.size(); ++i)
+			log_p[i] = -static_cast<ValueType>(rand() % 1000) / 100;
+	}
+};
+
 #include "unit_test_dictionary.hpp"
 #include "unit_test_k_shortest_path.hpp"
+#include "unit_test_pos_tagger.hpp"
 #include "unit_test_segment.hpp"
 #include "unit_test_serialization.hpp"
+#include "unit_test_thread_pool.hpp"
 #include "unit_test_utility.hpp"
 #include "unit_test_viterbi.hpp"
 #include "unit_test_longtime.hpp"
@@ -10,6 +10,7 @@
 #define _OPENCLAS_UNIT_TEST_DICTIONARY_HPP_
 
 #include <openclas/dictionary.hpp>
+#include <openclas/utility.hpp>
 #include <boost/test/floating_point_comparison.hpp>
 
 BOOST_AUTO_TEST_SUITE( dictionary )
@@ -92,23 +93,60 @@ BOOST_AUTO_TEST_CASE( test_DictEntry_remove )
 BOOST_AUTO_TEST_CASE( test_DictEntry_get_forward_weight )
 {
 	DictEntry entry;
-	entry.forward[L"TestA"] = 0.135;
-	entry.forward[L"TestB"] = 0.246;
+	entry.forward.set(7, 0.135);
+	entry.forward.set(2, 0.246);
 	
-	BOOST_CHECK_CLOSE( entry.get_forward_weight(L"TestA"), 0.135, 0.00001 );
-	BOOST_CHECK_CLOSE( entry.get_forward_weight(L"TestB"), 0.246, 0.00001 );
-	BOOST_CHECK_CLOSE( entry.get_forward_weight(L"NotExist"), 0., 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_forward_weight(7), 0.135, 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_forward_weight(2), 0.246, 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_forward_weight(5), 0., 0.00001 );
 }
 
 BOOST_AUTO_TEST_CASE( test_DictEntry_get_backward_weight )
 {
 	DictEntry entry;
-	entry.backward[L"TestA"] = 0.246;
-	entry.backward[L"TestB"] = 0.135;
+	entry.backward.set(7, 0.246);
+	entry.backward.set(2, 0.135);
 	
-	BOOST_CHECK_CLOSE( entry.get_backward_weight(L"TestA"), 0.246, 0.00001 );
-	BOOST_CHECK_CLOSE( entry.get_backward_weight(L"TestB"), 0.135, 0.00001 );
-	BOOST_CHECK_CLOSE( entry.get_backward_weight(L"NotExist"), 0., 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_backward_weight(7), 0.246, 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_backward_weight(2), 0.135, 0.00001 );
+	BOOST_CHECK_CLOSE( entry.get_backward_weight(5), 0., 0.00001 );
+}
+
+BOOST_AUTO_TEST_CASE( test_TransitTable )
+{
+	TransitTable table;
+	BOOST_CHECK( table.empty() );
+
+	table.set(30, 3);
+	table.set(10, 1);
+	table.set(20, 2);
+	BOOST_REQUIRE_EQUAL( table.size(), 3 );
+
+	//	sorted by id
+	TransitTable::const_iterator iter = table.begin();
+	BOOST_CHECK_EQUAL( (iter++)->id, 10 );
+	BOOST_CHECK_EQUAL( (iter++)->id, 20 );
+	BOOST_CHECK_EQUAL( (iter++)->id, 30 );
+	BOOST_CHECK( iter == table.end() );
+
+	//	update
+	table.set(20, 22);
+	BOOST_CHECK_EQUAL( table.size(), 3 );
+	BOOST_CHECK_CLOSE( table.get(20), 22., 0.00001 );
+
+	//	remove
+	table.remove(10);
+	table.remove(15);
+	BOOST_CHECK_EQUAL( table.size(), 2 );
+	BOOST_CHECK_CLOSE( table.get(10), 0., 0.00001 );
+
+	//	remove and shift
+	table.remove_and_shift(20);
+	BOOST_REQUIRE_EQUAL( table.size(), 1 );
+	BOOST_CHECK_CLOSE( table.get(29), 3., 0.00001 );
+
+	table.clear();
+	BOOST_CHECK( table.empty() );
 }
 
 
@@ -223,6 +261,105 @@ BOOST_AUTO_TEST_CASE( test_WordIndexer )
 }
 
 
+/*******************************************************************
+*
+*	DoubleArrayIndexer
+*
+********************************************************************/
+
+BOOST_AUTO_TEST_CASE( test_DoubleArrayIndexer )
+{
+	DoubleArrayIndexer indexer;
+	BOOST_CHECK( indexer.empty() );
+	BOOST_CHECK_EQUAL( indexer.get(L"A"), DoubleArrayIndexer::npos );
+
+	//	build with the value of the index in INDEX_STRING
+	std::vector<DoubleArrayIndexer::key_type> keys;
+	for (int i = 9; i >= 0; --i)
+		keys.push_back(DoubleArrayIndexer::key_type(INDEX_STRING[i], i));
+	indexer.build(keys);
+	BOOST_CHECK( !indexer.empty() );
+
+	//	get the value and verify it
+	for (int i = 0; i < 10; ++i)
+	{
+		std::wstring str(INDEX_STRING[i]);
+		BOOST_CHECK_EQUAL( indexer.get(str.begin(), str.end()), i );
+	}
+
+	//	get Not Exist entry, should return npos
+	BOOST_CHECK_EQUAL( indexer.get(L"NotExist"), DoubleArrayIndexer::npos );
+	BOOST_CHECK_EQUAL( indexer.get(L"AC"), DoubleArrayIndexer::npos );
+	BOOST_CHECK_EQUAL( indexer.get(L"ABCD"), DoubleArrayIndexer::npos );
+
+	//	Test prefix function
+	std::vector<int> prefix_list = indexer.prefix(L"ACDEFGHK");
+	BOOST_REQUIRE_EQUAL( prefix_list.size(), 4 );
+	BOOST_CHECK_EQUAL( prefix_list[0], 0 );	//	L""
+	BOOST_CHECK_EQUAL( prefix_list[1], 1 );	//	L"A"
+	BOOST_CHECK_EQUAL( prefix_list[2], 6 );	//	L"ACD"
+	BOOST_CHECK_EQUAL( prefix_list[3], 4 );	//	L"ACDEFG"
+
+	//	rebuild with Chinese words and the symbol out of BMP
+	keys.clear();
+	keys.push_back(DoubleArrayIndexer::key_type(L"他说", 0));
+	keys.push_back(DoubleArrayIndexer::key_type(L"的确", 1));
+	keys.push_back(DoubleArrayIndexer::key_type(L"的确实", 2));
+	keys.push_back(DoubleArrayIndexer::key_type(L"实在", 3));
+	keys.push_back(DoubleArrayIndexer::key_type(std::wstring(1, static_cast<wchar_t>(0xFFFD)), 4));
+	indexer.build(keys);
+
+	BOOST_CHECK_EQUAL( indexer.get(L"他说"), 0 );
+	BOOST_CHECK_EQUAL( indexer.get(L"的确实"), 2 );
+	BOOST_CHECK_EQUAL( indexer.get(L"实在"), 3 );
+	BOOST_CHECK_EQUAL( indexer.get(std::wstring(1, static_cast<wchar_t>(0xFFFD))), 4 );
+	BOOST_CHECK_EQUAL( indexer.get(L"A"), DoubleArrayIndexer::npos );
+	BOOST_CHECK_EQUAL( indexer.get(L""), DoubleArrayIndexer::npos );
+
+	prefix_list = indexer.prefix(L"的确实在理");
+	BOOST_REQUIRE_EQUAL( prefix_list.size(), 2 );
+	BOOST_CHECK_EQUAL( prefix_list[0], 1 );
+	BOOST_CHECK_EQUAL( prefix_list[1], 2 );
+
+	indexer.clear();
+	BOOST_CHECK( indexer.empty() );
+	BOOST_CHECK_EQUAL( indexer.get(L"他说"), DoubleArrayIndexer::npos );
+}
+
+BOOST_AUTO_TEST_CASE( test_BigramHash )
+{
+	BigramHash hash;
+	BOOST_CHECK( hash.empty() );
+	BOOST_CHECK_EQUAL( hash.get(BigramHash::make_key(0, 1)), BigramHash::npos );
+
+	std::vector<BigramHash::key_type> keys;
+	for (size_t current = 0; current < 100; ++current)
+		for (size_t next = current; next < 100; next += 7)
+			keys.push_back(BigramHash::make_key(current, next));
+	hash.build(keys);
+	BOOST_CHECK_EQUAL( hash.size(), keys.size() );
+
+	//	every key has its own slot
+	std::vector<bool> used(keys.size(), false);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		int slot = hash.get(keys[i]);
+		BOOST_REQUIRE( slot >= 0 && slot < static_cast<int>(keys.size()) );
+		BOOST_CHECK( !used[slot] );
+		used[slot] = true;
+	}
+
+	//	the absent keys are rejected by the fingerprints
+	BOOST_CHECK_EQUAL( hash.get(BigramHash::make_key(1, 0)), BigramHash::npos );
+	BOOST_CHECK_EQUAL( hash.get(BigramHash::make_key(0, 100)), BigramHash::npos );
+	BOOST_CHECK_EQUAL( hash.get(BigramHash::make_key(1000, 1000)), BigramHash::npos );
+
+	hash.clear();
+	BOOST_CHECK( hash.empty() );
+	BOOST_CHECK_EQUAL( hash.get(keys[0]), BigramHash::npos );
+}
+
+
 /*******************************************************************
 *
 *	Dictionary
@@ -286,6 +423,41 @@ BOOST_AUTO_TEST_CASE( test_Dictionary_add_word )
 	BOOST_CHECK_EQUAL( dict.words().size(), 0 );
 }
 
+BOOST_AUTO_TEST_CASE( test_Dictionary_word_id )
+{
+	Dictionary dict;
+	DictEntry* entry_a = dict.add_word(L"WordA");
+	DictEntry* entry_b = dict.add_word(L"WordB");
+	DictEntry* entry_c = dict.add_word(L"WordC");
+
+	//	ids are the index in words()
+	BOOST_CHECK_EQUAL( entry_a->id, 0 );
+	BOOST_CHECK_EQUAL( entry_b->id, 1 );
+	BOOST_CHECK_EQUAL( entry_c->id, 2 );
+	BOOST_CHECK_EQUAL( dict.add_word(L"WordB")->id, 1 );
+
+	//	word transit
+	BOOST_CHECK( dict.add_word_transit_weight(L"WordA", L"WordC", 10) );
+	BOOST_CHECK( dict.add_word_transit_weight(L"WordC", L"WordA", 20) );
+	BOOST_CHECK( dict.add_word_transit_weight(L"WordB", L"WordC", 30) );
+	BOOST_CHECK( !dict.add_word_transit_weight(L"WordA", L"NotExist", 40) );
+	BOOST_CHECK_CLOSE( entry_a->get_forward_weight(entry_c->id), 10., 0.00001 );
+	BOOST_CHECK_CLOSE( entry_c->get_backward_weight(entry_a->id), 10., 0.00001 );
+	BOOST_CHECK_CLOSE( entry_c->get_forward_weight(entry_a->id), 20., 0.00001 );
+	BOOST_CHECK_CLOSE( entry_a->get_forward_weight(entry_b->id), 0., 0.00001 );
+
+	//	remove a word, the ids after it should be shifted
+	dict.remove_word(L"WordB");
+	BOOST_REQUIRE_EQUAL( dict.words().size(), 2 );
+	BOOST_CHECK_EQUAL( entry_a->id, 0 );
+	BOOST_CHECK_EQUAL( entry_c->id, 1 );
+	BOOST_CHECK_EQUAL( dict.words()[entry_c->id], entry_c );
+	BOOST_CHECK_EQUAL( entry_c->backward.size(), 1 );
+	BOOST_CHECK_CLOSE( entry_a->get_forward_weight(entry_c->id), 10., 0.00001 );
+	BOOST_CHECK_CLOSE( entry_c->get_forward_weight(entry_a->id), 20., 0.00001 );
+	BOOST_CHECK_CLOSE( entry_c->get_backward_weight(entry_a->id), 10., 0.00001 );
+}
+
 BOOST_AUTO_TEST_CASE( test_Dictionary_prefix )
 {
     Dictionary dict;
@@ -306,6 +478,216 @@ BOOST_AUTO_TEST_CASE( test_Dictionary_prefix )
 	BOOST_CHECK( result[3]->word == L"ABCDEF" );
 }
 
+struct prefix_recorder {
+	std::vector<size_t> ids;
+	std::vector<size_t> lengths;
+	void operator() (size_t id, size_t length)
+	{
+		ids.push_back(id);
+		lengths.push_back(length);
+	}
+};
+
+BOOST_AUTO_TEST_CASE( test_Dictionary_for_each_prefix )
+{
+	Dictionary dict;
+	dict.add_word(L"A");
+	dict.add_word(L"B");
+	dict.add_word(L"ABC");
+	dict.add_word(L"ABCD");
+	dict.add_word(L"ABCDEF");
+
+	const std::wstring text(L"ABCDEFGHIJKL");
+	for (int frozen = 0; frozen < 2; ++frozen)
+	{
+		if (frozen)
+			dict.freeze();
+
+		prefix_recorder recorder;
+		dict.for_each_prefix(text.begin(), text.end(), recorder);
+
+		BOOST_REQUIRE_EQUAL( recorder.ids.size(), 4 );
+		BOOST_CHECK( dict.get_word_string(recorder.ids[0]) == L"A" );
+		BOOST_CHECK_EQUAL( recorder.lengths[0], 1 );
+		BOOST_CHECK( dict.get_word_string(recorder.ids[1]) == L"ABC" );
+		BOOST_CHECK_EQUAL( recorder.lengths[1], 3 );
+		BOOST_CHECK( dict.get_word_string(recorder.ids[2]) == L"ABCD" );
+		BOOST_CHECK_EQUAL( recorder.lengths[2], 4 );
+		BOOST_CHECK( dict.get_word_string(recorder.ids[3]) == L"ABCDEF" );
+		BOOST_CHECK_EQUAL( recorder.lengths[3], 6 );
+
+		//	search from the middle of the text
+		prefix_recorder recorder_b;
+		dict.for_each_prefix(text.begin() + 1, text.end(), recorder_b);
+		BOOST_CHECK_EQUAL( recorder_b.ids.size(), 1 );
+		//	stop at the end of the range
+		prefix_recorder recorder_c;
+		dict.for_each_prefix(text.begin(), text.begin() + 3, recorder_c);
+		BOOST_CHECK_EQUAL( recorder_c.ids.size(), 2 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_Dictionary_for_each_prefix_utf8 )
+{
+	Dictionary dict;
+	dict.add_word(L"中");
+	dict.add_word(L"中华");
+	dict.add_word(L"中华人民");
+	dict.add_word(L"中a文");
+	dict.add_word(L"华");
+
+	const std::wstring texts[] = { L"中华人民共和国", L"中a文", L"中华", L"华人", L"人民" };
+	for (int frozen = 0; frozen < 2; ++frozen)
+	{
+		if (frozen)
+			dict.freeze();
+
+		//	the UTF-8 text has the same prefixes as the wide one
+		for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i)
+		{
+			std::string utf8 = encode_utf8(texts[i]);
+			prefix_recorder expected, result;
+			dict.for_each_prefix(texts[i].begin(), texts[i].end(), expected);
+			dict.for_each_prefix(Utf8Iterator(utf8.data(), utf8.data() + utf8.size()), Utf8Iterator(utf8.data() + utf8.size(), utf8.data() + utf8.size()), result);
+			BOOST_CHECK( result.ids == expected.ids );
+			BOOST_CHECK( result.lengths == expected.lengths );
+		}
+
+		//	the lengths are in symbols
+		std::string utf8 = encode_utf8(L"中华人民共和国");
+		prefix_recorder recorder;
+		dict.for_each_prefix(Utf8Iterator(utf8.data(), utf8.data() + utf8.size()), Utf8Iterator(utf8.data() + utf8.size(), utf8.data() + utf8.size()), recorder);
+		BOOST_REQUIRE_EQUAL( recorder.lengths.size(), 3 );
+		BOOST_CHECK_EQUAL( recorder.lengths[2], 4 );
+
+		//	a broken sequence never matches
+		std::string broken = utf8.substr(0, 4);
+		prefix_recorder recorder_b;
+		dict.for_each_prefix(Utf8Iterator(broken.data(), broken.data() + broken.size()), Utf8Iterator(broken.data() + broken.size(), broken.data() + broken.size()), recorder_b);
+		BOOST_CHECK_EQUAL( recorder_b.ids.size(), 1 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_Dictionary_freeze )
+{
+	Dictionary dict;
+	dict.add_word(L"A");
+	dict.add_word(L"B");
+	dict.add_word(L"BC");
+	dict.add_word(L"ABC");
+	dict.add_word(L"ABCD");
+	dict.add_word(L"ABDD");
+	dict.add_word(L"ABCDEF");
+
+	BOOST_CHECK( !dict.is_frozen() );
+	dict.freeze();
+	BOOST_CHECK( dict.is_frozen() );
+
+	//	lookups give the same entries as the WordIndexer
+	DictEntry* entry = dict.get_word(L"ABDD");
+	BOOST_REQUIRE_NE( entry, static_cast<DictEntry*>(0) );
+	BOOST_CHECK( entry->word == L"ABDD" );
+	BOOST_CHECK_EQUAL( dict.get_word(L"AB"), static_cast<DictEntry*>(0) );
+
+	std::vector<DictEntry*> result = dict.prefix(L"ABCDEFGHIJKL");
+	BOOST_REQUIRE_EQUAL( result.size(), 4 );
+	BOOST_CHECK( result[0]->word == L"A" );
+	BOOST_CHECK( result[1]->word == L"ABC" );
+	BOOST_CHECK( result[2]->word == L"ABCD" );
+	BOOST_CHECK( result[3]->word == L"ABCDEF" );
+
+	//	modification drops the frozen indexer
+	dict.add_word(L"AB");
+	BOOST_CHECK( !dict.is_frozen() );
+	BOOST_CHECK_NE( dict.get_word(L"AB"), static_cast<DictEntry*>(0) );
+
+	dict.freeze();
+	BOOST_CHECK_NE( dict.get_word(L"AB"), static_cast<DictEntry*>(0) );
+	dict.remove_word(L"ABC");
+	BOOST_CHECK( !dict.is_frozen() );
+	BOOST_CHECK_EQUAL( dict.get_word(L"ABC"), static_cast<DictEntry*>(0) );
+
+	dict.freeze();
+	BOOST_CHECK_EQUAL( dict.get_word(L"ABC"), static_cast<DictEntry*>(0) );
+	BOOST_CHECK_EQUAL( dict.prefix(L"ABCDEFGHIJKL").size(), 4 );
+}
+
+BOOST_AUTO_TEST_CASE( test_Dictionary_word_by_id )
+{
+	Dictionary dict;
+	dict.add_word(L"AB")->add(1, 200);
+	dict.get_word(L"AB")->add(2, 50);
+	dict.add_word(L"ABC")->add(3, 10);
+	dict.add_word(L"D");
+	dict.add_word_transit_weight(L"AB", L"D", 20);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		//	the same results with and without the frozen indexer
+		if (i == 1)
+			dict.freeze();
+
+		BOOST_CHECK_EQUAL( dict.word_count(), 3 );
+		size_t id = dict.get_word_id(L"AB");
+		BOOST_CHECK_EQUAL( id, 0 );
+		BOOST_CHECK_EQUAL( dict.get_word_id(L"ABC"), 1 );
+		BOOST_CHECK_EQUAL( dict.get_word_id(L"A"), INVALID_WORD_ID );
+		BOOST_CHECK_EQUAL( dict.get_word_id(L"ABCD"), INVALID_WORD_ID );
+		BOOST_CHECK( dict.get_word_string(id) == L"AB" );
+
+		Dictionary::tag_range_type tags = dict.get_word_tags(id);
+		BOOST_REQUIRE_EQUAL( tags.second - tags.first, 2 );
+		BOOST_CHECK_EQUAL( tags.first->tag, 1 );
+		BOOST_CHECK_EQUAL( dict.get_word_weight(id), 250 );
+		tags = dict.get_word_tags(dict.get_word_id(L"D"));
+		BOOST_CHECK( tags.first == tags.second );
+		BOOST_CHECK_EQUAL( dict.get_word_weight(dict.get_word_id(L"D")), 0 );
+
+		BOOST_CHECK_EQUAL( dict.get_word_transit_weight(id, dict.get_word_id(L"D")), 20 );
+		BOOST_CHECK_EQUAL( dict.get_word_transit_weight(dict.get_word_id(L"D"), id), 0 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_Dictionary_scores )
+{
+	Dictionary dict;
+	dict.add_word(L"AB")->add(1, 200);
+	dict.get_word(L"AB")->add(2, 50);
+	dict.add_word(L"ABC")->add(3, 10);
+	dict.add_word(L"D");
+	dict.add_word_transit_weight(L"AB", L"D", 20);
+
+	size_t ab = dict.get_word_id(L"AB");
+	size_t abc = dict.get_word_id(L"ABC");
+	size_t d = dict.get_word_id(L"D");
+
+	for (int i = 0; i < 2; ++i)
+	{
+		//	the same costs with and without the precomputed scores, the bigram costs are floats
+		if (i == 1)
+			dict.freeze();
+		BOOST_CHECK_EQUAL( dict.has_scores(), i == 1 );
+
+		BOOST_CHECK_CLOSE( dict.get_transit_cost(ab, d), calculate_transit_cost(250, 20, 0.1), 1e-4 );
+		BOOST_CHECK_CLOSE( dict.get_transit_cost(ab, abc), calculate_transit_cost(250, 0, 0.1), 1e-10 );
+		BOOST_CHECK_CLOSE( dict.get_transit_cost(d, ab), calculate_transit_cost(0, 0, 0.1), 1e-10 );
+		BOOST_CHECK_CLOSE( dict.get_word_cost(abc), calculate_transit_cost(10, 0, 0.1), 1e-10 );
+	}
+
+	//	changing the scoring config computes the scores again
+	dict.set_scoring(ScoringConfig(0.3));
+	BOOST_CHECK( dict.has_scores() );
+	BOOST_CHECK_CLOSE( dict.get_transit_cost(ab, d), calculate_transit_cost(250, 20, 0.3), 1e-4 );
+	BOOST_CHECK_CLOSE( dict.get_word_cost(ab), calculate_transit_cost(250, 0, 0.3), 1e-10 );
+
+	//	modification drops the scores
+	dict.add_word_transit_weight(L"D", L"AB", 5);
+	BOOST_CHECK( !dict.has_scores() );
+	BOOST_CHECK_CLOSE( dict.get_transit_cost(d, ab), calculate_transit_cost(0, 5, 0.3), 1e-10 );
+	dict.build_scores();
+	BOOST_CHECK_CLOSE( dict.get_transit_cost(d, ab), calculate_transit_cost(0, 5, 0.3), 1e-4 );
+}
+
 /*****************   Tag   *****************/
 
 BOOST_AUTO_TEST_CASE( test_Dictionary_init_tag_dict )
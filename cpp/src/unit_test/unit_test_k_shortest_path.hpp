@@ -519,6 +519,184 @@ BOOST_AUTO_TEST_CASE( test_ksp_shortest_paths_complex_graph )
 	BOOST_CHECK_EQUAL( result.nodelist[5], 10 );
 }
 
+/****************************************************
+ *
+ *					Lattice
+ *
+ ****************************************************/
+
+BOOST_AUTO_TEST_CASE( test_ksp_lattice )
+{
+	Lattice<int> lattice;
+	BOOST_CHECK( lattice.empty() );
+	lattice.add_node(10);
+	lattice.add_node(20);
+	lattice.add_node(30);
+	lattice.add_edge(0, 1, 1.5);
+	lattice.add_edge(0, 2, 2.5);
+	lattice.add_edge(1, 2, 3.5);
+	BOOST_CHECK_EQUAL( lattice.node_count(), 3 );
+	BOOST_CHECK_EQUAL( lattice.edge_count(), 3 );
+	BOOST_CHECK_EQUAL( lattice[1], 20 );
+
+	Lattice<int>::edge_iterator ei, ei_end;
+	tie(ei, ei_end) = lattice.out_edges(0);
+	BOOST_REQUIRE_EQUAL( ei_end - ei, 2 );
+	BOOST_CHECK_EQUAL( ei[1].target, 2 );
+	BOOST_CHECK_CLOSE( ei[1].weight, 2.5, 0.00001 );
+	tie(ei, ei_end) = lattice.out_edges(2);
+	BOOST_CHECK( ei == ei_end );
+
+	//	the out edges of a node should be added together
+	BOOST_CHECK_THROW( lattice.add_edge(0, 1, 1), std::logic_error );
+
+	lattice.clear();
+	BOOST_CHECK( lattice.empty() );
+	BOOST_CHECK_EQUAL( lattice.edge_count(), 0 );
+}
+
+//	The k best paths should be the first k of all the paths sorted by weight.
+void check_k_best_paths(Lattice<size_t>& lattice, size_t begin, size_t end, int k)
+{
+	std::vector<path_type> all_paths, result;
+	dag_all_paths(lattice, begin, end, all_paths);
+	std::sort(all_paths.begin(), all_paths.end());
+	dag_k_shortest_paths(lattice, begin, end, result, k);
+
+	BOOST_REQUIRE_EQUAL( result.size(), std::min(static_cast<size_t>(k), all_paths.size()) );
+	for (size_t j = 0; j < result.size(); ++j)
+	{
+		BOOST_CHECK_CLOSE( result[j].weight, all_paths[j].weight, 0.00001 );
+		//	a real path with the weight
+		BOOST_REQUIRE( !result[j].nodelist.empty() );
+		BOOST_CHECK_EQUAL( result[j].nodelist.front(), begin );
+		BOOST_CHECK_EQUAL( result[j].nodelist.back(), end );
+		double weight = 0;
+		for (size_t n = 0; n + 1 < result[j].nodelist.size(); ++n)
+		{
+			double edge_weight = -1;
+			Lattice<size_t>::edge_iterator ei, ei_end;
+			for (tie(ei, ei_end) = lattice.out_edges(result[j].nodelist[n]); ei != ei_end; ++ei)
+				if (ei->target == result[j].nodelist[n + 1] && (edge_weight < 0 || ei->weight < edge_weight))
+					edge_weight = ei->weight;
+			BOOST_REQUIRE( edge_weight >= 0 );
+			weight += edge_weight;
+		}
+		BOOST_CHECK_CLOSE( weight + 1, result[j].weight + 1, 0.00001 );
+		//	no duplicated path
+		for (size_t i = 0; i < j; ++i)
+			BOOST_CHECK( result[i].nodelist != result[j].nodelist );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_ksp_lattice_same_as_graph )
+{
+	const enum TestGraphKind kinds[] = {GRAPH_SINGLE_NODE, GRAPH_SINGLE_EDGE, GRAPH_SINGLE_PATH, GRAPH_SIMPLE, GRAPH_COMPLEX};
+	for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i)
+	{
+		WordGraph g = generate_test_graph(kinds[i]);
+		Lattice<size_t> lattice;
+		std::vector<size_t> index_map;
+		dag_to_lattice(g, lattice, index_map);
+
+		size_t last = num_vertices(g) - 1;
+		for (int k = 1; k <= 10; ++k)
+		{
+			std::vector<path_type> expected, result;
+			dag_k_shortest_paths(g, 0, last, expected, k);
+			dag_k_shortest_paths(lattice, index_map[0], index_map[last], result, k);
+
+			BOOST_REQUIRE_EQUAL( result.size(), expected.size() );
+			for (size_t j = 0; j < result.size(); ++j)
+			{
+				BOOST_CHECK_CLOSE( result[j].weight, expected[j].weight, 0.00001 );
+				BOOST_REQUIRE_EQUAL( result[j].nodelist.size(), expected[j].nodelist.size() );
+				for (size_t n = 0; n < result[j].nodelist.size(); ++n)
+					BOOST_CHECK_EQUAL( lattice[result[j].nodelist[n]], expected[j].nodelist[n] );
+			}
+
+			check_k_best_paths(lattice, index_map[0], index_map[last], k);
+		}
+	}
+
+	Lattice<size_t> empty_lattice;
+	std::vector<path_type> result;
+	dag_k_shortest_paths(empty_lattice, 0, 0, result, 1);
+	BOOST_CHECK_EQUAL( result.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_ksp_lattice_k_best_random )
+{
+	//	random lattices like the ones of segmentation, each node links to a few following nodes
+	std::srand(20100401);
+	for (int round = 0; round < 50; ++round)
+	{
+		Lattice<size_t> lattice;
+		size_t node_count = 2 + std::rand() % 20;
+		for (size_t i = 0; i < node_count; ++i)
+			lattice.add_node(i);
+		for (size_t i = 0; i + 1 < node_count; ++i)
+		{
+			for (size_t target = i + 1; target < node_count && target <= i + 4; ++target)
+			{
+				//	integer weights give many ties
+				if (target == i + 1 || std::rand() % 2 == 0)
+					lattice.add_edge(i, target, std::rand() % 5);
+			}
+		}
+
+		for (int k = 1; k <= 8; ++k)
+			check_k_best_paths(lattice, 0, node_count - 1, k);
+		//	a sub-lattice
+		check_k_best_paths(lattice, 1, node_count - 1, 4);
+	}
+
+	//	not connected
+	Lattice<size_t> lattice;
+	lattice.add_node(0);
+	lattice.add_node(1);
+	std::vector<path_type> result;
+	dag_k_shortest_paths(lattice, 0, 1, result, 3);
+	BOOST_CHECK_EQUAL( result.size(), 0 );
+	dag_k_shortest_paths(lattice, 0, 1, result, 0);
+	BOOST_CHECK_EQUAL( result.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_ksp_lattice_buffer_reuse )
+{
+	//	one buffer for lattices of different sizes, from larger to smaller and back
+	const enum TestGraphKind kinds[] = {GRAPH_COMPLEX, GRAPH_SIMPLE, GRAPH_SINGLE_EDGE, GRAPH_SINGLE_PATH, GRAPH_COMPLEX};
+	shortest_path_buffer buffer;
+	for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i)
+	{
+		WordGraph g = generate_test_graph(kinds[i]);
+		Lattice<size_t> lattice;
+		std::vector<size_t> index_map;
+		dag_to_lattice(g, lattice, index_map);
+
+		size_t last = num_vertices(g) - 1;
+		path_type expected, result;
+		dag_shortest_path(lattice, index_map[0], index_map[last], expected);
+		dag_shortest_path(lattice, index_map[0], index_map[last], result, buffer);
+		BOOST_CHECK_CLOSE( result.weight, expected.weight, 0.00001 );
+		BOOST_CHECK( result.nodelist == expected.nodelist );
+	}
+	BOOST_CHECK_EQUAL( buffer.distance.size(), 11 );
+
+	//	the sub-lattice between two inner nodes
+	WordGraph g = generate_test_graph(GRAPH_COMPLEX);
+	Lattice<size_t> lattice;
+	std::vector<size_t> index_map;
+	dag_to_lattice(g, lattice, index_map);
+	path_type result;
+	dag_shortest_path(lattice, index_map[1], index_map[5], result, buffer);
+	//	1, 7, 4, 5
+	BOOST_CHECK_CLOSE( result.weight, 4.10 + 3.92 + 5.62, 0.00001 );
+	BOOST_REQUIRE_EQUAL( result.nodelist.size(), 4 );
+	BOOST_CHECK_EQUAL( lattice[result.nodelist[1]], 7 );
+	BOOST_CHECK_EQUAL( lattice[result.nodelist[2]], 4 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 //	_OPENCLAS_UNIT_TEST_K_SHORTEST_PATH_HPP_
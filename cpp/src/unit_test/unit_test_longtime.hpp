@@ -11,8 +11,90 @@
 
 #include <openclas/serialization.hpp>
 #include <openclas/segment.hpp>
+#include <openclas/viterbi.hpp>
+#include <openclas/pos_tagger.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <fstream>
+#include <sstream>
 #include <ctime>
+#include <new>
+#include <cstdlib>
+
+/*******************************************************************
+*
+*				allocation counter
+*
+********************************************************************/
+
+//	the allocations of all the threads, the thread pool tests allocate concurrently
+static boost::detail::atomic_count allocation_count(0);
+
+#if defined(_MSC_VER)
+#	define UNIT_TEST_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#	define UNIT_TEST_NOINLINE __attribute__((noinline))
+#else
+#	define UNIT_TEST_NOINLINE
+#endif
+
+//	not inlined into the callers, so the compilers don't pair a new expression with free()
+UNIT_TEST_NOINLINE static void* counted_allocate(std::size_t size)
+{
+	++allocation_count;
+	return std::malloc(size ? size : 1);
+}
+
+UNIT_TEST_NOINLINE static void counted_free(void* ptr)
+{
+	std::free(ptr);
+}
+
+void* operator new(std::size_t size)
+{
+	void* ptr = counted_allocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+	void* ptr = counted_allocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+	return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+	return counted_allocate(size);
+}
+
+void operator delete(void* ptr) throw()
+{
+	counted_free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+	counted_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) throw()
+{
+	counted_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) throw()
+{
+	counted_free(ptr);
+}
 
 BOOST_AUTO_TEST_SUITE( long_time_run )
 
@@ -53,16 +135,36 @@ void construct_dict_subset(Dictionary& dict, Dictionary& mini_dict, const std::w
 		{
 			DictEntry* entry = *iEntry;
 			DictEntry* mini_entry = mini_dict.add_word(entry->word);
-			*mini_entry = *entry;
+			mini_entry->tags = entry->tags;
 		}
 	}
 }
 
+//	word ids are different between dictionaries, so copy the transit by word.
+void construct_dict_subset_transit(Dictionary& dict, Dictionary& mini_dict)
+{
+	for (Dictionary::word_dict_type::const_iterator iter = mini_dict.words().begin(); iter != mini_dict.words().end(); ++iter)
+	{
+		DictEntry* entry = dict.get_word((*iter)->word);
+		for (DictEntry::transit_type::const_iterator it = entry->forward.begin(); it != entry->forward.end(); ++it)
+			mini_dict.add_word_transit_weight(entry->word, dict.words().at(it->id)->word, it->weight);
+	}
+}
+
 int ms(clock_t tick)
 {
 	return static_cast<int>( (clock()-tick) * 1000. / CLOCKS_PER_SEC );
 }
 
+struct prefix_counter {
+	size_t count;
+	prefix_counter() : count(0) {}
+	void operator() (size_t /*id*/, size_t /*length*/)
+	{
+		++count;
+	}
+};
+
 BOOST_AUTO_TEST_CASE( test_Serialization_dct_ocd_txt_gz )
 {
 	Dictionary dict;
@@ -134,6 +236,33 @@ BOOST_AUTO_TEST_CASE( test_Serialization_dct_ocd_txt_gz )
 	}
 	BOOST_CHECK_EQUAL( transit_count, 408960 );
 
+	/******************************************
+	 *		Test .ocd2 format (save and map)
+	 ******************************************/
+	const char* core_image_name = "data/core.ocd2";
+
+	tick = clock();
+	save_to_ocd2_file(dict, core_image_name);
+	std::cout << "Save " << core_image_name << " : \t" << ms(tick) << " ms" << std::endl;
+
+	Dictionary dict_ocd2;
+
+	tick = clock();
+	load_from_ocd2_file(dict_ocd2, core_image_name);
+	std::cout << "Load " << core_image_name << " : \t" << ms(tick) << " ms" << std::endl;
+
+	BOOST_CHECK_EQUAL( dict_ocd2.word_count(), 85604 );
+	BOOST_CHECK_EQUAL( dict_ocd2.image().header().tag_item_count, 104451 );
+	BOOST_CHECK_EQUAL( dict_ocd2.image().header().transit_count, 408960 );
+	for (size_t i = 0; i < dict.words().size(); i += 97)
+	{
+		const DictEntry* entry = dict.words()[i];
+		BOOST_CHECK_EQUAL( dict_ocd2.get_word_id(entry->word), i );
+		BOOST_CHECK_EQUAL( dict_ocd2.get_word_weight(i), dict.get_word_weight(i) );
+		for (DictEntry::transit_type::const_iterator it = entry->forward.begin(); it != entry->forward.end(); ++it)
+			BOOST_CHECK_EQUAL( dict_ocd2.get_word_transit_weight(i, it->id), static_cast<int>(it->weight) );
+	}
+
 	/******************************************
 	 *		Test .txt format (save and load)
 	 ******************************************/
@@ -207,13 +336,14 @@ BOOST_AUTO_TEST_CASE( test_Serialization_dct_ocd_txt_gz )
 		if (entry)
 		{
 			DictEntry* mini_entry = mini_dict.add_word(special_word);
-			*mini_entry = *entry;
+			mini_entry->tags = entry->tags;
 		}
 	}
 
 	//	add subset of normal word
 	for (int i = 0; i < sample_count; ++i)
 		construct_dict_subset(dict, mini_dict, sample[i]);
+	construct_dict_subset_transit(dict, mini_dict);
 
 	//	one special
 	//	Punctuation as Terminal of each segment
@@ -250,6 +380,11 @@ BOOST_AUTO_TEST_CASE( test_Segment_performance )
 		entry_w->add(WORD_TAG_W, entry_begin->tags.front().weight);
 	}
 
+	std::cout << "Freezing dictionary ... ";
+	tick = clock();
+	dict.freeze();
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
 	tick = clock();
 	std::cout << "Generating 1MB text ... ";
 	std::wostringstream oss;
@@ -272,11 +407,30 @@ BOOST_AUTO_TEST_CASE( test_Segment_performance )
 	content_out.close();
 	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
 
+	size_t allocations = allocation_count;
+	size_t prefix_count = 0;
+	tick = clock();
+	std::cout << "Looking up prefixes by prefix() ... ";
+	for (std::wstring::const_iterator iter = content.begin(); iter != content.end(); ++iter)
+		prefix_count += dict.prefix(iter, content.end()).size();
+	std::cout << "OK (" << ms(tick) << " ms, " << prefix_count << " words, " << (allocation_count - allocations) << " allocations)" << std::endl;
+
+	allocations = allocation_count;
+	prefix_counter counter;
+	tick = clock();
+	std::cout << "Looking up prefixes by for_each_prefix() ... ";
+	for (std::wstring::const_iterator iter = content.begin(); iter != content.end(); ++iter)
+		dict.for_each_prefix(iter, content.end(), counter);
+	std::cout << "OK (" << ms(tick) << " ms, " << counter.count << " words, " << (allocation_count - allocations) << " allocations)" << std::endl;
+	BOOST_CHECK_EQUAL( counter.count, prefix_count );
+
+	allocations = allocation_count;
 	tick = clock();
 	std::cout << "Segmenting 1MB text ... ";
 	std::vector<Segment::segment_type> segs = Segment::segment(content, dict, 1);
 	int time_cost = ms(tick);
 	std::cout << "OK (" << time_cost << " ms)" << std::endl;
+	std::cout << "Allocations during segmentation = " << (allocation_count - allocations) << std::endl;
 	std::cout << "Segmented " << (content.size() * sizeof(wchar_t)) << " bytes in " << time_cost << " ms" << std::endl;
 	std::cout << "Speed = " << ((content.size() * sizeof(wchar_t) / 1024.) / (time_cost / 1000.)) << " KB/s" << std::endl;
 
@@ -289,6 +443,467 @@ BOOST_AUTO_TEST_CASE( test_Segment_performance )
 	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
 }
 
+BOOST_FIXTURE_TEST_CASE( test_Segment_shortest_path_performance, mini_dictionary_fixture )
+{
+	//	build the lattices of the samples, and the boost graphs of them.
+	std::vector<WordLattice> lattices;
+	for (int i = 0; i < sample_count; ++i)
+	{
+		Segment::graph_list_type graphs = Segment::create_graphs(sample[i], dict);
+		lattices.insert(lattices.end(), graphs.begin(), graphs.end());
+	}
+	std::vector<WordGraph> graphs(lattices.size());
+	for (size_t i = 0; i < lattices.size(); ++i)
+		lattice_to_graph(lattices[i], graphs[i]);
+
+	const int repeat = 2000;
+	clock_t tick;
+	double graph_weight = 0;
+	double lattice_weight = 0;
+
+	tick = clock();
+	std::cout << "Shortest paths of " << lattices.size() << " sub-graphs by dag_shortest_paths() x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+	{
+		for (size_t i = 0; i < graphs.size(); ++i)
+		{
+			graph_property<WordGraph, graph_terminal_t>::type
+				gterminal = get_property(graphs[i], graph_terminal);
+			path_type path;
+			dag_shortest_path(graphs[i], gterminal.first, gterminal.second, path);
+			graph_weight += path.weight;
+		}
+	}
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+	size_t allocations = allocation_count;
+	shortest_path_buffer buffer;
+	tick = clock();
+	std::cout << "Shortest paths of " << lattices.size() << " sub-graphs by lattice forward pass x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+	{
+		for (size_t i = 0; i < lattices.size(); ++i)
+		{
+			path_type path;
+			dag_shortest_path(lattices[i], lattices[i].terminal().first, lattices[i].terminal().second, path, buffer);
+			lattice_weight += path.weight;
+		}
+	}
+	std::cout << "OK (" << ms(tick) << " ms, " << (allocation_count - allocations) << " allocations)" << std::endl;
+
+	BOOST_CHECK_CLOSE( lattice_weight, graph_weight, 0.00001 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_context_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	const int repeat = 500;
+	clock_t tick;
+	double segment_weight = 0;
+	double context_weight = 0;
+
+	size_t allocations = allocation_count;
+	tick = clock();
+	std::cout << "Segmenting " << sample_count << " samples by Segment::segment() x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+		for (int i = 0; i < sample_count; ++i)
+			segment_weight += Segment::segment(sample[i], dict, 1).at(0).weight;
+	std::cout << "OK (" << ms(tick) << " ms, " << (allocation_count - allocations) << " allocations)" << std::endl;
+
+	std::vector<std::wstring> texts(sample, sample + sample_count);
+	SegmenterContext context;
+	//	warm up the buffers
+	for (int i = 0; i < sample_count; ++i)
+		context.segment(texts[i], dict, 1);
+
+	allocations = allocation_count;
+	tick = clock();
+	std::cout << "Segmenting " << sample_count << " samples by SegmenterContext x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+		for (int i = 0; i < sample_count; ++i)
+			context_weight += context.segment(texts[i], dict, 1).at(0).weight;
+	allocations = allocation_count - allocations;
+	std::cout << "OK (" << ms(tick) << " ms, " << allocations << " allocations)" << std::endl;
+
+	BOOST_CHECK_CLOSE( context_weight, segment_weight, 0.00001 );
+	//	no allocation in steady state
+	BOOST_CHECK_EQUAL( allocations, 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_context_allocation, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	the texts of few sub-graphs, then one of many, so the buffers grow after they are used
+	std::vector<std::wstring> texts(sample, sample + sample_count);
+	texts.push_back(L"");
+	texts.push_back(join_samples(L"。"));
+
+	const int ks[] = { 1, 3 };
+	for (size_t n = 0; n < sizeof(ks) / sizeof(ks[0]); ++n)
+	{
+		SegmenterContext context;
+		for (size_t i = 0; i < texts.size(); ++i)
+			context.segment(texts[i], dict, ks[n]);
+
+		//	no allocation after the first pass, whatever the order of the texts is
+		size_t allocations = allocation_count;
+		for (int pass = 0; pass < 3; ++pass)
+		{
+			for (size_t i = 0; i < texts.size(); ++i)
+				context.segment(texts[i], dict, ks[n]);
+			std::reverse(texts.begin(), texts.end());
+		}
+		BOOST_CHECK_EQUAL( allocation_count - allocations, 0 );
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_ascii_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	ASCII-heavy corpus: URLs, product codes, English titles mixed with Chinese
+	const wchar_t* lines[] = {
+		L"http://www.example.com/products/index.html?category=electronics&id=1234567890",
+		L"型号ABC1234XYZ的产品在2010年上市，价格为12999元",
+		L"The Quick Brown Fox Jumps Over The Lazy Dog 中文标题 Windows Vista Service Pack",
+		L"订单号20100101123456789，快递单号SF1234567890123",
+		L"OpenCLAS is a Chinese Lexical Analysis System written in C++"
+	};
+	const int line_count = sizeof(lines) / sizeof(lines[0]);
+	std::vector<std::wstring> texts;
+	for (int i = 0; i < 1000; ++i)
+		texts.push_back(lines[i % line_count]);
+
+	const int repeat = 20;
+	SegmenterContext context;
+	enum SimdLevel previous = get_simd_level();
+	double expected_weight = 0;
+	for (int level = SIMD_NONE; level <= detect_simd_level(); ++level)
+	{
+		set_simd_level(static_cast<enum SimdLevel>(level));
+		double weight = 0;
+		clock_t tick = clock();
+		std::cout << "Segmenting ASCII-heavy corpus at SIMD level " << level << " x " << repeat << " ... ";
+		for (int r = 0; r < repeat; ++r)
+			for (size_t i = 0; i < texts.size(); ++i)
+				weight += context.segment(texts[i], dict, 1).at(0).weight;
+		std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+		if (level == SIMD_NONE)
+			expected_weight = weight;
+		BOOST_CHECK_CLOSE( weight, expected_weight, 0.00001 );
+	}
+	set_simd_level(previous);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_utf8_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	about 1MB of UTF-8 text
+	std::string content = repeat_to_size(encode_utf8(join_samples()), 1024 * 1024);
+
+	clock_t tick = clock();
+	std::cout << "Widening and segmenting " << content.size() << " bytes of UTF-8 ... ";
+	std::wstring text(Utf8Iterator(content.data(), content.data() + content.size()), Utf8Iterator(content.data() + content.size(), content.data() + content.size()));
+	std::vector<Segment::segment_type> expected = Segment::segment(text, dict, 1);
+	std::cout << "OK (" << ms(tick) << " ms, " << text.size() * sizeof(wchar_t) << " bytes of wstring)" << std::endl;
+
+	tick = clock();
+	std::cout << "Segmenting " << content.size() << " bytes of UTF-8 directly ... ";
+	std::vector<Segment::segment_type> result = Segment::segment_utf8(content, dict, 1);
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+	BOOST_REQUIRE_EQUAL( result.size(), 1 );
+	BOOST_CHECK_CLOSE( result[0].weight, expected[0].weight, 0.00001 );
+	BOOST_CHECK_EQUAL( result[0].words.size(), expected[0].words.size() );
+}
+
+struct token_counter {
+	size_t count;
+	size_t bytes;
+	token_counter() : count(0), bytes(0) {}
+	void operator() (const WordInformation& word, const char* /*bytes*/)
+	{
+		++count;
+		bytes += word.byte_length;
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_stream_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	about 8MB of UTF-8 text in lines
+	std::string content = repeat_to_size(encode_utf8(join_samples(L"\n")), 8 * 1024 * 1024);
+	std::istringstream in(content);
+
+	SegmenterContext context;
+	token_counter counter;
+	size_t allocations = allocation_count;
+	clock_t tick = clock();
+	std::cout << "Segmenting a stream of " << content.size() << " bytes of UTF-8 ... ";
+	context.segment_stream(in, dict, counter);
+	allocations = allocation_count - allocations;
+	std::cout << "OK (" << ms(tick) << " ms, " << counter.count << " words, " << allocations << " allocations)" << std::endl;
+
+	BOOST_CHECK_EQUAL( counter.bytes, content.size() );
+	//	the buffers are reused from chunk to chunk, so the allocations don't grow with the stream
+	BOOST_CHECK( allocations < 10000 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_parallel_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	about 1M symbols
+	std::wstring text = repeat_to_size(join_samples(), 1024 * 1024);
+
+	SegmenterContext sequential;
+	std::vector<Segment::segment_type> expected = sequential.segment(text, dict, 1);
+
+	//	clock() counts the time of all the threads, so the wall time is used
+	size_t max_workers = boost::thread::hardware_concurrency();
+	if (max_workers < 4)
+		max_workers = 4;
+	for (size_t workers = 1; workers <= max_workers; workers *= 2)
+	{
+		ThreadPool pool(workers);
+		SegmenterContext context;
+		context.set_thread_pool(&pool);
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		std::cout << "Segmenting " << text.size() << " symbols with " << workers << " workers ... ";
+		const std::vector<Segment::segment_type>& result = context.segment(text, dict, 1);
+		std::cout << "OK (" << (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds() << " ms)" << std::endl;
+
+		BOOST_REQUIRE_EQUAL( result.size(), 1 );
+		BOOST_CHECK( result[0].words == expected[0].words );
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_batch_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	16384 queries of 5 to 20 symbols
+	std::wstring sentences = join_samples();
+	std::vector<std::wstring> queries;
+	for (size_t offset = 0; queries.size() < 16384; offset += 7)
+		queries.push_back(sentences.substr(offset % (sentences.size() - 20), 5 + queries.size() % 16));
+
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	std::cout << "Segmenting " << queries.size() << " queries one by one ... ";
+	size_t expected_words = 0;
+	for (size_t i = 0; i < queries.size(); ++i)
+		expected_words += Segment::segment(queries[i], dict, 1)[0].words.size() - 1;
+	double elapsed = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+	std::cout << "OK (" << static_cast<size_t>(queries.size() / elapsed) << " queries/s)" << std::endl;
+
+	ThreadPool pool;
+	size_t batch_sizes[] = {1, 64, 1024};
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++b)
+		{
+			SegmenterContext context;
+			if (threaded)
+				context.set_thread_pool(&pool);
+			size_t words = 0;
+			start = boost::posix_time::microsec_clock::universal_time();
+			std::cout << "Segmenting " << queries.size() << " queries in batches of " << batch_sizes[b];
+			if (threaded)
+				std::cout << " with " << pool.size() << " workers";
+			std::cout << " ... ";
+			for (size_t i = 0; i < queries.size(); i += batch_sizes[b])
+				words += context.segment_batch(&queries[i], std::min(batch_sizes[b], queries.size() - i), dict).words.size();
+			elapsed = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+			std::cout << "OK (" << static_cast<size_t>(queries.size() / elapsed) << " queries/s)" << std::endl;
+
+			BOOST_CHECK_EQUAL( words, expected_words );
+		}
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_format_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	about 1M symbols
+	std::wstring text = repeat_to_size(join_samples(), 1024 * 1024);
+	std::vector<Segment::segment_type> segs = Segment::segment(text, dict, 1);
+
+	clock_t tick = clock();
+	std::cout << "Formatting " << segs[0].words.size() << " words by segment_to_string() ... ";
+	std::string expected = encode_utf8(Segment::segment_to_string(text, segs[0]));
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+	std::vector<WordSpan> spans;
+	Segment::get_spans(segs[0], spans);
+	std::vector<char> buffer(expected.size());
+	size_t allocations = allocation_count;
+	tick = clock();
+	std::cout << "Formatting " << spans.size() << " words by format_utf8() ... ";
+	size_t size = Segment::format_utf8(text.data(), &spans[0], spans.size(), &buffer[0], buffer.size());
+	allocations = allocation_count - allocations;
+	std::cout << "OK (" << ms(tick) << " ms, " << allocations << " allocations)" << std::endl;
+
+	BOOST_CHECK_EQUAL( allocations, 0 );
+	BOOST_REQUIRE_EQUAL( size, expected.size() );
+	BOOST_CHECK( std::equal(buffer.begin(), buffer.end(), expected.begin()) );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_PosTagger_performance, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	const int repeat = 500;
+	std::vector<std::wstring> texts(sample, sample + sample_count);
+	SegmenterContext context;
+	PosTagger tagger;
+	std::vector<WordInformation> words;
+
+	//	warm up the buffers of the context and of the tagger
+	for (int i = 0; i < sample_count; ++i)
+	{
+		const std::vector<WordInformation>& best = context.segment(texts[i], dict, 1).at(0).words;
+		words.assign(best.begin(), best.end());
+		tagger.tag(&words[0], words.size(), dict);
+	}
+
+	clock_t tick = clock();
+	std::cout << "Segmenting " << sample_count << " samples x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+		for (int i = 0; i < sample_count; ++i)
+		{
+			const std::vector<WordInformation>& best = context.segment(texts[i], dict, 1).at(0).words;
+			words.assign(best.begin(), best.end());
+		}
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+	size_t allocations = allocation_count;
+	tick = clock();
+	std::cout << "Segmenting and tagging " << sample_count << " samples x " << repeat << " ... ";
+	for (int r = 0; r < repeat; ++r)
+		for (int i = 0; i < sample_count; ++i)
+		{
+			const std::vector<WordInformation>& best = context.segment(texts[i], dict, 1).at(0).words;
+			words.assign(best.begin(), best.end());
+			tagger.tag(&words[0], words.size(), dict);
+		}
+	allocations = allocation_count - allocations;
+	std::cout << "OK (" << ms(tick) << " ms, " << allocations << " allocations)" << std::endl;
+
+	//	no allocation in steady state
+	BOOST_CHECK_EQUAL( allocations, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_Viterbi_max_plus_performance )
+{
+	//	the state spaces of POS tagging, and of the role tagging of the unknown words
+	const size_t state_counts[] = { WORD_TAG_SIZE, 16 };
+	const size_t outputs = 100;
+	const size_t steps = 100000;
+
+	srand(random_seed);
+	std::vector<size_t> obs(steps);
+	for (size_t i = 0; i < steps; ++i)
+		obs[i] = rand() % outputs;
+
+	enum SimdLevel previous = get_simd_level();
+	for (size_t n = 0; n < sizeof(state_counts) / sizeof(state_counts[0]); ++n)
+	{
+		size_t states = state_counts[n];
+		random_log_model<float> model(states, outputs);
+		const std::vector<float>& start_p = model.start_p;
+		const std::vector<float>& trans_p = model.trans_p;
+		const std::vector<float>& emit_p = model.emit_p;
+
+		ViterbiDecoder<float> decoder;
+		std::vector<size_t> path, expected_path;
+		for (int level = SIMD_NONE; level <= detect_simd_level(); ++level)
+		{
+			set_simd_level(static_cast<enum SimdLevel>(level));
+			clock_t tick = clock();
+			std::cout << "Viterbi of " << steps << " steps over " << states << " states at SIMD level " << level << " ... ";
+			decoder.decode(states, outputs, obs, start_p, trans_p, emit_p, path);
+			std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+			if (level == SIMD_NONE)
+				expected_path = path;
+			BOOST_CHECK( path == expected_path );
+		}
+	}
+	set_simd_level(previous);
+}
+
+BOOST_AUTO_TEST_CASE( test_Viterbi_batch_performance )
+{
+	//	many short sentences over the state space of POS tagging
+	const size_t states = WORD_TAG_SIZE;
+	const size_t outputs = 100;
+	const size_t sentences = 20000;
+
+	srand(random_seed);
+	std::vector<std::vector<size_t> > obs(sentences);
+	size_t total_steps = 0;
+	for (size_t i = 0; i < sentences; ++i)
+	{
+		size_t length = 5 + rand() % 36;
+		for (size_t t = 0; t < length; ++t)
+			obs[i].push_back(rand() % outputs);
+		total_steps += length;
+	}
+
+	random_log_model<float> model(states, outputs);
+	const std::vector<float>& start_p = model.start_p;
+	const std::vector<float>& trans_p = model.trans_p;
+	const std::vector<float>& emit_p = model.emit_p;
+	std::vector<double> start_prob(states), trans_prob(states * states), emit_prob(states * outputs);
+	for (size_t i = 0; i < start_p.size(); ++i)
+		start_prob[i] = std::exp(static_cast<double>(start_p[i]));
+	for (size_t i = 0; i < trans_p.size(); ++i)
+		trans_prob[i] = std::exp(static_cast<double>(trans_p[i]));
+	for (size_t i = 0; i < emit_p.size(); ++i)
+		emit_prob[i] = std::exp(static_cast<double>(emit_p[i]));
+
+	clock_t tick = clock();
+	std::cout << "forward_viterbi of " << sentences << " sentences (" << total_steps << " steps) ... ";
+	for (size_t i = 0; i < sentences; ++i)
+	{
+		viterbi_info<double> result;
+		forward_viterbi(states, outputs, obs[i], start_prob, trans_prob, emit_prob, result);
+	}
+	std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+	enum SimdLevel previous = get_simd_level();
+	for (int level = SIMD_NONE; level <= detect_simd_level(); ++level)
+	{
+		set_simd_level(static_cast<enum SimdLevel>(level));
+
+		ViterbiDecoder<float> single;
+		std::vector<std::vector<size_t> > paths(sentences);
+		tick = clock();
+		std::cout << "ViterbiDecoder of " << sentences << " sentences at SIMD level " << level << " ... ";
+		for (size_t i = 0; i < sentences; ++i)
+			single.decode(states, outputs, obs[i], start_p, trans_p, emit_p, paths[i]);
+		std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+		BatchViterbiDecoder<float> batch;
+		ViterbiBatch<float> result;
+		tick = clock();
+		std::cout << "BatchViterbiDecoder of " << sentences << " sentences at SIMD level " << level << " ... ";
+		batch.decode(states, outputs, obs, start_p, trans_p, emit_p, result);
+		std::cout << "OK (" << ms(tick) << " ms)" << std::endl;
+
+		BOOST_REQUIRE_EQUAL( result.size(), sentences );
+		for (size_t i = 0; i < sentences; ++i)
+			BOOST_CHECK( std::vector<size_t>(result.begin(i), result.end(i)) == paths[i] );
+	}
+	set_simd_level(previous);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 //	_OPENCLAS_UNIT_TEST_LONGTIME_HPP_
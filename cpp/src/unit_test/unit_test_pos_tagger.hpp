@@ -0,0 +1,145 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+
+#pragma once
+#ifndef _OPENCLAS_UNIT_TEST_POS_TAGGER_HPP_
+#define _OPENCLAS_UNIT_TEST_POS_TAGGER_HPP_
+
+#include <openclas/pos_tagger.hpp>
+#include <openclas/dictionary.hpp>
+#include <openclas/segment.hpp>
+#include <cmath>
+
+BOOST_AUTO_TEST_SUITE( pos_tagger )
+
+using namespace openclas;
+
+static WordInformation make_tagged_word(const Dictionary& dict, const std::wstring& word, enum WordTag tag = WORD_TAG_UNKNOWN)
+{
+	WordInformation info;
+	info.tag = tag;
+	info.entry_id = dict.get_word_id(word);
+	info.is_recorded = (info.entry_id != INVALID_WORD_ID);
+	return info;
+}
+
+BOOST_AUTO_TEST_CASE( test_PosTagger )
+{
+	Dictionary dict;
+	dict.init_tag_dict(WORD_TAG_SIZE);
+	dict.set_tag_total_weight(1000);
+	dict.add_tag_weight(WORD_TAG_R, 100);
+	dict.add_tag_weight(WORD_TAG_P, 100);
+	dict.add_tag_weight(WORD_TAG_Q, 100);
+	dict.add_tag_weight(WORD_TAG_M, 100);
+	dict.add_tag_weight(WORD_TAG_N, 100);
+	dict.add_tag_transit_weight(WORD_TAG_R, WORD_TAG_P, 80);
+	dict.add_tag_transit_weight(WORD_TAG_M, WORD_TAG_Q, 90);
+	dict.add_tag_transit_weight(WORD_TAG_P, WORD_TAG_N, 50);
+	dict.add_tag_transit_weight(WORD_TAG_Q, WORD_TAG_N, 50);
+
+	dict.add_word(L"我")->add(WORD_TAG_R, 50);
+	dict.add_word(L"一")->add(WORD_TAG_M, 50);
+	DictEntry* ba = dict.add_word(L"把");
+	ba->add(WORD_TAG_P, 40);
+	ba->add(WORD_TAG_Q, 20);
+	dict.add_word(L"书")->add(WORD_TAG_N, 30);
+
+	PosTagger tagger;
+	for (int i = 0; i < 2; ++i)
+	{
+		//	the same tags with and without the precomputed costs
+		if (i == 1)
+			dict.freeze();
+
+		//	"把" is a preposition after a pronoun
+		std::vector<WordInformation> words;
+		words.push_back(make_tagged_word(dict, L"", WORD_TAG_BEGIN));
+		words.push_back(make_tagged_word(dict, L"我"));
+		words.push_back(make_tagged_word(dict, L"把"));
+		words.push_back(make_tagged_word(dict, L"书"));
+		words.push_back(make_tagged_word(dict, L"", WORD_TAG_END));
+		tagger.tag(&words[0], words.size(), dict);
+		BOOST_CHECK_EQUAL( words[0].tag, WORD_TAG_BEGIN );
+		BOOST_CHECK_EQUAL( words[1].tag, WORD_TAG_R );
+		BOOST_CHECK_EQUAL( words[2].tag, WORD_TAG_P );
+		BOOST_CHECK_EQUAL( words[3].tag, WORD_TAG_N );
+		BOOST_CHECK_EQUAL( words[4].tag, WORD_TAG_END );
+
+		//	but a measure word after a numeral
+		words[1] = make_tagged_word(dict, L"一");
+		tagger.tag(&words[0], words.size(), dict);
+		BOOST_CHECK_EQUAL( words[1].tag, WORD_TAG_M );
+		BOOST_CHECK_EQUAL( words[2].tag, WORD_TAG_Q );
+
+		//	an unrecorded word keeps its tag
+		words[1] = make_tagged_word(dict, L"", WORD_TAG_NX);
+		tagger.tag(&words[0], words.size(), dict);
+		BOOST_CHECK_EQUAL( words[1].tag, WORD_TAG_NX );
+	}
+
+	//	the precomputed costs are the same as the ones on the fly
+	BOOST_CHECK( dict.has_scores() );
+	size_t id = dict.get_word_id(L"把");
+	BOOST_CHECK_CLOSE( dict.get_word_tag_cost(id, 1), calculate_tag_cost(20, 100, WORD_TAG_SIZE), 1e-10 );
+	BOOST_CHECK_CLOSE( dict.get_word_tag_cost(id, 1), - std::log(21. / (100 + WORD_TAG_SIZE)), 1e-10 );
+	BOOST_CHECK_CLOSE( dict.get_tag_transit_cost(WORD_TAG_M, WORD_TAG_Q), calculate_tag_transit_cost(90, 100, 100, 1000, 0.1), 1e-10 );
+	dict.add_tag_transit_weight(WORD_TAG_M, WORD_TAG_Q, 10);
+	BOOST_CHECK( !dict.has_scores() );
+	BOOST_CHECK_CLOSE( dict.get_tag_transit_cost(WORD_TAG_M, WORD_TAG_Q), calculate_tag_transit_cost(10, 100, 100, 1000, 0.1), 1e-10 );
+
+	//	a tag without weight has no negative cost
+	dict.get_word(L"书")->add(WORD_TAG_V, 30);
+	dict.build_scores();
+	size_t shu = dict.get_word_id(L"书");
+	BOOST_CHECK_EQUAL( dict.get_tag_weight(WORD_TAG_V), 0 );
+	BOOST_CHECK( dict.get_word_tag_cost(shu, 1) > 0 );
+	BOOST_CHECK_CLOSE( dict.get_word_tag_cost(shu, 1), calculate_tag_cost(30, 0, WORD_TAG_SIZE), 1e-10 );
+	BOOST_CHECK( calculate_tag_cost(1000, 0, WORD_TAG_SIZE) >= 0 );
+	BOOST_CHECK( calculate_tag_cost(0, 0, 0) >= 0 );
+
+	//	so "书" is still a noun after "把"
+	std::vector<WordInformation> words;
+	words.push_back(make_tagged_word(dict, L"", WORD_TAG_BEGIN));
+	words.push_back(make_tagged_word(dict, L"我"));
+	words.push_back(make_tagged_word(dict, L"把"));
+	words.push_back(make_tagged_word(dict, L"书"));
+	words.push_back(make_tagged_word(dict, L"", WORD_TAG_END));
+	tagger.tag(&words[0], words.size(), dict);
+	BOOST_CHECK_EQUAL( words[3].tag, WORD_TAG_N );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_PosTagger_segment, mini_dictionary_fixture )
+{
+	dict.freeze();
+
+	//	every recorded word gets one of the tags of its entry
+	PosTagger tagger;
+	for (int i = 0; i < sample_count; ++i)
+	{
+		std::vector<Segment::segment_type> segs = Segment::segment(sample[i], dict, 1);
+		tagger.tag(segs, dict);
+		const std::vector<WordInformation>& words = segs[0].words;
+		for (size_t w = 0; w < words.size(); ++w)
+		{
+			if (!words[w].is_recorded || words[w].entry_id == INVALID_WORD_ID)
+				continue;
+			Dictionary::tag_range_type tags = dict.get_word_tags(words[w].entry_id);
+			if (tags.first == tags.second)
+				continue;
+			bool found = false;
+			for (const TagEntry* tag = tags.first; tag != tags.second; ++tag)
+				found = found || (tag->tag == words[w].tag);
+			BOOST_CHECK( found );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//	_OPENCLAS_UNIT_TEST_POS_TAGGER_HPP_
+#endif
@@ -29,139 +29,598 @@ void test_segment(std::wofstream& out, Dictionary& dict, int k, const std::wstri
 	out << std::endl;
 }
 
-BOOST_AUTO_TEST_CASE( test_Segment_create_empty )
+//	the 3 best segmentations of sample[3] by the mini dictionary
+static const double sample3_weights[] = {136420, 136427, 136429};
+static const wchar_t* sample3_segmentations[] = {
+	L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月份/n 大会/n 上/ 说/ 的/ 确实/ 在理/a 。/w",
+	L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月份/n 大/ 会上/ 说/ 的/ 确实/ 在理/a 。/w",
+	L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月/ 份/ 大会/n 上/ 说/ 的/ 确实/ 在理/a 。/w"
+};
+
+void check_sample3_segmentations(const std::vector<Segment::segment_type>& segs, size_t k)
 {
-    Dictionary dict;
-	load_from_txt_file(dict, mini_dict_base_name, true);
+	BOOST_REQUIRE_EQUAL( segs.size(), k );
+	for (size_t i = 0; i < k; ++i)
+	{
+		BOOST_CHECK_CLOSE( segs[i].weight, sample3_weights[i], 0.001 );
+		BOOST_CHECK( Segment::segment_to_string(sample[3], segs[i]) == sample3_segmentations[i] );
+	}
+}
 
+BOOST_FIXTURE_TEST_CASE( test_Segment_create_empty, mini_dictionary_fixture )
+{
 	const wchar_t* empty_text = L"";
 	Segment::graph_list_type empty_graph_list = Segment::create_graphs(empty_text, dict);
 	BOOST_CHECK_EQUAL( empty_graph_list.size(), 0 );
 }
 
-BOOST_AUTO_TEST_CASE( test_Segment_create_english_string )
+BOOST_FIXTURE_TEST_CASE( test_Segment_create_english_string, mini_dictionary_fixture )
 {
-    Dictionary dict;
-	load_from_txt_file(dict, mini_dict_base_name, true);
-
 	const wchar_t* text = L"English Words";
 	Segment::graph_list_type graph_list = Segment::create_graphs(text, dict);
 	BOOST_REQUIRE_EQUAL( graph_list.size(), 1 );
-	WordGraph& graph = *graph_list.at(0);
-	BOOST_REQUIRE_EQUAL( num_vertices(graph), 5 );
-
-	property_map<WordGraph, vertex_desc_t>::type vprop_map = get(vertex_desc, graph);
+	const WordLattice& graph = graph_list.at(0);
+	BOOST_REQUIRE_EQUAL( graph.node_count(), 5 );
 
-	BOOST_CHECK_EQUAL( vprop_map[0].tag, WORD_TAG_BEGIN );
-	BOOST_CHECK_EQUAL( vprop_map[1].tag, WORD_TAG_NX );
-	BOOST_CHECK_EQUAL( vprop_map[1].offset, 0 );
-	BOOST_CHECK_EQUAL( vprop_map[1].length, 7 );
-	BOOST_CHECK_EQUAL( vprop_map[2].tag, WORD_TAG_W );
-	BOOST_CHECK_EQUAL( vprop_map[2].offset, 7 );
-	BOOST_CHECK_EQUAL( vprop_map[2].length, 1 );
-	BOOST_CHECK_EQUAL( vprop_map[3].tag, WORD_TAG_NX );
-	BOOST_CHECK_EQUAL( vprop_map[3].offset, 8 );
-	BOOST_CHECK_EQUAL( vprop_map[3].length, 5 );
-	BOOST_CHECK_EQUAL( vprop_map[4].tag, WORD_TAG_END );
-	BOOST_CHECK_EQUAL( vprop_map[4].offset, 13 );
+	BOOST_CHECK_EQUAL( graph[0].tag, WORD_TAG_BEGIN );
+	BOOST_CHECK_EQUAL( graph[1].tag, WORD_TAG_NX );
+	BOOST_CHECK_EQUAL( graph[1].offset, 0 );
+	BOOST_CHECK_EQUAL( graph[1].length, 7 );
+	BOOST_CHECK_EQUAL( graph[2].tag, WORD_TAG_W );
+	BOOST_CHECK_EQUAL( graph[2].offset, 7 );
+	BOOST_CHECK_EQUAL( graph[2].length, 1 );
+	BOOST_CHECK_EQUAL( graph[3].tag, WORD_TAG_NX );
+	BOOST_CHECK_EQUAL( graph[3].offset, 8 );
+	BOOST_CHECK_EQUAL( graph[3].length, 5 );
+	BOOST_CHECK_EQUAL( graph[4].tag, WORD_TAG_END );
+	BOOST_CHECK_EQUAL( graph[4].offset, 13 );
 }
 
-BOOST_AUTO_TEST_CASE( test_Segment_create_single_sentence )
+BOOST_FIXTURE_TEST_CASE( test_Segment_create_single_sentence, mini_dictionary_fixture )
 {
-    Dictionary dict;
-	load_from_txt_file(dict, mini_dict_base_name, true);
-
 	const wchar_t* text = L"19９5年底ｇoｏgｌｅ在1月份大会上说的确实在理。";
-	property_map<WordGraph, vertex_desc_t>::type vprop_map;
-	graph_property<WordGraph, graph_terminal_t>::type gterminal;
-
 	Segment::graph_list_type graph_list = Segment::create_graphs(text, dict);
 	BOOST_REQUIRE_EQUAL( graph_list.size(), 3 );
 
 	//	"19９5年底ｇoｏgｌｅ在1"
-	WordGraph& graph = *graph_list.at(0);
-	vprop_map = get(vertex_desc, graph);
-	gterminal = get_property(graph, graph_terminal);
+	const WordLattice& graph = graph_list.at(0);
 
-	BOOST_REQUIRE_EQUAL( num_vertices(graph), 8 );
+	BOOST_REQUIRE_EQUAL( graph.node_count(), 8 );
 	//	[Begin]
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].tag, WORD_TAG_BEGIN );
+	BOOST_CHECK_EQUAL( graph[graph.terminal().first].tag, WORD_TAG_BEGIN );
 	//	"19９5"
-	BOOST_CHECK_EQUAL( vprop_map[1].tag, WORD_TAG_M );
-	BOOST_CHECK_EQUAL( vprop_map[1].offset, 0 );
-	BOOST_CHECK_EQUAL( vprop_map[1].length, 4 );
+	BOOST_CHECK_EQUAL( graph[1].tag, WORD_TAG_M );
+	BOOST_CHECK_EQUAL( graph[1].offset, 0 );
+	BOOST_CHECK_EQUAL( graph[1].length, 4 );
 	//	"年"
-	BOOST_CHECK_EQUAL( vprop_map[2].tag, WORD_TAG_UNKNOWN );
-	BOOST_CHECK_EQUAL( vprop_map[2].offset, 4 );
-	BOOST_CHECK_EQUAL( vprop_map[2].length, 1 );
+	BOOST_CHECK_EQUAL( graph[2].tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( graph[2].offset, 4 );
+	BOOST_CHECK_EQUAL( graph[2].length, 1 );
 	//	"1"
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].tag, WORD_TAG_M );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].offset, 13 );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].length, 1 );
+	BOOST_CHECK_EQUAL( graph[graph.terminal().second].tag, WORD_TAG_M );
+	BOOST_CHECK_EQUAL( graph[graph.terminal().second].offset, 13 );
+	BOOST_CHECK_EQUAL( graph[graph.terminal().second].length, 1 );
 
 	//	"1月份大会上说"
-	graph = *graph_list.at(1);
-	vprop_map = get(vertex_desc, graph);
-	gterminal = get_property(graph, graph_terminal);
-	BOOST_REQUIRE_EQUAL( num_vertices(graph), 10 );
+	const WordLattice& graph1 = graph_list.at(1);
+	BOOST_REQUIRE_EQUAL( graph1.node_count(), 10 );
 	//	"1"
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].tag, WORD_TAG_M );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].offset, 13 );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].length, 1 );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().first].tag, WORD_TAG_M );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().first].offset, 13 );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().first].length, 1 );
 	//	"月"
-	BOOST_CHECK_EQUAL( vprop_map[1].tag, WORD_TAG_UNKNOWN );
-	BOOST_CHECK_EQUAL( vprop_map[1].offset, 14 );
-	BOOST_CHECK_EQUAL( vprop_map[1].length, 1 );
+	BOOST_CHECK_EQUAL( graph1[1].tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( graph1[1].offset, 14 );
+	BOOST_CHECK_EQUAL( graph1[1].length, 1 );
 	//	"说"
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].tag, WORD_TAG_UNKNOWN );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].offset, 19 );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].length, 1 );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().second].tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().second].offset, 19 );
+	BOOST_CHECK_EQUAL( graph1[graph1.terminal().second].length, 1 );
 
 	//	"说的确实在理。"
-	graph = *graph_list.at(2);
-	vprop_map = get(vertex_desc, graph);
-	gterminal = get_property(graph, graph_terminal);
-	BOOST_REQUIRE_EQUAL( num_vertices(graph), 12 );
+	const WordLattice& graph2 = graph_list.at(2);
+	BOOST_REQUIRE_EQUAL( graph2.node_count(), 12 );
 	//	"说"
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].tag, WORD_TAG_UNKNOWN );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].offset, 19 );
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.first].length, 1 );
+	BOOST_CHECK_EQUAL( graph2[graph2.terminal().first].tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( graph2[graph2.terminal().first].offset, 19 );
+	BOOST_CHECK_EQUAL( graph2[graph2.terminal().first].length, 1 );
 	//	"的"
-	BOOST_CHECK_EQUAL( vprop_map[1].tag, WORD_TAG_UNKNOWN );
-	BOOST_CHECK_EQUAL( vprop_map[1].offset, 20 );
-	BOOST_CHECK_EQUAL( vprop_map[1].length, 1 );
+	BOOST_CHECK_EQUAL( graph2[1].tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( graph2[1].offset, 20 );
+	BOOST_CHECK_EQUAL( graph2[1].length, 1 );
 	//	[End]
-	BOOST_CHECK_EQUAL( vprop_map[gterminal.second].tag, WORD_TAG_END );
+	BOOST_CHECK_EQUAL( graph2[graph2.terminal().second].tag, WORD_TAG_END );
 
 	/***************************************************************
 	 *
 	 *		Test segment(graphs, k) and segment_to_string()
 	 *
 	 ***************************************************************/
-	std::vector<Segment::segment_type> segs = Segment::segment(text, dict, 3);
-	BOOST_REQUIRE_EQUAL( segs.size(), 3 );
-
-	const double weights[] = {136420, 136427, 136429};
-	const wchar_t* seg_correct[] = {
-		L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月份/n 大会/n 上/ 说/ 的/ 确实/ 在理/a 。/w",
-		L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月份/n 大/ 会上/ 说/ 的/ 确实/ 在理/a 。/w",
-		L"19９5/m 年底/ ｇoｏgｌｅ/nx 在/ 1/m 月/ 份/ 大会/n 上/ 说/ 的/ 确实/ 在理/a 。/w"
-	};
+	check_sample3_segmentations(Segment::segment(text, dict, 3), 3);
+}
 
+BOOST_FIXTURE_TEST_CASE( test_Segment_lattice_to_graph, mini_dictionary_fixture )
+{
+	const wchar_t* text = L"19９5年底ｇoｏgｌｅ在1月份大会上说的确实在理。";
+	Segment::graph_list_type graph_list = Segment::create_graphs(text, dict);
+	for (size_t i = 0; i < graph_list.size(); ++i)
+	{
+		WordLattice& lattice = graph_list[i];
+		WordGraph graph;
+		lattice_to_graph(lattice, graph);
+		BOOST_REQUIRE_EQUAL( num_vertices(graph), lattice.node_count() );
+		BOOST_CHECK_EQUAL( num_edges(graph), lattice.edge_count() );
+
+		graph_property<WordGraph, graph_terminal_t>::type gterminal = get_property(graph, graph_terminal);
+		BOOST_CHECK_EQUAL( gterminal.first, lattice.terminal().first );
+		BOOST_CHECK_EQUAL( gterminal.second, lattice.terminal().second );
+
+		property_map<WordGraph, vertex_desc_t>::type vprop_map = get(vertex_desc, graph);
+		for (size_t v = 0; v < lattice.node_count(); ++v)
+			BOOST_CHECK( vprop_map[v] == lattice[v].to_word_information(v) );
+
+		//	the boost graph algorithms give the same paths
+		std::vector<path_type> expected, result;
+		dag_k_shortest_paths(graph, gterminal.first, gterminal.second, expected, 3);
+		dag_k_shortest_paths(lattice, gterminal.first, gterminal.second, result, 3);
+		BOOST_REQUIRE_EQUAL( result.size(), expected.size() );
+		for (size_t j = 0; j < result.size(); ++j)
+		{
+			BOOST_CHECK_CLOSE( result[j].weight, expected[j].weight, 0.00001 );
+			BOOST_CHECK( result[j].nodelist == expected[j].nodelist );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_Segment_overall_k_shortest_path )
+{
+	//	3 sub-graphs, the weights of the sorted paths
+	const double weights[3][4] = {
+		{1, 2, 6, 9},
+		{0, 0.5, 3, 3},
+		{2, 2, 7, 8}
+	};
+	std::vector<std::vector<path_type> > lists(3);
 	for (size_t i = 0; i < 3; ++i)
 	{
-		BOOST_CHECK_CLOSE( segs[i].weight, weights[i], 0.001 );
-		std::wstring seg_text = Segment::segment_to_string(text, segs[i]);
-		BOOST_CHECK( seg_text == seg_correct[i] );
+		for (size_t j = 0; j < 4; ++j)
+		{
+			path_type path;
+			path.weight = weights[i][j];
+			path.nodelist.push_back(i);
+			path.nodelist.push_back(j);
+			lists[i].push_back(path);
+		}
+	}
+
+	//	all the 64 sums
+	std::vector<double> all_sums;
+	for (size_t a = 0; a < 4; ++a)
+		for (size_t b = 0; b < 4; ++b)
+			for (size_t c = 0; c < 4; ++c)
+				all_sums.push_back(weights[0][a] + weights[1][b] + weights[2][c]);
+	std::sort(all_sums.begin(), all_sums.end());
+
+	for (int k = 1; k <= 70; ++k)
+	{
+		std::vector<std::vector<path_type> > overall = Segment::get_overall_k_shortest_path(lists, k);
+		BOOST_REQUIRE_EQUAL( overall.size(), std::min<size_t>(k, all_sums.size()) );
+		for (size_t r = 0; r < overall.size(); ++r)
+		{
+			BOOST_REQUIRE_EQUAL( overall[r].size(), 3 );
+			double sum = 0;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				BOOST_CHECK_EQUAL( overall[r][i].nodelist[0], i );
+				sum += overall[r][i].weight;
+			}
+			BOOST_CHECK_CLOSE( sum, all_sums[r], 0.00001 );
+			//	no duplicated combination
+			for (size_t q = 0; q < r; ++q)
+			{
+				bool same = true;
+				for (size_t i = 0; i < 3; ++i)
+					same = same && overall[q][i].nodelist == overall[r][i].nodelist;
+				BOOST_CHECK( !same );
+			}
+		}
 	}
+
+	//	a sub-graph without path
+	lists[1].clear();
+	BOOST_CHECK( Segment::get_overall_k_shortest_path(lists, 3).empty() );
+	//	no sub-graph, the empty text
+	lists.clear();
+	BOOST_CHECK_EQUAL( Segment::get_overall_k_shortest_path(lists, 3).size(), 1 );
 }
 
-BOOST_AUTO_TEST_CASE( test_Segment_segment_single_sentence )
+BOOST_AUTO_TEST_CASE( test_Segment_WordNode )
 {
-    Dictionary dict;
-	
-	load_from_txt_file(dict, mini_dict_base_name, true);
+	BOOST_CHECK_EQUAL( sizeof(WordNode), 24 );
+
+	WordNode node;
+	WordInformation word = node.to_word_information(3);
+	BOOST_CHECK_EQUAL( word.tag, WORD_TAG_UNKNOWN );
+	BOOST_CHECK_EQUAL( word.entry_id, INVALID_WORD_ID );
+	BOOST_CHECK_EQUAL( word.index, 3 );
+
+	node.offset = 7;
+	node.length = 2;
+	node.tag = WORD_TAG_NS;
+	node.is_recorded = true;
+	//	above 2^24, where a float is no longer exact
+	node.weight = 16777217;
+	node.entry_id = 42;
+	word = node.to_word_information(5);
+	BOOST_CHECK_EQUAL( word.offset, 7 );
+	BOOST_CHECK_EQUAL( word.length, 2 );
+	BOOST_CHECK_EQUAL( word.tag, WORD_TAG_NS );
+	BOOST_CHECK( word.is_recorded );
+	BOOST_CHECK_EQUAL( word.weight, 16777217 );
+	BOOST_CHECK_EQUAL( word.entry_id, 42 );
+	BOOST_CHECK_EQUAL( word.index, 5 );
+	BOOST_CHECK( WordSpan(node) == WordSpan(word) );
+}
+
+BOOST_AUTO_TEST_CASE( test_Segment_out_table )
+{
+	OutTable table;
+	table.reset(6);
+	BOOST_CHECK_EQUAL( table.length(), 6 );
+	table.mark(0);
+	table.mark(2);
+	table.mark(5);
+	BOOST_CHECK( table.is_marked(2) );
+	BOOST_CHECK( !table.is_marked(3) );
+	BOOST_CHECK( !table.is_marked(6) );
+	BOOST_CHECK_EQUAL( table.next(0), 2 );
+	BOOST_CHECK_EQUAL( table.next(2), 5 );
+	BOOST_CHECK_EQUAL( table.next(5), 6 );
+
+	WordNode word;
+	word.offset = 0;
+	word.length = 2;
+	table.push_back(word);
+	word.length = 5;
+	table.push_back(word);
+	word.offset = 2;
+	word.length = 3;
+	table.push_back(word);
+
+	BOOST_CHECK_EQUAL( table.size(0), 2 );
+	BOOST_CHECK_EQUAL( table.size(2), 1 );
+	BOOST_CHECK_EQUAL( table.size(3), 0 );
+	BOOST_CHECK_EQUAL( table.size(5), 0 );
+	BOOST_CHECK_EQUAL( table.begin(0)[1].length, 5 );
+	BOOST_CHECK_EQUAL( table.begin(2)->length, 3 );
+	BOOST_CHECK( table.begin(5) == table.end(5) );
+
+	//	the words of an offset should be added together
+	word.offset = 0;
+	BOOST_CHECK_THROW( table.push_back(word), std::logic_error );
+
+	table.reset(2);
+	BOOST_CHECK_EQUAL( table.length(), 2 );
+	BOOST_CHECK( !table.is_marked(0) );
+	BOOST_CHECK_EQUAL( table.size(0), 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_context, mini_dictionary_fixture )
+{
+	//	one context for all the samples and k, and a context releasing the buffers every time
+	SegmenterContext context;
+	SegmenterContext releasing_context(0);
+	BOOST_CHECK_EQUAL( releasing_context.max_reused_length(), 0 );
+	for (int round = 0; round < 2; ++round)
+	{
+		for (int k = 1; k <= 5; k += 2)
+		{
+			for (int i = 0; i < sample_count; ++i)
+			{
+				const std::vector<Segment::segment_type>& result = context.segment(sample[i], dict, k);
+				const std::vector<Segment::segment_type>& released = releasing_context.segment(sample[i], dict, k);
+
+				//	the reused buffers don't change the result
+				BOOST_REQUIRE_EQUAL( released.size(), result.size() );
+				for (size_t j = 0; j < result.size(); ++j)
+				{
+					BOOST_CHECK_CLOSE( released[j].weight + 1, result[j].weight + 1, 0.00001 );
+					BOOST_CHECK( Segment::segment_to_string(sample[i], released[j]) == Segment::segment_to_string(sample[i], result[j]) );
+				}
+			}
+			//	the context is used by all the samples before
+			if (k <= 3)
+			{
+				check_sample3_segmentations(context.segment(sample[3], dict, k), k);
+				check_sample3_segmentations(releasing_context.segment(sample[3], dict, k), k);
+			}
+		}
+	}
+
+	//	sub-graphs from outside
+	Segment::graph_list_type graphs = Segment::create_graphs(sample[3], dict);
+	check_sample3_segmentations(context.segment(graphs, 3), 3);
+
+	BOOST_CHECK( context.segment(sample[3], dict, 0).empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_simd_level, mini_dictionary_fixture )
+{
+	const wchar_t* texts[] = {
+		L"http://www.example.com/index.html?id=20100101&page=12345678901234567890",
+		L"型号ABC1234XYZ的iPhone和Windows7在2010年上市",
+		L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789",
+		L"a1b2c3d4e5f6g7h8i9j0 English Words 中文English中文12345中文",
+		L"19９5年底ｇoｏgｌｅ在1月份大会上说的确实在理。"
+	};
+	const int text_count = sizeof(texts) / sizeof(texts[0]);
+
+	//	the segmentations with the scalar code are the expected ones
+	enum SimdLevel previous = set_simd_level(SIMD_NONE);
+	std::vector<std::vector<Segment::segment_type> > expected;
+	for (int i = 0; i < text_count; ++i)
+		expected.push_back(Segment::segment(texts[i], dict, 3));
+
+	for (int level = SIMD_SSE2; level <= detect_simd_level(); ++level)
+	{
+		set_simd_level(static_cast<enum SimdLevel>(level));
+		for (int i = 0; i < text_count; ++i)
+		{
+			std::vector<Segment::segment_type> segs = Segment::segment(texts[i], dict, 3);
+			BOOST_REQUIRE_EQUAL( segs.size(), expected[i].size() );
+			for (size_t j = 0; j < segs.size(); ++j)
+				BOOST_CHECK( Segment::segment_to_string(texts[i], segs[j]) == Segment::segment_to_string(texts[i], expected[i][j]) );
+		}
+	}
+	set_simd_level(previous);
 
+	//	a run of ASCII letters or digits is one atom
+	std::vector<Segment::segment_type> segs = Segment::segment(texts[2], dict, 1);
+	BOOST_REQUIRE_EQUAL( segs.size(), 1 );
+	BOOST_CHECK( Segment::segment_to_string(texts[2], segs[0]) == L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ/nx 0123456789/m" );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_utf8, mini_dictionary_fixture )
+{
+	//	the UTF-8 segmentations are the same as the wide ones, with the offsets in bytes
+	SegmenterContext context;
+	for (int k = 1; k <= 3; k += 2)
+	{
+		for (int i = 0; i < sample_count; ++i)
+		{
+			std::wstring text(sample[i]);
+			std::string utf8 = encode_utf8(text);
+			std::vector<Segment::segment_type> expected = Segment::segment(text, dict, k);
+			const std::vector<Segment::segment_type>& result = context.segment_utf8(utf8, dict, k);
+
+			BOOST_REQUIRE_EQUAL( result.size(), expected.size() );
+			for (size_t j = 0; j < expected.size(); ++j)
+			{
+				BOOST_CHECK_CLOSE( result[j].weight + 1, expected[j].weight + 1, 0.00001 );
+				BOOST_REQUIRE_EQUAL( result[j].words.size(), expected[j].words.size() );
+				for (size_t n = 0; n < expected[j].words.size(); ++n)
+				{
+					const WordInformation& word = result[j].words[n];
+					BOOST_CHECK_EQUAL( word.offset, expected[j].words[n].offset );
+					BOOST_CHECK_EQUAL( word.length, expected[j].words[n].length );
+					BOOST_CHECK_EQUAL( word.tag, expected[j].words[n].tag );
+					BOOST_CHECK( utf8.substr(word.byte_offset, word.byte_length) == encode_utf8(text.substr(word.offset, word.length)) );
+				}
+			}
+		}
+	}
+
+	//	an invalid byte is a symbol by itself
+	std::string broken = encode_utf8(L"他说") + "\xff" + encode_utf8(L"的确实在理");
+	std::vector<Segment::segment_type> segs = Segment::segment_utf8(broken, dict, 1);
+	BOOST_REQUIRE_EQUAL( segs.size(), 1 );
+	const std::vector<WordInformation>& words = segs[0].words;
+	const WordInformation& last = words.back();
+	BOOST_CHECK_EQUAL( last.offset + last.length, 8 );
+	BOOST_CHECK_EQUAL( last.byte_offset + last.byte_length, broken.size() );
+
+	BOOST_CHECK_EQUAL( Segment::segment_utf8("", dict, 1).size(), 1 );
+}
+
+struct token_recorder {
+	std::vector<WordInformation> words;
+	std::string text;
+	void operator() (const WordInformation& word, const char* bytes)
+	{
+		words.push_back(word);
+		text.append(bytes, word.byte_length);
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_stream, mini_dictionary_fixture )
+{
+	std::wstring wide = join_samples(L"\n");
+	std::string content = encode_utf8(wide) + "\xff" + encode_utf8(L"𠀀English");
+
+	//	a chunk large enough for the whole stream is the same as segment_utf8()
+	SegmenterContext context;
+	std::vector<Segment::segment_type> expected = Segment::segment_utf8(content, dict, 1);
+	std::istringstream whole_stream(content);
+	token_recorder whole;
+	size_t count = context.segment_stream(whole_stream, dict, whole, content.size() + 1);
+	BOOST_CHECK_EQUAL( count, whole.words.size() );
+	BOOST_REQUIRE_EQUAL( whole.words.size(), expected[0].words.size() - 1 );
+	for (size_t i = 0; i < whole.words.size(); ++i)
+		BOOST_CHECK( whole.words[i] == expected[0].words[i + 1] );
+
+	//	the words of small chunks still cover the stream in order, in both symbols and bytes
+	for (size_t chunk_size = 1; chunk_size <= 64; chunk_size = chunk_size * 2 + 1)
+	{
+		std::istringstream in(content);
+		token_recorder recorder;
+		context.segment_stream(in, dict, recorder, chunk_size);
+		BOOST_CHECK( recorder.text == content );
+
+		size_t offset = 0, byte_offset = 0;
+		for (size_t i = 0; i < recorder.words.size(); ++i)
+		{
+			const WordInformation& word = recorder.words[i];
+			BOOST_CHECK_EQUAL( word.offset, offset );
+			BOOST_CHECK_EQUAL( word.byte_offset, byte_offset );
+			offset += word.length;
+			byte_offset += word.byte_length;
+		}
+		BOOST_CHECK_EQUAL( offset, whole.words.back().offset + whole.words.back().length );
+	}
+
+	//	the chunk is cut after the line breaks, so the lines are segmented one by one
+	std::istringstream line_stream(content);
+	token_recorder lines;
+	context.segment_stream(line_stream, dict, lines, encode_utf8(sample[3]).size() + 1);
+	std::string line = encode_utf8(std::wstring(sample[3]) + L"\n");
+	std::vector<Segment::segment_type> line_expected = Segment::segment_utf8(line, dict, 1);
+	size_t line_begin = encode_utf8(std::wstring(sample[0]) + L"\n" + sample[1] + L"\n" + sample[2] + L"\n").size();
+	size_t n = 0;
+	while (n < lines.words.size() && lines.words[n].byte_offset < line_begin)
+		++n;
+	BOOST_REQUIRE( n + line_expected[0].words.size() - 1 <= lines.words.size() );
+	for (size_t i = 1; i < line_expected[0].words.size(); ++i, ++n)
+	{
+		BOOST_CHECK_EQUAL( lines.words[n].byte_offset, line_begin + line_expected[0].words[i].byte_offset );
+		BOOST_CHECK_EQUAL( lines.words[n].tag, line_expected[0].words[i].tag );
+	}
+
+	//	empty stream
+	std::istringstream empty_stream("");
+	token_recorder empty;
+	BOOST_CHECK_EQUAL( context.segment_stream(empty_stream, dict, empty), 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_parallel, mini_dictionary_fixture )
+{
+	//	long enough to be segmented in parallel, and the short samples are segmented sequentially
+	std::wstring text = repeat_to_size(join_samples(), SegmenterContext::MIN_PARALLEL_LENGTH * 4);
+	std::vector<std::wstring> texts(sample, sample + sample_count);
+	texts.push_back(text);
+
+	ThreadPool pool(4);
+	SegmenterContext sequential;
+	SegmenterContext parallel;
+	parallel.set_thread_pool(&pool);
+	BOOST_CHECK( parallel.thread_pool() == &pool );
+	for (int k = 1; k <= 3; k += 2)
+	{
+		for (size_t i = 0; i < texts.size(); ++i)
+		{
+			std::vector<Segment::segment_type> expected = sequential.segment(texts[i], dict, k);
+			const std::vector<Segment::segment_type>& result = parallel.segment(texts[i], dict, k);
+			BOOST_REQUIRE_EQUAL( result.size(), expected.size() );
+			for (size_t j = 0; j < expected.size(); ++j)
+			{
+				BOOST_CHECK_EQUAL( result[j].weight, expected[j].weight );
+				BOOST_CHECK( result[j].words == expected[j].words );
+			}
+		}
+	}
+
+	//	UTF-8 text, and the sub-graphs from outside
+	std::string utf8 = encode_utf8(text);
+	std::vector<Segment::segment_type> expected = sequential.segment_utf8(utf8, dict, 1);
+	BOOST_CHECK( parallel.segment_utf8(utf8, dict, 1)[0].words == expected[0].words );
+
+	Segment::graph_list_type graphs = Segment::create_graphs(text, dict);
+	expected = sequential.segment(graphs, 3);
+	const std::vector<Segment::segment_type>& result = parallel.segment(graphs, 3);
+	BOOST_REQUIRE_EQUAL( result.size(), expected.size() );
+	for (size_t j = 0; j < expected.size(); ++j)
+		BOOST_CHECK( result[j].words == expected[j].words );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_batch, mini_dictionary_fixture )
+{
+	//	short queries cut from the samples, and an empty one
+	std::vector<std::wstring> queries;
+	for (size_t length = 5; length <= 20; length += 2)
+	{
+		for (int i = 0; i < sample_count; ++i)
+			queries.push_back(std::wstring(sample[i]).substr(0, length));
+	}
+	queries.push_back(L"");
+
+	ThreadPool pool(4);
+	SegmenterContext context;
+	SegmenterContext parallel;
+	parallel.set_thread_pool(&pool);
+	BOOST_REQUIRE( queries.size() >= SegmenterContext::MIN_PARALLEL_BATCH );
+	for (int round = 0; round < 2; ++round)
+	{
+		SegmentBatch batch = context.segment_batch(queries, dict);
+		const SegmentBatch& parallel_batch = parallel.segment_batch(queries, dict);
+		BOOST_REQUIRE_EQUAL( batch.size(), queries.size() );
+		BOOST_CHECK( parallel_batch.words == batch.words );
+		BOOST_CHECK( parallel_batch.offsets == batch.offsets );
+
+		for (size_t i = 0; i < queries.size(); ++i)
+		{
+			std::vector<Segment::segment_type> segs = Segment::segment(queries[i], dict, 1);
+			std::vector<WordInformation> expected;
+			for (size_t j = 0; j < segs[0].words.size(); ++j)
+			{
+				if (segs[0].words[j].tag != WORD_TAG_BEGIN && segs[0].words[j].tag != WORD_TAG_END)
+					expected.push_back(segs[0].words[j]);
+			}
+			BOOST_REQUIRE_EQUAL( static_cast<size_t>(batch.end(i) - batch.begin(i)), expected.size() );
+			BOOST_CHECK( std::equal(batch.begin(i), batch.end(i), expected.begin()) );
+		}
+		BOOST_CHECK( batch.begin(queries.size() - 1) == batch.end(queries.size() - 1) );
+	}
+
+	//	empty batch
+	BOOST_CHECK_EQUAL( context.segment_batch(0, 0, dict).size(), 0 );
+	BOOST_CHECK( context.segment_batch(0, 0, dict).words.empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_format_utf8, mini_dictionary_fixture )
+{
+	for (int i = 0; i < sample_count; ++i)
+	{
+		std::wstring text(sample[i]);
+		std::vector<Segment::segment_type> segs = Segment::segment(text, dict, 3);
+		for (size_t j = 0; j < segs.size(); ++j)
+		{
+			std::string expected = encode_utf8(Segment::segment_to_string(text, segs[j]));
+			std::string out("prefix");
+			Segment::format_utf8(text, segs[j], out);
+			BOOST_CHECK( out == "prefix" + expected );
+
+			//	the spans are formatted the same
+			std::vector<WordSpan> spans;
+			Segment::get_spans(segs[j], spans);
+			if (text.empty())
+			{
+				BOOST_CHECK( spans.empty() && expected.empty() );
+				continue;
+			}
+			BOOST_REQUIRE_EQUAL( spans.size(), segs[j].words.size() - 1 );
+			BOOST_CHECK( spans[0] == WordSpan(segs[j].words[1]) );
+			std::vector<char> buffer(expected.size());
+			BOOST_CHECK_EQUAL( Segment::format_utf8(text.data(), &spans[0], spans.size(), &buffer[0], buffer.size()), expected.size() );
+			BOOST_CHECK( std::string(buffer.begin(), buffer.end()) == expected );
+
+			//	a small buffer gets the beginning of the output, and the whole size
+			for (size_t size = 0; size < expected.size(); size += 7)
+			{
+				std::vector<char> small(size + 1, '#');
+				BOOST_CHECK_EQUAL( Segment::format_utf8(text.data(), &spans[0], spans.size(), &small[0], size), expected.size() );
+				BOOST_CHECK( std::string(small.begin(), small.begin() + size) == expected.substr(0, size) );
+				BOOST_CHECK_EQUAL( small[size], '#' );
+			}
+		}
+	}
+
+	//	no word
+	char buffer[1] = {'#'};
+	BOOST_CHECK_EQUAL( Segment::format_utf8(L"", static_cast<const WordSpan*>(0), 0, buffer, 0), 0 );
+	BOOST_CHECK_EQUAL( buffer[0], '#' );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_Segment_segment_single_sentence, mini_dictionary_fixture )
+{
 	std::wofstream out("data/segment_test.txt");
 	out.imbue(locale_utf8);
 
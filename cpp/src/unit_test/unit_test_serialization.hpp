@@ -11,6 +11,7 @@
 
 #include <openclas/serialization.hpp>
 #include <fstream>
+#include <sstream>
 
 BOOST_AUTO_TEST_SUITE( serialization )
 
@@ -52,9 +53,9 @@ void output_part_dict(std::wofstream& out, Dictionary& dict, const std::wstring&
 				std::vector<DictEntry*> next_entries = dict.prefix(iter+1, text.end());
 				for(std::vector<DictEntry*>::iterator iNextEntry = next_entries.begin(); iNextEntry != next_entries.end(); ++iNextEntry)
 				{
-					DictEntry::transit_type::iterator iForward = entry->forward.find((*iNextEntry)->word);
-					if (iForward != entry->forward.end())
-						out << "\t" << iForward->first << ", weight = " << iForward->second << std::endl;
+					double weight = entry->get_forward_weight((*iNextEntry)->id);
+					if (weight != 0)
+						out << "\t" << (*iNextEntry)->word << ", weight = " << weight << std::endl;
 				}
 			}
 		}
@@ -163,7 +164,7 @@ BOOST_AUTO_TEST_CASE( test_Serialization_ocd )
 	dict.add_tag_transit_weight(1, 2, 123);
 	dict.add_word(L"ABCD")->add(0, 100);
 	dict.add_word(L"AB")->add(1, 200);
-	dict.get_word(L"AB")->forward[L"ABCD"] = 1013;
+	dict.add_word_transit_weight(L"AB", L"ABCD", 1013);
 
 	openclas::save_to_ocd_file(dict, dict_name);
 
@@ -187,7 +188,155 @@ BOOST_AUTO_TEST_CASE( test_Serialization_ocd )
 	BOOST_REQUIRE_EQUAL( entry2->tags.size(), 1 );
 	BOOST_CHECK_EQUAL( entry2->tags[0].tag, 1 );
 	BOOST_CHECK_EQUAL( entry2->tags[0].weight, 200 );
-	BOOST_CHECK_EQUAL( entry2->forward[L"ABCD"], 1013 );
+	BOOST_CHECK_EQUAL( entry2->get_forward_weight(entry1->id), 1013 );
+	BOOST_CHECK_EQUAL( entry1->get_backward_weight(entry2->id), 1013 );
+}
+
+static const char* image_name = "dict.ocd2";
+
+BOOST_AUTO_TEST_CASE( test_Serialization_ocd2 )
+{
+	Dictionary dict;
+	dict.init_tag_dict(10);
+	dict.set_tag_total_weight(1000);
+	dict.add_tag_weight(1, 231);
+	dict.add_tag_transit_weight(1, 2, 123);
+	dict.add_word(L"ABCD")->add(0, 100);
+	dict.add_word(L"AB")->add(1, 200);
+	dict.get_word(L"AB")->add(2, 50);
+	dict.add_word(L"C");
+	dict.add_word_transit_weight(L"AB", L"ABCD", 1013);
+	dict.add_word_transit_weight(L"AB", L"C", 7);
+
+	openclas::save_to_ocd2_file(dict, image_name);
+
+	test_file_existence(image_name);
+	Dictionary dict2;
+	dict2.add_word(L"XYZ");
+	openclas::load_from_ocd2_file(dict2, image_name);
+
+	BOOST_CHECK( dict2.is_read_only() );
+	BOOST_CHECK( dict2.is_frozen() );
+	BOOST_CHECK_EQUAL( dict2.tags().size(), 10 );
+	BOOST_CHECK_EQUAL( dict2.get_tag_total_weight(), 1000 );
+	BOOST_CHECK_EQUAL( dict2.get_tag_weight(1), 231 );
+	BOOST_CHECK_EQUAL( dict2.get_tag_transit_weight(1, 2), 123 );
+	BOOST_CHECK_EQUAL( dict2.longest_word_length(), 4 );
+
+	//	the old words are dropped, and there is no DictEntry
+	BOOST_CHECK_THROW( dict2.words(), std::logic_error );
+	BOOST_CHECK_EQUAL( dict2.word_count(), 3 );
+	BOOST_CHECK_EQUAL( dict2.get_word_id(L"XYZ"), INVALID_WORD_ID );
+	BOOST_CHECK_THROW( dict2.get_word(L"AB"), std::logic_error );
+
+	size_t id1 = dict2.get_word_id(L"ABCD");
+	size_t id2 = dict2.get_word_id(L"AB");
+	size_t id3 = dict2.get_word_id(L"C");
+	BOOST_CHECK_EQUAL( id1, dict.get_word(L"ABCD")->id );
+	BOOST_CHECK_EQUAL( id2, dict.get_word(L"AB")->id );
+	BOOST_CHECK_EQUAL( id3, dict.get_word(L"C")->id );
+	BOOST_CHECK( dict2.get_word_string(id1) == L"ABCD" );
+	BOOST_CHECK( dict2.get_word_string(id2) == L"AB" );
+
+	Dictionary::tag_range_type tags = dict2.get_word_tags(id2);
+	BOOST_REQUIRE_EQUAL( tags.second - tags.first, 2 );
+	BOOST_CHECK_EQUAL( tags.first[0].tag, 1 );
+	BOOST_CHECK_EQUAL( tags.first[0].weight, 200 );
+	BOOST_CHECK_EQUAL( tags.first[1].tag, 2 );
+	BOOST_CHECK_EQUAL( dict2.get_word_weight(id2), 250 );
+	tags = dict2.get_word_tags(id3);
+	BOOST_CHECK( tags.first == tags.second );
+
+	BOOST_CHECK_EQUAL( dict2.get_word_transit_weight(id2, id1), 1013 );
+	BOOST_CHECK_EQUAL( dict2.get_word_transit_weight(id2, id3), 7 );
+	BOOST_CHECK_EQUAL( dict2.get_word_transit_weight(id1, id2), 0 );
+
+	std::wstring text(L"ABCDE");
+	BOOST_CHECK_THROW( dict2.prefix(text), std::logic_error );
+	std::vector<size_t> ids;
+	prefix_collector<size_t> collector(ids);
+	dict2.for_each_prefix(text.begin(), text.end(), collector);
+	BOOST_REQUIRE_EQUAL( ids.size(), 2 );
+	BOOST_CHECK_EQUAL( ids[0], id2 );
+	BOOST_CHECK_EQUAL( ids[1], id1 );
+
+	//	read-only
+	BOOST_CHECK_THROW( dict2.add_word(L"D"), std::logic_error );
+	BOOST_CHECK_THROW( dict2.remove_word(L"AB"), std::logic_error );
+	BOOST_CHECK_THROW( dict2.add_word_transit_weight(L"AB", L"AB", 1), std::logic_error );
+	dict2.unfreeze();
+	BOOST_CHECK( dict2.is_frozen() );
+
+	//	the image of an attached dictionary is the same
+	std::vector<char> buffer, buffer2;
+	build_image(dict, buffer);
+	build_image(dict2, buffer2);
+	BOOST_CHECK( buffer == buffer2 );
+}
+
+BOOST_AUTO_TEST_CASE( test_Serialization_ocd2_save )
+{
+	Dictionary dict;
+	dict.init_tag_dict(10);
+	dict.add_tag_weight(1, 231);
+	dict.add_tag_transit_weight(1, 2, 123);
+	dict.add_word(L"ABCD")->add(0, 100);
+	dict.add_word(L"AB")->add(1, 200);
+	dict.get_word(L"AB")->add(2, 50);
+	dict.add_word(L"C");
+	dict.add_word_transit_weight(L"AB", L"ABCD", 1013);
+	dict.add_word_transit_weight(L"AB", L"C", 7);
+
+	std::wostringstream tag_out, unigram_out, bigram_out;
+	save_to_txt_stream(dict, tag_out, unigram_out, bigram_out);
+
+	//	the attached dictionary is saved from the image
+	openclas::save_to_ocd2_file(dict, image_name);
+	Dictionary dict2;
+	openclas::load_from_ocd2_file(dict2, image_name);
+	std::wostringstream tag_out2, unigram_out2, bigram_out2;
+	save_to_txt_stream(dict2, tag_out2, unigram_out2, bigram_out2);
+	BOOST_CHECK( tag_out2.str() == tag_out.str() );
+	BOOST_CHECK( unigram_out2.str() == unigram_out.str() );
+	BOOST_CHECK( bigram_out2.str() == bigram_out.str() );
+	BOOST_CHECK( !bigram_out2.str().empty() );
+
+	openclas::save_to_ocd_file(dict2, dict_name);
+	Dictionary dict3;
+	openclas::load_from_ocd_file(dict3, dict_name);
+	BOOST_CHECK_EQUAL( dict3.words().size(), 3 );
+	std::wostringstream tag_out3, unigram_out3, bigram_out3;
+	save_to_txt_stream(dict3, tag_out3, unigram_out3, bigram_out3);
+	BOOST_CHECK( tag_out3.str() == tag_out.str() );
+	BOOST_CHECK( unigram_out3.str() == unigram_out.str() );
+	BOOST_CHECK( bigram_out3.str() == bigram_out.str() );
+}
+
+BOOST_AUTO_TEST_CASE( test_Serialization_ocd2_corrupted )
+{
+	Dictionary dict;
+	dict.add_word(L"AB")->add(1, 200);
+
+	boost::shared_ptr<std::vector<char> > buffer(new std::vector<char>());
+	build_image(dict, *buffer);
+	BOOST_CHECK_NO_THROW( DictionaryImage(&(*buffer)[0], buffer->size(), buffer) );
+
+	//	truncated
+	BOOST_CHECK_THROW( DictionaryImage(&(*buffer)[0], sizeof(DictImageHeader) - 1, buffer), std::runtime_error );
+	BOOST_CHECK_THROW( DictionaryImage(&(*buffer)[0], buffer->size() - 1, buffer), std::runtime_error );
+
+	//	not an image
+	std::vector<char> bad(*buffer);
+	reinterpret_cast<DictImageHeader*>(&bad[0])->magic_code = DICT_MAGIC_CODE;
+	BOOST_CHECK_THROW( DictionaryImage(&bad[0], bad.size(), buffer), std::runtime_error );
+
+	//	entry out of range
+	bad = *buffer;
+	const DictImageHeader& header = *reinterpret_cast<DictImageHeader*>(&bad[0]);
+	reinterpret_cast<DictImageEntry*>(&bad[header.offset[IMAGE_ENTRY]])->tag_count = 2;
+	BOOST_CHECK_THROW( DictionaryImage(&bad[0], bad.size(), buffer), std::runtime_error );
+
+	BOOST_CHECK_THROW( load_from_ocd2_file(dict, "not_exist.ocd2"), std::runtime_error );
 }
 
 BOOST_AUTO_TEST_SUITE_END()
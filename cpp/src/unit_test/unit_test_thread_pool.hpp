@@ -0,0 +1,70 @@
+﻿/*
+ * Copyright (c) 2007-2010 Tao Wang <dancefire@gmail.org>
+ * See the file "LICENSE.txt" for usage and redistribution license requirements
+ *
+ *	$Id$
+ */
+
+#pragma once
+#ifndef _OPENCLAS_UNIT_TEST_THREAD_POOL_HPP_
+#define _OPENCLAS_UNIT_TEST_THREAD_POOL_HPP_
+
+#include <openclas/thread_pool.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+BOOST_AUTO_TEST_SUITE( thread_pool )
+
+using namespace openclas;
+
+struct index_recorder {
+	std::vector<size_t> runs;
+	std::vector<size_t> workers;
+	size_t throw_index;
+	explicit index_recorder(size_t count, size_t throw_index = static_cast<size_t>(-1))
+		: runs(count), workers(count), throw_index(throw_index)
+	{}
+	void operator() (size_t index, size_t worker)
+	{
+		++runs[index];
+		workers[index] = worker;
+		if (index == throw_index)
+			throw std::logic_error("task failed");
+	}
+};
+
+BOOST_AUTO_TEST_CASE( test_ThreadPool )
+{
+	ThreadPool single(1);
+	BOOST_CHECK_EQUAL( single.size(), 1 );
+	BOOST_CHECK( ThreadPool().size() >= 1 );
+
+	//	every index runs exactly once, on a valid worker, for any count
+	ThreadPool pool(4);
+	BOOST_REQUIRE_EQUAL( pool.size(), 4 );
+	size_t counts[] = {0, 1, 3, 4, 5, 100, 10007};
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+	{
+		index_recorder recorder(counts[c]);
+		pool.run(counts[c], recorder);
+		for (size_t i = 0; i < counts[c]; ++i)
+		{
+			BOOST_CHECK_EQUAL( recorder.runs[i], 1 );
+			BOOST_CHECK( recorder.workers[i] < pool.size() );
+		}
+	}
+
+	//	the error is thrown after all the tasks are done, and the pool is still usable
+	index_recorder failing(1000, 500);
+	BOOST_CHECK_THROW( pool.run(1000, failing), std::runtime_error );
+	for (size_t i = 0; i < failing.runs.size(); ++i)
+		BOOST_CHECK_EQUAL( failing.runs[i], 1 );
+	index_recorder after(10);
+	pool.run(10, after);
+	BOOST_CHECK_EQUAL( std::count(after.runs.begin(), after.runs.end(), 1), 10 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//	_OPENCLAS_UNIT_TEST_THREAD_POOL_HPP_
+#endif
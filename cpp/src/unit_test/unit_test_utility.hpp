@@ -14,6 +14,9 @@
 #endif
 
 #include <openclas/utility.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 
 BOOST_AUTO_TEST_SUITE( utility )
@@ -297,6 +300,213 @@ BOOST_AUTO_TEST_CASE( test_get_symbol_type )
 	//	SYMBOL_TYPE_OTHER
 }
 
+BOOST_AUTO_TEST_CASE( test_get_symbol_type_table )
+{
+	//	the table should be the same as the ranges for all BMP symbols
+	size_t mismatch = 0;
+	for (unsigned long code = 0; code <= 0xFFFF; ++code)
+	{
+		wchar_t symbol = static_cast<wchar_t>(code);
+		if (get_symbol_type(symbol) != get_symbol_type_by_range(symbol))
+			++mismatch;
+	}
+	BOOST_CHECK_EQUAL( mismatch, 0 );
+
+	//	classify() is the same as get_symbol_type() for each symbol
+	std::vector<wchar_t> text;
+	for (unsigned long code = 0; code <= 0xFFFF; ++code)
+		text.push_back(static_cast<wchar_t>(code));
+	std::vector<enum SymbolType> types(text.size());
+	classify(&text[0], text.size(), &types[0]);
+	mismatch = 0;
+	for (size_t i = 0; i < text.size(); ++i)
+		if (types[i] != get_symbol_type_by_range(text[i]))
+			++mismatch;
+	BOOST_CHECK_EQUAL( mismatch, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_scan_ascii_run )
+{
+	//	every SIMD level should find the same run as the scalar code, for all lengths and all run ends
+	const wchar_t fillers[] = { L'a', L'Z', L'5', L'0', L'9', L'@', L'[', L'`', L'{', L'/', L':', L'中', L'ａ', L'１', L' ' };
+	const size_t filler_count = sizeof(fillers) / sizeof(fillers[0]);
+	enum SimdLevel detected = detect_simd_level();
+
+	srand(random_seed);
+	size_t mismatch = 0;
+	for (int round = 0; round < 2000; ++round)
+	{
+		std::vector<wchar_t> text(rand() % 80 + 1);
+		bool letter = (round % 2 == 0);
+		//	a run of letters or digits, then anything
+		size_t run = rand() % text.size();
+		for (size_t i = 0; i < text.size(); ++i)
+		{
+			if (i < run)
+				text[i] = letter ? static_cast<wchar_t>((rand() % 2 ? L'a' : L'A') + rand() % 26) : static_cast<wchar_t>(L'0' + rand() % 10);
+			else
+				text[i] = fillers[rand() % filler_count];
+		}
+		size_t expected = scan_ascii_run_scalar(&text[0], text.size(), letter);
+		BOOST_CHECK( expected >= run );
+		for (int level = SIMD_NONE; level <= detected; ++level)
+		{
+			if (scan_ascii_run(&text[0], text.size(), letter, static_cast<enum SimdLevel>(level)) != expected)
+				++mismatch;
+		}
+	}
+	BOOST_CHECK_EQUAL( mismatch, 0 );
+
+	BOOST_CHECK_EQUAL( scan_ascii_run(L"", 0, true), 0 );
+	BOOST_CHECK_EQUAL( scan_ascii_run(L"abcXYZ012", 9, true), 6 );
+	BOOST_CHECK_EQUAL( scan_ascii_run(L"0123456789012345678901234567890123456789a", 41, false), 40 );
+	//	the full-width letters are not in an ASCII run
+	BOOST_CHECK_EQUAL( scan_ascii_run(L"googleｇｏｏｇｌｅ", 12, true), 6 );
+	//	the symbols differ from the letters only by 0x20
+	BOOST_CHECK_EQUAL( scan_ascii_run(L"ab@[`{", 6, true), 2 );
+
+	//	the bytes of UTF-8, the multi-byte sequences are never in a run
+	std::string utf8 = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ\xe4\xb8\xad";
+	for (int level = SIMD_NONE; level <= detected; ++level)
+	{
+		BOOST_CHECK_EQUAL( scan_ascii_run(utf8.data(), utf8.size(), true, static_cast<enum SimdLevel>(level)), 52 );
+		BOOST_CHECK_EQUAL( scan_ascii_run(utf8.data() + 3, 40, true, static_cast<enum SimdLevel>(level)), 40 );
+	}
+
+	//	set_simd_level() is limited to the detected level
+	enum SimdLevel previous = set_simd_level(SIMD_NONE);
+	BOOST_CHECK_EQUAL( get_simd_level(), SIMD_NONE );
+	set_simd_level(SIMD_AVX2);
+	BOOST_CHECK_EQUAL( get_simd_level(), detected );
+	set_simd_level(previous);
+}
+
+BOOST_AUTO_TEST_CASE( test_max_plus )
+{
+	//	every SIMD level should find the same scores and backpointers as the scalar code
+	enum SimdLevel detected = detect_simd_level();
+	//	few values, so there are many ties
+	const float values[] = { -std::numeric_limits<float>::infinity(), -3.5f, -2, -1, -0.25f, 0 };
+	const size_t value_count = sizeof(values) / sizeof(values[0]);
+
+	srand(random_seed);
+	size_t mismatch = 0;
+	for (int round = 0; round < 500; ++round)
+	{
+		size_t source_count = rand() % 70 + 1;
+		size_t target_count = rand() % 10 + 1;
+		std::vector<float> score(source_count), transposed(source_count * target_count);
+		for (size_t i = 0; i < score.size(); ++i)
+			score[i] = values[rand() % value_count];
+		for (size_t i = 0; i < transposed.size(); ++i)
+			transposed[i] = values[rand() % value_count];
+
+		std::vector<float> expected(target_count), next(target_count);
+		std::vector<unsigned short> expected_backpointer(target_count), backpointer(target_count);
+		max_plus(&score[0], &transposed[0], source_count, target_count, &expected[0], &expected_backpointer[0], SIMD_NONE);
+		for (int level = SIMD_NONE; level <= detected; ++level)
+		{
+			max_plus(&score[0], &transposed[0], source_count, target_count, &next[0], &backpointer[0], static_cast<enum SimdLevel>(level));
+			if (next != expected || backpointer != expected_backpointer)
+				++mismatch;
+		}
+	}
+	BOOST_CHECK_EQUAL( mismatch, 0 );
+
+	//	the first of the best on a tie
+	float score[] = { 1, 5, 2, 5, 0, 5, 1, 1, 5, 3 };
+	float transposed[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 4 };
+	float next[2];
+	size_t backpointer[2];
+	for (int level = SIMD_NONE; level <= detected; ++level)
+	{
+		max_plus(score, transposed, 10, 2, next, backpointer, static_cast<enum SimdLevel>(level));
+		BOOST_CHECK_EQUAL( next[0], 5 );
+		BOOST_CHECK_EQUAL( backpointer[0], 1 );
+		BOOST_CHECK_EQUAL( next[1], 7 );
+		BOOST_CHECK_EQUAL( backpointer[1], 9 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_encode_utf8 )
+{
+	const wchar_t text[] = L"a\x7f\x80\x7ff\x800\xffff";
+	const char expected[] = "a\x7f\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf";
+	size_t length = sizeof(text) / sizeof(text[0]) - 1;
+	char buffer[sizeof(text) / sizeof(text[0]) * UTF8_MAX_LENGTH];
+	BOOST_REQUIRE_EQUAL( encode_utf8(text, length, buffer), sizeof(expected) - 1 );
+	BOOST_CHECK( std::memcmp(buffer, expected, sizeof(expected) - 1) == 0 );
+	BOOST_CHECK( encode_utf8(std::wstring(text)) == expected );
+	BOOST_CHECK_EQUAL( encode_utf8(text, 0, buffer), 0 );
+
+	//	surrogate pair
+	const wchar_t pair[] = {0xD840, 0xDC00, 0};
+	BOOST_CHECK( encode_utf8(std::wstring(pair)) == "\xf0\xa0\x80\x80" );
+}
+
+BOOST_AUTO_TEST_CASE( test_WORD_TAG_NAME_UTF8 )
+{
+	size_t max_length = 0;
+	for (int tag = 0; tag < WORD_TAG_SIZE; ++tag)
+	{
+		BOOST_CHECK( std::string(WORD_TAG_NAME_UTF8[tag].name) == encode_utf8(WORD_TAG_NAME[tag]) );
+		BOOST_CHECK_EQUAL( WORD_TAG_NAME_UTF8[tag].length, std::strlen(WORD_TAG_NAME_UTF8[tag].name) );
+		max_length = std::max(max_length, WORD_TAG_NAME_UTF8[tag].length);
+	}
+	BOOST_CHECK_EQUAL( max_length, WORD_TAG_NAME_UTF8_MAX_LENGTH );
+	BOOST_CHECK_EQUAL( sizeof(WORD_TAG_NAME_UTF8) / sizeof(WORD_TAG_NAME_UTF8[0]), static_cast<size_t>(WORD_TAG_SIZE) );
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_utf8 )
+{
+	size_t length = 0;
+	const char ascii[] = "a";
+	BOOST_CHECK( decode_utf8(ascii, ascii + 1, length) == L'a' );
+	BOOST_CHECK_EQUAL( length, 1 );
+	const char two[] = "\xc2\xa9";
+	BOOST_CHECK_EQUAL( static_cast<unsigned long>(decode_utf8(two, two + 2, length)), 0xA9 );
+	BOOST_CHECK_EQUAL( length, 2 );
+	const char three[] = "\xe4\xb8\xad";
+	BOOST_CHECK( decode_utf8(three, three + 3, length) == L'中' );
+	BOOST_CHECK_EQUAL( length, 3 );
+	const char four[] = "\xf0\x9f\x98\x80";
+	wchar_t symbol = decode_utf8(four, four + 4, length);
+	if (sizeof(wchar_t) >= 4)
+	{
+		BOOST_CHECK_EQUAL( static_cast<unsigned long>(symbol), 0x1F600 );
+		BOOST_CHECK_EQUAL( length, 4 );
+	}else{
+		BOOST_CHECK( symbol == UTF8_REPLACEMENT_SYMBOL );
+		BOOST_CHECK_EQUAL( length, 1 );
+	}
+
+	//	invalid: truncated, continuation byte, overlong form, surrogate
+	const char* invalid[] = { "\xe4\xb8", "\x80", "\xc0\xaf", "\xed\xa0\x80", "\xff" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+	{
+		BOOST_CHECK( decode_utf8(invalid[i], invalid[i] + strlen(invalid[i]), length) == UTF8_REPLACEMENT_SYMBOL );
+		BOOST_CHECK_EQUAL( length, 1 );
+	}
+
+	//	the iterator decodes the same symbols as the wide string
+	const std::wstring text(L"19９5年底ｇoｏgｌｅ在1月份大会上说的确实在理。English");
+	std::string utf8 = encode_utf8(text);
+	BOOST_CHECK_EQUAL( utf8.substr(0, 2), "19" );
+	Utf8Iterator iter(utf8.data(), utf8.data() + utf8.size());
+	Utf8Iterator end(utf8.data() + utf8.size(), utf8.data() + utf8.size());
+	std::wstring decoded(iter, end);
+	BOOST_CHECK( decoded == text );
+	BOOST_CHECK_EQUAL( static_cast<size_t>(std::distance(iter, end)), text.size() );
+
+	//	skip a run in UTF-8 bytes
+	std::string run = encode_utf8(L"abcDEF中文");
+	Utf8Iterator run_iter(run.data(), run.data() + run.size());
+	wchar_t last = 0;
+	BOOST_CHECK_EQUAL( skip_ascii_run(run_iter, Utf8Iterator(run.data() + run.size(), run.data() + run.size()), true, last), 6 );
+	BOOST_CHECK( last == L'F' );
+	BOOST_CHECK( *run_iter == L'中' );
+}
+
 BOOST_AUTO_TEST_CASE( test_exist )
 {
 	//	char
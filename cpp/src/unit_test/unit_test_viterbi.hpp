@@ -100,6 +100,209 @@ BOOST_AUTO_TEST_CASE( test_viterbi_vector )
 }
 
 
+BOOST_AUTO_TEST_CASE( test_viterbi_decoder )
+{
+	std::vector<double> log_start_p = log_of<double>(start_probability, number_of_states);
+	std::vector<double> log_tran_p = log_of<double>(transition_probability, number_of_states * number_of_states);
+	std::vector<double> log_emit_p = log_of<double>(emission_probability, number_of_states * number_of_observations);
+
+	ViterbiDecoder<double> decoder;
+	std::vector<size_t> path;
+	std::vector<size_t> obs(observation_sequence, observation_sequence + number_of_observation_sequence);
+	double best = decoder.decode(number_of_states, number_of_observations, obs, log_start_p, log_tran_p, log_emit_p, path);
+	BOOST_CHECK_CLOSE( best, std::log(0.009408), 0.00001 );
+	BOOST_REQUIRE_EQUAL( path.size(), 4 );
+	BOOST_CHECK_EQUAL( path[0], Sunny );
+	BOOST_CHECK_EQUAL( path[1], Rainy );
+	BOOST_CHECK_EQUAL( path[2], Rainy );
+	BOOST_CHECK_EQUAL( path[3], Rainy );
+	BOOST_CHECK_CLOSE( log_forward_probability<double>(number_of_states, number_of_observations, obs, log_start_p, log_tran_p, log_emit_p), std::log(0.033612), 0.00001 );
+
+	//	a long sequence underflows the probabilities, but not the log probabilities
+	std::vector<size_t> long_obs;
+	for (int i = 0; i < 1000; ++i)
+		long_obs.insert(long_obs.end(), obs.begin(), obs.end());
+	best = decoder.decode(number_of_states, number_of_observations, long_obs, log_start_p, log_tran_p, log_emit_p, path);
+	BOOST_CHECK( best < -1000 && best > -100000 );
+	BOOST_CHECK_EQUAL( path.size(), long_obs.size() + 1 );
+	BOOST_CHECK_EQUAL( path[0], Sunny );
+
+	//	the decoder is reused for the short sequence
+	best = decoder.decode(number_of_states, number_of_observations, obs, log_start_p, log_tran_p, log_emit_p, path);
+	BOOST_CHECK_CLOSE( best, std::log(0.009408), 0.00001 );
+	BOOST_CHECK_EQUAL( path.size(), 4 );
+
+	//	no path if every start probability is 0
+	std::vector<double> zero_start_p(number_of_states, -std::numeric_limits<double>::infinity());
+	best = decoder.decode(number_of_states, number_of_observations, obs, zero_start_p, log_tran_p, log_emit_p, path);
+	BOOST_CHECK( best == -std::numeric_limits<double>::infinity() );
+	BOOST_CHECK( path.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( test_viterbi_decoder_float )
+{
+	//	the float decoder runs the vectorized kernel, and should agree with double
+	srand(random_seed);
+	const size_t states = 60;
+	const size_t outputs = 30;
+	random_log_model<float> model(states, outputs);
+	const std::vector<float>& start_f = model.start_p;
+	const std::vector<float>& trans_f = model.trans_p;
+	const std::vector<float>& emit_f = model.emit_p;
+	std::vector<double> start_d(start_f.begin(), start_f.end());
+	std::vector<double> trans_d(trans_f.begin(), trans_f.end());
+	std::vector<double> emit_d(emit_f.begin(), emit_f.end());
+	std::vector<size_t> obs;
+	for (int i = 0; i < 50; ++i)
+		obs.push_back(rand() % outputs);
+
+	ViterbiDecoder<double> decoder_d;
+	std::vector<size_t> path_d;
+	double best_d = decoder_d.decode(states, outputs, obs, start_d, trans_d, emit_d, path_d);
+
+	enum SimdLevel previous = get_simd_level();
+	for (int level = SIMD_NONE; level <= detect_simd_level(); ++level)
+	{
+		set_simd_level(static_cast<enum SimdLevel>(level));
+		ViterbiDecoder<float> decoder_f;
+		std::vector<size_t> path_f;
+		float best_f = decoder_f.decode(states, outputs, obs, start_f, trans_f, emit_f, path_f);
+		BOOST_CHECK_CLOSE( best_f, best_d, 0.001 );
+		BOOST_CHECK( path_f == path_d );
+	}
+	set_simd_level(previous);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_viterbi_decoder )
+{
+	//	with all the states as the candidates, it's the same as the dense decoder
+	srand(random_seed);
+	const size_t states = 7;
+	const size_t outputs = 5;
+	random_log_model<double> model(states, outputs);
+	const std::vector<double>& start_p = model.start_p;
+	const std::vector<double>& trans_p = model.trans_p;
+	const std::vector<double>& emit_p = model.emit_p;
+	std::vector<size_t> obs;
+	for (int i = 0; i < 20; ++i)
+		obs.push_back(rand() % outputs);
+
+	ViterbiDecoder<double> dense;
+	std::vector<size_t> dense_path;
+	double dense_best = dense.decode(states, outputs, obs, start_p, trans_p, emit_p, dense_path);
+
+	//	the position t emits obs[t], and the last position is the final state
+	SparseViterbiDecoder<double> sparse;
+	sparse.clear();
+	for (size_t t = 0; t <= obs.size(); ++t)
+	{
+		sparse.add_position();
+		for (size_t state = 0; state < states; ++state)
+		{
+			double log_p = (t < obs.size()) ? emit_p[state * outputs + obs[t]] : 0;
+			if (t == 0)
+				log_p += start_p[state];
+			sparse.add_candidate(state, log_p);
+		}
+	}
+	BOOST_CHECK_EQUAL( sparse.position_count(), obs.size() + 1 );
+	std::vector<size_t> sparse_path;
+	double sparse_best = sparse.decode(dense_transit<double>(trans_p, states), sparse_path);
+	BOOST_CHECK_CLOSE( sparse_best, dense_best, 1e-10 );
+	BOOST_CHECK( sparse_path == dense_path );
+
+	//	a few candidates of each position: (0 or 1), (2), (0 or 2)
+	sparse.clear();
+	sparse.add_position();
+	sparse.add_candidate(0, std::log(0.6));
+	sparse.add_candidate(1, std::log(0.4));
+	sparse.add_position();
+	sparse.add_candidate(2, 0);
+	sparse.add_position();
+	sparse.add_candidate(0, std::log(0.5));
+	sparse.add_candidate(2, std::log(0.5));
+	double trans[] = {
+		std::log(0.1), std::log(0.1), std::log(0.8),
+		std::log(0.1), std::log(0.1), std::log(0.8),
+		std::log(0.9), std::log(0.05), std::log(0.05)
+	};
+	double best = sparse.decode(dense_transit<double>(trans, 3), sparse_path);
+	BOOST_CHECK_CLOSE( best, std::log(0.6 * 0.8 * 0.9 * 0.5), 1e-10 );
+	BOOST_REQUIRE_EQUAL( sparse_path.size(), 3 );
+	BOOST_CHECK_EQUAL( sparse_path[0], 0 );
+	BOOST_CHECK_EQUAL( sparse_path[1], 2 );
+	BOOST_CHECK_EQUAL( sparse_path[2], 0 );
+
+	//	the lattice is unchanged by decode(), so decoding it again gives the same path
+	std::vector<size_t> again_path;
+	BOOST_CHECK_CLOSE( sparse.decode(dense_transit<double>(trans, 3), again_path), best, 1e-10 );
+	BOOST_CHECK( again_path == sparse_path );
+
+	//	no path through a position without candidate
+	sparse.add_position();
+	BOOST_CHECK( sparse.decode(dense_transit<double>(trans, 3), sparse_path) == -std::numeric_limits<double>::infinity() );
+	BOOST_CHECK( sparse_path.empty() );
+
+	//	a candidate without position
+	sparse.clear();
+	BOOST_CHECK_THROW( sparse.add_candidate(0, 0), std::logic_error );
+	SparseViterbiDecoder<double> fresh;
+	BOOST_CHECK_THROW( fresh.add_candidate(0, 0), std::logic_error );
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_viterbi_decoder )
+{
+	//	each sequence of a batch has the same path as the single decoder
+	srand(random_seed);
+	const size_t states = 20;
+	const size_t outputs = 10;
+	random_log_model<float> model(states, outputs);
+	const std::vector<float>& start_p = model.start_p;
+	const std::vector<float>& trans_p = model.trans_p;
+	std::vector<float>& emit_p = model.emit_p;
+	//	no state emits the last output
+	for (size_t i = 0; i < states; ++i)
+		emit_p[i * outputs + outputs - 1] = -std::numeric_limits<float>::infinity();
+
+	//	not a multiple of the lanes, with empty sequences and sequences without path
+	std::vector<std::vector<size_t> > obs(21);
+	for (size_t i = 0; i < obs.size(); ++i)
+	{
+		size_t length = (i % 5 == 0) ? 0 : rand() % 30;
+		for (size_t t = 0; t < length; ++t)
+			obs[i].push_back(rand() % (outputs - 1));
+	}
+	obs[3].push_back(outputs - 1);
+	obs[17].push_back(outputs - 1);
+
+	enum SimdLevel previous = get_simd_level();
+	for (int level = SIMD_NONE; level <= detect_simd_level(); ++level)
+	{
+		set_simd_level(static_cast<enum SimdLevel>(level));
+		ViterbiDecoder<float> single;
+		BatchViterbiDecoder<float> batch;
+		ViterbiBatch<float> result;
+		batch.decode(states, outputs, obs, start_p, trans_p, emit_p, result);
+		BOOST_REQUIRE_EQUAL( result.size(), obs.size() );
+		for (size_t i = 0; i < obs.size(); ++i)
+		{
+			std::vector<size_t> path;
+			float best = single.decode(states, outputs, obs[i], start_p, trans_p, emit_p, path);
+			BOOST_CHECK( result.scores[i] == best );
+			BOOST_CHECK( std::vector<size_t>(result.begin(i), result.end(i)) == path );
+		}
+		BOOST_CHECK( result.begin(3) == result.end(3) );
+		BOOST_CHECK( result.begin(17) == result.end(17) );
+	}
+	set_simd_level(previous);
+
+	//	out of range
+	obs[5].push_back(outputs);
+	BatchViterbiDecoder<float> batch;
+	ViterbiBatch<float> result;
+	BOOST_CHECK_THROW( batch.decode(states, outputs, obs, start_p, trans_p, emit_p, result), std::out_of_range );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 //	_OPENCLAS_UNIT_TEST_VITERBI_HPP_